@@ -0,0 +1,25 @@
+#ifndef AUDIO_PLAYBACK_H
+#define AUDIO_PLAYBACK_H
+
+#include "SampledFunction.h"
+
+// An audition engine that plays a channel straight out of its in-memory function over WASAPI, so hearing an edit doesn't take a save
+// and a round trip through another program. It reads the live buffer, which means changes the user applies are audible within a block
+// or two of landing - the price is that the buffer must actually hold a waveform, which MuteAudioPlayback is there to guarantee.
+
+// Starts playing the given channel function from the given sample, for the given number of real samples, at the given sample rate.
+// The function is taken by its address in the channels array, so the engine follows along when domain flips trade the buffer out.
+// Any playback that's already going is stopped first. Returns zero iff the audio stack couldn't be set up, which just means no audition.
+char StartAudioPlayback(Function**, unsigned long long, unsigned long long, unsigned int);
+
+// Stops playback and releases the audio stack. Fine to call when nothing is playing.
+void StopAudioPlayback();
+
+// Whether a playback is currently going. Turns false on its own when the channel plays out to the end.
+char IsAudioPlaying();
+
+// While muted, playback holds its position and feeds silence. For the windows where the channel buffer holds spectrum bins instead of
+// a waveform - the engine would otherwise blast them out as noise.
+void MuteAudioPlayback(char);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef GPU_FOURIER_H
+#define GPU_FOURIER_H
+
+#include "SampledFunction.h"
+
+// The complex interleaved length where the GPU engine starts being worth the transfer overhead. Below it the CPU engines win outright.
+#define GPU_FOURIER_MIN_LENGTH (1ULL << 24)
+
+// An opaque plan for running transforms of one length and precision on the GPU. All the OpenCL machinery lives behind it so nothing else needs the SDK.
+typedef struct GpuFourierContext GpuFourierContext;
+
+// Tries to build a GPU plan for complex transforms of the given length and type. Returns NULL when there's no usable device or driver around,
+// the length is below the threshold, or it isn't a power of two (the GPU engine only speaks radix-2). Callers just use the CPU engines on NULL.
+GpuFourierContext* CreateGpuFourierContext(unsigned long long, FunctionType);
+
+// Runs the forward FFT of the function in-place on the GPU. Returns zero iff something failed along the way, in which case the
+// function is left untouched and the caller should run the transform on the CPU instead.
+char GpuFFT(GpuFourierContext*, Function*);
+
+// Releases the plan and everything the driver holds for it. Can handle NULL no problem.
+void DeallocateGpuFourierContext(GpuFourierContext*);
+
+#endif
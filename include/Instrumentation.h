@@ -0,0 +1,52 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+// Lightweight scoped timers and counters for finding out where an operation's time went. Compile them in with 'make instrument'.
+// When they're in, every operation prints a breakdown line (I/O wait vs. convert vs. transform vs. paint) to stderr, which
+// 'make run' redirects into errors.log, and the last breakdown also rides on the title bar. Otherwise the macros compile down
+// to nothing at all, so the disabled overhead really is zero.
+
+#ifdef INSTRUMENT
+
+// The things we know how to blame time on.
+typedef enum
+{
+	INSTRUMENT_SLOT_IO,			// Waiting on reads and writes of the open file.
+	INSTRUMENT_SLOT_CONVERT,	// Converting between PCM integers and our sample functions.
+	INSTRUMENT_SLOT_TRANSFORM,	// The FFTs, in both directions.
+	INSTRUMENT_SLOT_PAINT,		// Plotting the waveform and fourier graphs.
+	INSTRUMENT_SLOT_COUNT,
+} InstrumentSlot;
+
+// Records the slot's start time. Use the macros below instead of calling these directly.
+void InstrumentBeginSlot(InstrumentSlot);
+
+// Adds the time since the slot's last recorded start to its total.
+void InstrumentEndSlot(InstrumentSlot);
+
+// Adds to the slot's unit counter (bytes for I/O, samples for the rest), which the report prints next to its time.
+void InstrumentCountUnits(InstrumentSlot, unsigned long long);
+
+// Prints the named operation's breakdown to stderr, saves it for InstrumentLastReport, and zeroes the slots for the next operation.
+void InstrumentReport(const char*);
+
+// The last report as a string, for putting it on screen. Empty until the first report.
+const char* InstrumentLastReport(void);
+
+// Wrap a stretch of code with these two to bill its time to a slot. Slots keep a single start time, so don't nest a slot inside itself.
+#define INSTRUMENT_BEGIN(slot) InstrumentBeginSlot(INSTRUMENT_SLOT_##slot)
+#define INSTRUMENT_END(slot) InstrumentEndSlot(INSTRUMENT_SLOT_##slot)
+#define INSTRUMENT_COUNT(slot, amount) InstrumentCountUnits(INSTRUMENT_SLOT_##slot, amount)
+#define INSTRUMENT_REPORT(operation) InstrumentReport(operation)
+
+#else
+
+// The do-nothing versions for when instrumentation is compiled out.
+#define INSTRUMENT_BEGIN(slot)
+#define INSTRUMENT_END(slot)
+#define INSTRUMENT_COUNT(slot, amount)
+#define INSTRUMENT_REPORT(operation)
+
+#endif
+
+#endif
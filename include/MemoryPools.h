@@ -0,0 +1,40 @@
+#ifndef MEMORY_POOLS_H
+#define MEMORY_POOLS_H
+
+// Allocators for things the editor allocates and frees a lot. malloc is fine for one-off buffers, but a long session of edits churns through cloned
+// sample ranges and little bookkeeping nodes until the heap is so fragmented that commit grows way past the live data and big allocations start failing.
+// Churny allocations come from here instead: arenas hand out pointer-bump chunks and give every block back in one go when they're destroyed, and slab
+// pools recycle fixed-size nodes forever.
+
+// An arena that grabs big blocks and carves chunks out of them by bumping a pointer. Freed chunks are recycled for equal-sized allocations.
+// Allocating and freeing are safe to do from concurrent threads. Creating and destroying the arena are not.
+typedef struct MemoryArena MemoryArena;
+
+// A pool of fixed-size elements carved out of slabs. Freed elements get handed out again before any new slab is grabbed.
+typedef struct SlabPool SlabPool;
+
+// Creates an empty arena. It doesn't grab any memory until the first allocation. Returns NULL in case of failure.
+MemoryArena* CreateMemoryArena();
+
+// Hands out a chunk of the given size from the arena, reusing a freed chunk of the same size when there is one. Returns NULL in case of failure.
+void* ArenaAlloc(MemoryArena*, unsigned long long);
+
+// Returns a chunk gotten from ArenaAlloc to its arena's free list, where a later equal-sized allocation can pick it up. Handles NULL chunks no problem.
+void ArenaFree(MemoryArena*, void*);
+
+// Releases every block the arena ever grabbed in one go, whether its chunks were individually freed or not. Handles NULL arenas no problem.
+void DestroyMemoryArena(MemoryArena*);
+
+// Creates a pool that hands out elements of the given size, grabbing memory a slab of the given element count at a time. Returns NULL in case of failure.
+SlabPool* CreateSlabPool(unsigned long long, unsigned int);
+
+// Hands out one element from the pool. Its contents are garbage, even if it was recycled. Returns NULL in case of failure.
+void* SlabPoolAlloc(SlabPool*);
+
+// Returns an element to its pool for a later SlabPoolAlloc to recycle.
+void SlabPoolFree(SlabPool*, void*);
+
+// Releases the pool and every slab it grabbed. Handles NULL pools no problem.
+void DestroySlabPool(SlabPool*);
+
+#endif
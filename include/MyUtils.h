@@ -51,6 +51,10 @@ unsigned int CountLeadingZeroes(unsigned long long);
 // Returns the smallest power of two that's greater/equal to the given number.
 unsigned long long NextPowerOfTwo(unsigned long long);
 
+// Returns the smallest number of the form m * 2^k with m in {1, 3, 5} that's greater/equal to the given number.
+// These are the lengths the FFT engine handles natively, so padding to them instead of all the way to a power of two can save a lot of memory and work.
+unsigned long long NextMixedRadixLength(unsigned long long);
+
 // Returns TRUE iff a file with the given path (path includes the filename) exists.
 char FileExists(LPCTSTR path);
 
@@ -13,5 +13,6 @@
 #define EDIT_ACTION_REDO 0x8005
 #define EDIT_ACTION_UNDO 0x8006
 #define EDIT_ACTION_APPLY 0x8007
+#define EDIT_ACTION_PLAY 0x800A // 0x8008 and 0x8009 are taken by codes defined over in WindowsMain.c.
 
 #endif
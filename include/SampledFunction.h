@@ -3,6 +3,7 @@
 
 #include <complex.h>
 #include <float.h>
+#include "MemoryPools.h"
 
 typedef enum
 {
@@ -19,8 +20,16 @@ typedef float complex FloatComplex;
 typedef double DoubleReal;
 typedef float FloatReal;
 
+// Same trick for min/max peak pyramids, which come in a variant for each Real precision.
+typedef void PeakPyramid;
+
+// And once more for the magnitude pyramids the fourier plotter zooms with, which come in a variant for each Complex precision.
+typedef void MagnitudePyramid;
+
 // Gets a function f and an index i and returns the i'th sample of f.
-#define get(f, i) ((f).samples[(i) / (f).segmentLen][(i) % (f).segmentLen])
+// Segment lengths are always a power of two, so the divide and modulo this used to do compile down to a shift and a mask.
+// That pair of divisions sat inside every butterfly, conversion loop and reduction, and it was a measurable tax on all of them.
+#define get(f, i) ((f).samples[(i) >> (f).segmentShift][(i) & (f).segmentMask])
 
 // Macros that rename float functions for different precisions.
 // First, things that are only available for complex numbers.
@@ -94,14 +103,20 @@ typedef float FloatReal;
 typedef struct																																								\
 {																																											\
 	FunctionType funcType;																																					\
-	unsigned long long segmentLen;																																			\
+	unsigned long long segmentLen;		/* Always a power of two, so get() can index with a shift and a mask.*/																\
+	unsigned int segmentShift;			/* log2 of segmentLen.*/																											\
+	unsigned long long segmentMask;		/* segmentLen - 1.*/																												\
 	unsigned long long segmentCount;																																		\
 	unsigned long long totalLen;																																			\
 	type** samples;																																							\
+	void* spillFile;	/* Handle (as a void* so windows.h stays out of here) to the temp file the samples spill into when they don't fit on the heap. NULL for heap-backed functions.*/\
+	void* spillMapping;	/* Handle to the file mapping of the spill file. The segments are mapped views of it.*/																\
+	MemoryArena* arena;	/* The arena the samples and their pointer array came from, or NULL when they came straight from the heap.*/										\
 } Function_##type;																																							\
 																																											\
 /* Initializes a function, including allocating its samples array. Returns zero iff there was a memory allocation error.*/													\
 /* If an error does occur, memory allocated before the error does not get freed. You must call DeallocateFunctionInternals yourself to avoid memory leaks.*/				\
+/* If there isn't enough memory for the samples, they spill into a temp file on disk and get paged in and out of RAM on demand, so functions bigger than RAM still work.*/	\
 char AllocateFunctionInternals_##type(Function_##type*, unsigned long long);																								\
 																																											\
 /* Deallocates a function.*/																																				\
@@ -123,7 +138,52 @@ type GetMin_##type(Function_##type, unsigned long long, unsigned long long, unsi
 /* Creates a real function which reads from the same data as the given complex function, but every complex number is read as two real numbers with adjacent indices.*/		\
 /* This is very useful for dealing with real functions in complex interleaved form.*/																						\
 /* Do not call DeallocateFunctionInternals on the returned function unless you are also done with the original complex function.*/											\
-Function_##precision##Real ReadComplexFunctionAsReal_##precision##Complex(Function_##precision##Complex*);
+Function_##precision##Real ReadComplexFunctionAsReal_##precision##Complex(Function_##precision##Complex*);																	\
+																																											\
+/* A pyramid of min/max sample pairs over power-of-two block sizes, mipmap style. Lets the waveform plotter find the exact peaks of any sample range in logarithmic time.*/	\
+typedef struct																																								\
+{																																											\
+	FunctionType funcType;				/* The Real type of the samples. This is the first member so untyped code can dispatch on it, same as with Function.*/				\
+	unsigned long long baseBlockLen;	/* How many samples each block at the bottom level covers. Doubles with every level above it.*/										\
+	unsigned long long levelCount;		/* How many levels the pyramid has. The top level always has a single block covering everything.*/									\
+	unsigned long long* levelLengths;	/* How many blocks each level has.*/																								\
+	precision##Real** mins;				/* For each level, the smallest sample inside each of its blocks.*/																	\
+	precision##Real** maxes;			/* For each level, the biggest sample inside each of its blocks.*/																	\
+} PeakPyramid_##precision##Real;																																			\
+																																											\
+/* Builds a pyramid over the first 'length' samples of the given function. Returns NULL in case of a memory allocation error.*/												\
+PeakPyramid_##precision##Real* CreatePeakPyramid_##precision##Real(Function_##precision##Real, unsigned long long);															\
+																																											\
+/* Deallocates the given pyramid. Handles NULL pointers no problem.*/																										\
+void DeallocatePeakPyramid_##precision##Real(PeakPyramid_##precision##Real*);																								\
+																																											\
+/* Returns the biggest sample between two indices [inclusive, exclusive).*/																									\
+/* The function must be the one the pyramid was built over. The partial blocks at the range's edges are read from it directly, so the result is exact.*/					\
+precision##Real GetPeakPyramidMax_##precision##Real(PeakPyramid_##precision##Real*, Function_##precision##Real, unsigned long long, unsigned long long);					\
+																																											\
+/* Returns the smallest sample between two indices [inclusive, exclusive).*/																								\
+precision##Real GetPeakPyramidMin_##precision##Real(PeakPyramid_##precision##Real*, Function_##precision##Real, unsigned long long, unsigned long long);					\
+																																											\
+/* A pyramid of max bin magnitudes over power-of-two block sizes, like PeakPyramid but for a complex spectrum. Lets the fourier plotter zoom without rescanning bins.*/		\
+typedef struct																																								\
+{																																											\
+	FunctionType funcType;				/* The Complex type of the bins. This is the first member so untyped code can dispatch on it, same as with Function.*/				\
+	unsigned long long baseBlockLen;	/* How many bins each block at the bottom level covers. Doubles with every level above it.*/										\
+	unsigned long long levelCount;		/* How many levels the pyramid has. The top level always has a single block covering everything.*/									\
+	unsigned long long* levelLengths;	/* How many blocks each level has.*/																								\
+	precision##Real** maxes;			/* For each level, the biggest magnitude inside each of its blocks. Magnitudes are never negative so there's no use for mins.*/		\
+	precision##Real globalMax;			/* The biggest magnitude over the whole spectrum, so scaling the graph doesn't even take a lookup.*/								\
+} MagnitudePyramid_##precision##Complex;																																	\
+																																											\
+/* Builds a pyramid over the first 'length' bins of the given spectrum. Returns NULL in case of a memory allocation error.*/												\
+MagnitudePyramid_##precision##Complex* CreateMagnitudePyramid_##precision##Complex(Function_##precision##Complex, unsigned long long);										\
+																																											\
+/* Deallocates the given pyramid. Handles NULL pointers no problem.*/																										\
+void DeallocateMagnitudePyramid_##precision##Complex(MagnitudePyramid_##precision##Complex*);																				\
+																																											\
+/* Returns the biggest bin magnitude between two indices [inclusive, exclusive).*/																							\
+/* The function must be the one the pyramid was built over. The partial blocks at the range's edges are read from it directly, so the result is exact.*/					\
+precision##Real GetMagnitudePyramidMax_##precision##Complex(MagnitudePyramid_##precision##Complex*, Function_##precision##Complex, unsigned long long, unsigned long long);
 
 /* Returns how many samples are used to represent f.*/
 unsigned long long NumOfSamples(Function*);
@@ -134,12 +194,28 @@ FunctionType GetType(Function*);
 // Deallocates memory allocated by the function (not the function itself).
 void DeallocateFunctionInternals(Function*);
 
+// Sets the arena that functions allocated from here on will take their segment storage from. Pass NULL to go back to plain heap allocations.
+// Deallocating a function is always safe regardless of the current arena, because each function remembers where its memory came from.
+void SetFunctionArena(MemoryArena*);
+
 // Clones the source function in the given sample range.
 Function* CreatePartialClone(Function*, unsigned long long, unsigned long long);
 
 // Copies the samples from the source function to the destination function, from their given starting points.
 void CopySamples(Function*, Function*, unsigned long long, unsigned long long, unsigned long long);
 
+// Builds a min/max peak pyramid over the real sequence that the given complex interleaved function encodes. Returns NULL in case of a memory allocation error.
+PeakPyramid* CreatePeakPyramid(Function*, unsigned long long);
+
+// Deallocates the given pyramid. Handles NULL pointers no problem.
+void DeallocatePeakPyramid(PeakPyramid*);
+
+// Builds a max magnitude pyramid over the first 'length' bins of the given complex spectrum. Returns NULL in case of a memory allocation error.
+MagnitudePyramid* CreateMagnitudePyramid(Function*, unsigned long long);
+
+// Deallocates the given pyramid. Handles NULL pointers no problem.
+void DeallocateMagnitudePyramid(MagnitudePyramid*);
+
 SAMPLED_FUNCTION_H_TYPED_CONTENTS(FloatComplex)
 SAMPLED_FUNCTION_H_TYPED_CONTENTS(DoubleComplex)
 SAMPLED_FUNCTION_H_TYPED_CONTENTS(FloatReal)
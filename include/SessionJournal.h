@@ -0,0 +1,59 @@
+#ifndef SESSION_JOURNAL_H
+#define SESSION_JOURNAL_H
+
+#include "SoundEditor.h"
+#include <windows.h> // For dealing with the journal file's path in TCHARs.
+
+// What a journal entry says happened. Applies carry the full parameters of the change, undos and redos are the action alone.
+typedef enum
+{
+	JOURNAL_APPLY,
+	JOURNAL_UNDO,
+	JOURNAL_REDO,
+} JournalAction;
+
+// One recorded action, exactly as the user made it. For applies the fields are the raw inputs that ApplyModification takes,
+// so replaying an entry is just calling it again.
+typedef struct
+{
+	unsigned char action;			// One of JournalAction.
+	unsigned char changeType;		// One of ChangeType. Only meaningful for applies, same as every field below.
+	unsigned short channel;			// The channel the change was applied to.
+	unsigned long long fromSample;	// The first sample of the changed range.
+	unsigned long long toSample;	// The last sample of the changed range.
+	double changeAmount;			// How much was changed.
+	double smoothing;				// The raw 0-1 smoothing, before ApplyModification reshapes it for additive changes.
+} JournalEntry;
+
+// An append-only sidecar file that records every edit made since the last full save, each one committed to disk the moment it happens.
+// Saving the file empties the journal, and a crash leaves it behind for the next session to replay. Every function here shrugs off NULL journals,
+// so callers can treat journaling as best-effort and never check whether opening one worked.
+typedef struct SessionJournal SessionJournal;
+
+// Opens the journal sidecar that sits next to the wave file at the given path, creating it when there isn't one. The sample length and channel
+// count get stamped into its header, and an existing journal whose stamp doesn't match is thrown out as stale. Returns NULL when the journal
+// can't be had for any reason, which just means this session goes without crash protection.
+SessionJournal* OpenSessionJournal(LPCTSTR, unsigned long long, unsigned short);
+
+// How many entries the journal holds. Nonzero right after opening means a past session crashed and left work behind to replay.
+unsigned long long SessionJournalEntries(SessionJournal*);
+
+// Reads the n'th entry into the given struct. Returns zero iff it couldn't be read.
+char ReadSessionJournalEntry(SessionJournal*, unsigned long long, JournalEntry*);
+
+// Appends an entry and flushes it all the way down to the disk, so it survives anything short of the power going out mid-call.
+// A failed append quietly turns journaling off for the rest of the session - the program shouldn't refuse to edit just because it couldn't journal.
+void AppendSessionJournalEntry(SessionJournal*, const JournalEntry*);
+
+// Empties the journal. For right after a full save, which makes every entry redundant.
+void ResetSessionJournal(SessionJournal*);
+
+// Empties the journal and then re-records one apply per modification on the (exclusive) path between the two given stack nodes.
+// For when a background save finishes while the user kept editing - those newer edits aren't in the saved file, so they keep their protection.
+// When the saved node isn't actually below the top (the user undid past it mid-save), this just empties the journal like ResetSessionJournal.
+void RewriteSessionJournal(SessionJournal*, Modification*, Modification*);
+
+// Closes the journal, deleting its file when it's empty so sidecars don't pile up next to files that were closed cleanly.
+void CloseSessionJournal(SessionJournal*);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include "SampledFunction.h"
+
+// Returns nonzero iff the CPU supports the instruction sets (AVX2 and FMA) that the kernels in this module are built for.
+// Check this once and only call the kernels when it's nonzero. Code that uses the kernels is expected to keep its scalar version around as a fallback.
+char SimdKernelsSupported(void);
+
+#define SIMD_KERNELS_H_PRECISION_CONTENTS(precision)																									\
+/* Computes FFT butterflies over two contiguous runs of samples: the samples the even sums are read from and written to, and likewise for the odds.*/	\
+/* The arguments are: even samples, odd samples, the twiddle factor of the first butterfly, the distance in elements between one butterfly's*/			\
+/* twiddle factor and the next (may be negative), whether to apply FlipReal to every twiddle factor, and how many butterflies to compute.*/				\
+/* The caller has to make sure all three runs are contiguous in memory, segmented functions being what they are.*/										\
+void FFTButterflies_##precision##Complex(precision##Complex*, precision##Complex*, const precision##Complex*, long long, char,							\
+										 unsigned long long);																							\
+																																						\
+/* Describes where one input's twiddle factors for a run of radix-4 butterflies sit: the factor of the run's first butterfly, the distance in*/			\
+/* elements between consecutive factors (may be negative), and which sign flips to apply to every factor loaded (they compose).*/						\
+typedef struct																																			\
+{																																						\
+	const precision##Complex* base;																														\
+	long long stride;																																	\
+	char flipReal;																																		\
+	char conjugate;																																		\
+} TwiddleStream_##precision##Complex;																													\
+																																						\
+/* Computes radix-4 FFT butterflies over four contiguous runs of samples, one per input of the butterfly.*/												\
+/* The arguments are: the four sample runs in tree order, the twiddle streams for the second, third and fourth runs, and how many butterflies.*/		\
+void FFTButterflies4_##precision##Complex(precision##Complex*, precision##Complex*, precision##Complex*, precision##Complex*,							\
+										  TwiddleStream_##precision##Complex, TwiddleStream_##precision##Complex,										\
+										  TwiddleStream_##precision##Complex, unsigned long long);														\
+																																						\
+/* Applies the forward postprocessing (or backward preprocessing) step of the real interleaved FFT to pairs of samples with consecutive even*/			\
+/* indices k, advancing by 2 each step. The arguments are: the samples at the indices k (ascending), the samples at the indices len-k (descending),*/	\
+/* the cached roots of unity at the indices k/2 (ascending and contiguous), whether this is for the backward transform, and the pair count.*/			\
+void PostprocessEvenIndices_##precision##Complex(precision##Complex*, precision##Complex*, const precision##Complex*, char, unsigned long long);		\
+																																						\
+/* Like PostprocessEvenIndices, but for consecutive odd indices 1<=k<=len/4, which need square roots of the cached roots of unity and which*/			\
+/* handle the two pairs (k, len-k) and (halfLen-k, halfLen+k) in each step. The arguments are: the samples at the indices k (ascending), len-k*/		\
+/* (descending), halfLen-k (descending) and halfLen+k (ascending), then the cached roots at the indices k (ascending, every other element),*/			\
+/* whether this is for the backward transform, and the pair-of-pairs count.*/																			\
+void PostprocessOddIndices_##precision##Complex(precision##Complex*, precision##Complex*, precision##Complex*, precision##Complex*,						\
+												const precision##Complex*, char, unsigned long long);													\
+																																						\
+/* Converts a run of interleaved PCM samples into reals in the [-1, 1] range, reading one integer sample every 'stride' bytes and storing the*/			\
+/* results contiguously. The byte depth picks the integer format the same way LoadPCMInterleaved does: depth 1 is biased 8-bit and the rest are*/		\
+/* two's complement. The float version handles all four depths; the double one only depths 3 and 4, since shallower files always load as floats.*/		\
+/* The arguments are: destination, source bytes, sample count, depth and stride.*/																		\
+void ConvertPcmToReal_##precision##Real(precision##Real*, const unsigned char*, unsigned long long, int, int);											\
+																																						\
+/* The inverse of ConvertPcmToReal: scales reals back up to integers of the given depth with triangular dither, clamping and rounding,*/				\
+/* and stores each one at its place in the interleaved blocks. The arguments are: destination bytes, source reals, sample count, depth and stride.*/	\
+void ConvertRealToPcm_##precision##Real(unsigned char*, const precision##Real*, unsigned long long, int, int);											\
+																																						\
+/* Returns the biggest sample in a contiguous run of reals. The arguments are: the samples and how many of them there are.*/							\
+precision##Real ReduceMax_##precision##Real(const precision##Real*, unsigned long long);																\
+																																						\
+/* Returns the smallest sample in a contiguous run of reals.*/																							\
+precision##Real ReduceMin_##precision##Real(const precision##Real*, unsigned long long);																\
+																																						\
+/* Returns the sample with the biggest magnitude in a contiguous run of complex numbers, comparing by squared magnitude so no per-sample*/				\
+/* square root is ever taken. Returns NAN when the run is empty.*/																						\
+precision##Complex ReduceMaxMagnitude_##precision##Complex(const precision##Complex*, unsigned long long);												\
+																																						\
+/* Computes the magnitude of each complex number in a strided run and stores them contiguously, with the exact arithmetic the modification kernels*/	\
+/* below use, so callers that need to predict what those kernels will do can agree with them down to the last bit.*/									\
+/* The arguments are: destination, samples, the distance in elements from one sample to the next (may be negative), and the sample count.*/				\
+void Magnitudes_##precision##Complex(precision##Real*, const precision##Complex*, long long, unsigned long long);										\
+																																						\
+/* Adds a run of amounts to the magnitudes of two runs of complex numbers without changing their phases, clamping the new magnitudes at zero.*/			\
+/* The first run ascends from its pointer and the second descends from its pointer, the way symmetric edits walk a band from both ends, and the*/		\
+/* amounts apply to both. The arguments are: the ascending samples, the descending samples, the amounts, and how many samples each run has.*/			\
+void MagnitudeAdd_##precision##Complex(precision##Complex*, precision##Complex*, const precision##Real*, unsigned long long);							\
+																																						\
+/* Evaluates amount * e^(-x^2) at the points x, x+step, x+2*step, ... into a contiguous run, with a vectorized exponential instead of libm's.*/			\
+/* The arguments are: destination, the first point, the step between points, the amount, and the point count.*/											\
+void GaussianAdditions_##precision##Real(precision##Real*, precision##Real, precision##Real, precision##Real, unsigned long long);						\
+																																						\
+/* Multiplies two runs of complex numbers (one ascending, one descending, like MagnitudeAdd) by the rising half of a Tukey window: sample n gets*/		\
+/* multiplied by 1 + amountMinusOne * (0.5 - 0.5*cos(phase + n*step)). The cosines come from a rotation recurrence instead of libm calls.*/				\
+/* The arguments are: the ascending samples, the descending samples, the first phase, the phase step, the amount minus one, whether to divide*/			\
+/* instead of multiply (that's how multiplications undo), and the sample count.*/																		\
+void TukeyRamp_##precision##Complex(precision##Complex*, precision##Complex*, precision##Real, precision##Real, precision##Real, char,					\
+									unsigned long long);
+
+SIMD_KERNELS_H_PRECISION_CONTENTS(Float)
+SIMD_KERNELS_H_PRECISION_CONTENTS(Double)
+
+#endif
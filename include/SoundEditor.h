@@ -2,6 +2,13 @@
 #define SOUND_EDITOR_H
 
 #include "SampledFunction.h"
+#include "ThreadPool.h"
+#include "GpuFourier.h"
+#include <windows.h> // For the CRITICAL_SECTION the cache carries.
+
+// The real range of smoothing values additive changes use. The 0-1 value the user picks gets interpolated between these.
+#define MIN_ADDITIVE_SMOOTHING 0.4
+#define MAX_ADDITIVE_SMOOTHING 0.01
 
 typedef enum
 {
@@ -11,12 +18,16 @@ typedef enum
 
 typedef struct Modification
 {
-	Function* oldFunc;				// The values that were in place before the modification. We only store samples that were changed.
+	Function* oldFunc;				// The values that were in place before the modification. NULL when the parameters alone are enough to undo it, which is most changes.
 	unsigned long long startSample; // The sample from which the modification was applied.
+	unsigned long long length;		// How many samples the modification covers, starting at startSample.
 	ChangeType changeType;			// Whether the modification was additive or multiplicative.
 	double changeAmount;			// How much was changed.
 	double smoothing;				// How smoothed the change was. 0 for totally square, 1 for totally curved.
 	unsigned short channel;			// The channel that the change was applied to.
+	unsigned long long clampedCount;	// How many samples an additive change flattened to zero magnitude. Those lose their phase, so they're the only ones whose old values have to be stored.
+	unsigned long long* clampedIndices;	// The indices (relative to startSample) of the flattened samples.
+	Function* clampedValues;		// The old values of the flattened samples, packed in the order their indices appear above.
 	struct Modification* prev;		// The modification before this one.
 	struct Modification* next;		// The modification after this one.
 } Modification;
@@ -25,8 +36,15 @@ typedef struct Modification
 typedef struct
 {
 	Function* twiddleFactors; 		// An array of all the twiddle factors up to the N/2'th one when N is the length of the complex interleaved functions.
-	unsigned long long length;		// The length of complex interleaved functions this cache is for. This is assumed to be a power of two and at least 8.
-	unsigned long long logLength;	// The log2 of the length field above.
+	unsigned long long length;		// The length of complex interleaved functions this cache is for. This is assumed to come from NextMixedRadixLength, so it's oddFactor * 2^logLength.
+	unsigned long long logLength;	// The log2 of the power-of-two part of the length field above.
+	unsigned long long oddFactor;	// The odd part of the length: 1, 3 or 5. Lengths with an odd factor go through the mixed-radix engine.
+	ThreadPool* threadPool;			// A pool of worker threads that the FFT spreads its butterfly passes across. May be NULL, in which case everything runs serially.
+	unsigned long long* reversalTable; // The precomputed reversal permutation the FFT sorts the array with. Covers only the middle index digits for lengths big enough to swap in tiles.
+	unsigned char* visitedFlags;	// One bit per sample, scratch for following the cycles of the mixed-radix engine's shuffle. NULL for power-of-two lengths.
+	CRITICAL_SECTION visitedLock;	// Serializes the shuffle, because channels transform concurrently on save and the scratch above is shared between them.
+	char radix4;					// Whether FFTs with this cache go through the radix-4 engine. Only possible when the length is a power of four.
+	GpuFourierContext* gpu;			// A GPU plan that takes whole transforms for huge power-of-two lengths. NULL when the length is modest or there's no usable device, which is the common case.
 } SoundEditorCache;
 
 // Creates a cache of things the sound editor wants to reuse as long as it's dealing with real interleaved functions of the same length and type as the one given.
@@ -39,11 +57,45 @@ void DeallocateSoundEditorCache(SoundEditorCache*);
 // Applies an FFT to the function assuming that it's a real function in complex interleaved form, as described in this document:
 // https://www.ti.com/lit/an/spra291/spra291.pdf?ts=1597858546752&ref_url=https%253A%252F%252Fwww.google.co.il%252F.
 // Basically, f is treated as if it's a complex sequence where the real parts correspond to even indices of a real sequence g, and the imaginary parts correspond to odds.
+// Note that the result is already the packed half spectrum: the 2N real samples have N+1 unique bins (the rest are their conjugate mirrors), and they live in the
+// same N complex slots the waveform occupied, with no mirrored copies stored anywhere. Editing stored bin k implicitly moves bin 2N-k too - that's how the inverse
+// transform's preprocessing reads it. So the frequency domain costs no more memory than the time domain, and edit loops only ever touch the bins they were given.
 void RealInterleavedFFT(Function*, SoundEditorCache*);
 
 // Applies an IFFT to the function assuming it's a real function in complex interleaved form.
 void InverseRealInterleavedFFT(Function*, SoundEditorCache*);
 
+// A copy of a channel's function in the opposite domain from the one the channel is currently in. Keeping both representations around means
+// domain flips can swap buffers instead of transforming, and a narrow-band frequency edit can patch the waveform by synthesizing just the
+// changed bins instead of re-running the whole inverse transform.
+typedef struct
+{
+	Function* func;					// The other-domain representation of the channel.
+	Function* bandBackup;			// During a band edit, the pre-edit values of the bins that are being changed. NULL the rest of the time.
+	unsigned long long bandStart;	// The index of the first bin that bandBackup holds.
+	char synced;					// Whether func is up to date with the channel. When it isn't, the next domain flip has to do a full transform again.
+} SpectralShadow;
+
+// Creates a shadow holding a copy of the given function, in whatever domain it's currently in. Returns NULL in case of a memory allocation error.
+SpectralShadow* CreateSpectralShadow(Function*);
+
+// Deallocates the given shadow. Handles NULL pointers no problem.
+void DeallocateSpectralShadow(SpectralShadow*);
+
+// Copies the channel's current representation into the shadow, bringing it back in sync after it went stale.
+void RefreshSpectralShadow(SpectralShadow*, Function*);
+
+// Exchanges the shadow's representation with the channel's. This is what flips the domain when the two are in sync.
+void SwapSpectralShadow(SpectralShadow*, Function**);
+
+// Call right before modifying the bins [from, to] of a frequency-domain channel whose shadow holds the waveform. Backs up the band so the
+// edit's spectral delta can be computed afterwards. When the band is too wide for sparse synthesis to beat the full transform (or it includes
+// bin 0, which packs the 0Hz and Nyquist values together), the shadow is marked stale instead and the edit proceeds like before.
+void BeginSpectralShadowBandEdit(SpectralShadow*, Function*, unsigned long long, unsigned long long, SoundEditorCache*);
+
+// Call right after the band edit. Synthesizes the changed bins' contribution directly into the shadowed waveform, keeping it in sync.
+void EndSpectralShadowBandEdit(SpectralShadow*, Function*, SoundEditorCache*);
+
 // Applies a modification to the function in the given channel and stores the modification in the modifications stack. Returns zero iff there was a memory allocation error.
 char ApplyModification(unsigned long long, unsigned long long, ChangeType, double, double, unsigned short, Function**, Modification**);
 
@@ -8,7 +8,7 @@
 /* Returns NULL in case of failure, which is probably caused by there not being enough memory available.*/														\
 SoundEditorCache* InitializeSoundEditor_##type(Function_##type*);																								\
 																																								\
-/* Swaps each element in the array with its bit-reverse. Assumes function length is a power of two.*/															\
+/* Swaps each element in the array with its bit-reverse, using the permutation table precomputed in the cache. Assumes function length is a power of two.*/		\
 void BitReverseArr_##type(Function_##type, SoundEditorCache*);																									\
 																																								\
 /* Calculates the DFT of a real sequence in complex interleaved form.*/																							\
@@ -17,15 +17,18 @@ void RealInterleavedFFT_##type(Function_##type, SoundEditorCache*);
 /* Takes half the DFT of a real sequence and calculates the original interleaved sequence.*/																	\
 void InverseRealInterleavedFFT_##type(Function_##type, SoundEditorCache*);																						\
 																																								\
-/* In-place cooley-tukey FFT. Assumes function length is a power of two.*/																						\
+/* In-place cooley-tukey FFT. Assumes the function length came from NextMixedRadixLength.*/																		\
 void FFT_##type(Function_##type f, SoundEditorCache*);																											\
 																																								\
-/* In-place inverse FFT. Assumes function length is a power of two.*/																							\
+/* In-place inverse FFT. Assumes the function length came from NextMixedRadixLength.*/																			\
 void InverseFFT_##type(Function_##type f, SoundEditorCache*);
 
 // Returns the reverse of a number with respect to a number of digits given.
 unsigned long long BitReverse(unsigned int, unsigned long long);
 
+// Returns the base-4 digit reverse of a number with respect to a number of base-4 digits given. The sorting order the radix-4 FFT engine wants.
+unsigned long long DigitReverse4(unsigned int, unsigned long long);
+
 // Deallocates memory for the current modification and its next ones until the end.
 void DeallocateModificationsNextwards(Modification*);
 
@@ -35,8 +38,9 @@ void DeallocateModificationsPrevwards(Modification*);
 // Deallocates a single modification.
 void DeallocateModification(Modification*);
 
-// Applies the given modification on the right function from the channels data.
-void ApplyModificationInternal(Function**, Modification*);
+// Applies the given modification on the right function from the channels data, or its exact inverse when the invert flag is set.
+// Inverting is how modifications that don't store the old samples get undone: multiplications divide back and additions subtract back.
+void ApplyModificationInternal(Function**, Modification*, char);
 
 SOUND_EDITOR_INTERNAL_H_TYPED_CONTENTS(DoubleComplex)
 SOUND_EDITOR_INTERNAL_H_TYPED_CONTENTS(FloatComplex)
@@ -0,0 +1,30 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// A pool of worker threads that persists between operations, so that repeated parallel computations don't pay the cost of spawning threads every time.
+// The pool is used through ParallelFor, which splits an index range into chunks and runs a job on all of them concurrently.
+typedef struct ThreadPool ThreadPool;
+
+// The type of jobs that can be dispatched to the pool. The job receives a caller-provided context and the [begin, end) subrange it should process.
+typedef void (*ThreadPoolJob)(void*, unsigned long long, unsigned long long);
+
+// Creates a thread pool with the given number of workers. Pass 0 to create one worker per logical processor.
+// Returns NULL in case of failure. Code that uses the pool is expected to fall back to serial execution when it's NULL.
+ThreadPool* CreateThreadPool(unsigned int);
+
+// Shuts down the pool's workers and deallocates it. Handles NULL pointers no problem.
+void DestroyThreadPool(ThreadPool*);
+
+// Returns how many threads participate in work dispatched to this pool, including the calling thread. Returns 1 for NULL pools.
+unsigned int GetThreadPoolParallelism(ThreadPool*);
+
+// Runs the given job over the range [begin, end), split into chunks which are processed concurrently by the pool's workers and the calling thread.
+// Blocks until the entire range has been processed. The job must not touch data that other chunks touch, except for reading.
+// If the pool is NULL, or the range is small, or this is called from inside a pool worker (nested parallelism), the whole range runs serially on the calling thread.
+void ParallelFor(ThreadPool*, ThreadPoolJob, void*, unsigned long long, unsigned long long);
+
+// Like ParallelFor, but without the fallback to serial execution for short ranges - even a range of 2 gets split across threads.
+// For jobs where every single index is a big pile of work, like converting a whole channel, rather than a few arithmetic operations.
+void ParallelForHeavy(ThreadPool*, ThreadPoolJob, void*, unsigned long long, unsigned long long);
+
+#endif
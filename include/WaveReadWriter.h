@@ -66,13 +66,14 @@ typedef struct
 typedef struct
 {
 	ChunkHeader header;
-	DWORD relativeOffset; // The offset that the header begins in relative to the offset in the WaveformChunk this belongs to.
+	unsigned long long size;		   // The chunk's real byte size. Usually just header.size, except in RF64 files where that field is stuck at 0xFFFFFFFF and the truth lives in the ds64 chunk.
+	unsigned long long relativeOffset; // The offset that the header begins in relative to the offset in the WaveformChunk this belongs to.
 } WaveformSegment;
 
 typedef struct
 {
 	char isList;
-	DWORD offset; // For lists, this should point to the byte after the 'wavl' FOURCC. For non-lists, this points to the first byte in the chunk header of the data chunk.
+	unsigned long long offset; // For lists, this should point to the byte after the 'wavl' FOURCC. For non-lists, this points to the first byte in the chunk header of the data chunk.
 	DWORD segmentsLength;
 	WaveformSegment* segments;
 } WaveformChunk;
@@ -84,7 +85,10 @@ typedef struct
 	WaveHeader header;
 	FormatChunk format;
 	WaveformChunk waveform;
-	DWORD sampleLength;
+	unsigned long long sampleLength;
+	char isRF64;				// Whether this is an RF64/BW64 file, which is how WAVE files outgrow the format's 4GB ceiling.
+	unsigned long long riffSize;	// The file size minus the first chunk header. Comes from the RIFF header normally, or the ds64 chunk for RF64 files.
+	unsigned long long dataSize;	// The data chunk's real size, from the ds64 chunk. Only meaningful for RF64 files.
 } FileInfo;
 
 // Closes the given file, and deallocates it.
@@ -96,13 +100,22 @@ ReadWaveResult ReadWaveFile(FileInfo**, LPCTSTR);
 // Occupies the given FileInfo with data about what the current file is according to the given new file creation parameters.
 void CreateNewFile(FileInfo**, unsigned int, unsigned int, unsigned int);
 
-// Loads the PCM data of the wave file into an array of functions it will allocate at the given address, such that the i'th function corresponds to the i'th channel.
+// Allocates the channel functions LoadPCMInterleaved fills at the given address, such that the i'th function corresponds to the i'th channel, without reading anything yet.
+// It's split out from the load so callers can start work that only needs the functions' type and length - like building the editor cache - while the PCM still loads.
+// Returns zero iff there is insufficient memory for the operation.
+char AllocateChannelsData(FileInfo*, Function***);
+
+// Loads the PCM data of the wave file into the channel functions that AllocateChannelsData allocated, reading each run of blocks while the previous one converts.
 // The data is loaded "interleaved", meaning each sample is complex, the real parts correspond to even indices of PCM samples, and the imaginary parts correspond to odds.
-// Additionally, zero-padding is added to bring the sample length to a power of two.
+// Additionally, zero-padding is added to bring the sample length to an FFT-friendly length.
 // Returns zero iff there is insufficient memory for the operation.
-char LoadPCMInterleaved(FileInfo*, Function***);
+char LoadPCMInterleaved(FileInfo*, Function**);
+
+// Sets whether files opened from now on get loaded into the single precision pipeline even when their byte depth would normally pick double precision.
+// Floats halve the memory and bandwidth of everything downstream, at a precision that's plenty for interactive work. Files already open are unaffected.
+void SetSinglePrecisionProcessing(char);
 
-// Writes the modified data from memory back to the file. Returns zero iff there is insufficient memory for the operation.
+// Writes the modified data from memory back to the file, overlapping sample conversion with the disk writes. Returns zero iff there was insufficient memory or a write failed.
 char WriteWaveFile(FILE*, FileInfo*, Function**);
 
 // Creates a new file with the modified data that we have in memory. Returns zero iff it failed to create the new file or there was insufficient memory for the operation.
@@ -7,13 +7,16 @@
 void AllocateWaveFile(FileInfo**, LPCTSTR);
 
 // Locates important chunks and assigns their offsets at the given addresses. Also determines whether the wave data is a list. Returns zero iff there's a chunk that appeared more than once.
-ReadWaveResult FindImportantChunks(FileInfo*, DWORD*, DWORD*);
+ReadWaveResult FindImportantChunks(FileInfo*, unsigned long long*, unsigned long long*);
+
+// Reads the ds64 chunk that RF64 files must lead with, and keeps the 64-bit sizes it carries in the FileInfo. Returns a nonzero value iff it succeeded.
+char ReadDS64Chunk(FileInfo*);
 
 // Reads the data at the given offset in the file into the format field of the FileInfo. Returns a nonzero value iff it succeeded.
-char ReadFormatChunk(FileInfo*, DWORD);
+char ReadFormatChunk(FileInfo*, unsigned long long);
 
 // Reads the data at the given offset in the file into the waveform field of the FileInfo. Returns a nonzero value iff it succeeded.
-char ReadWaveformChunk(FileInfo*, DWORD);
+char ReadWaveformChunk(FileInfo*, unsigned long long);
 
 // Checks that all the chunks that have already been read into the fileInfo are supported and in line with the specifications. Returns FILE_READ_SUCCESS iff the chunks are valid.
 ReadWaveResult ValidateFile(FileInfo*);
@@ -27,6 +30,13 @@ ReadWaveResult ValidateWaveform(FileInfo*);
 // Counts the length of a single channel from this file in samples.
 unsigned long long CountSampleLength(FileInfo*);
 
+// Maps the entire file into memory for reading and writing, storing the mapping handle at the given address for UnmapWaveFile.
+// Returns the base of the view, or NULL in case of failure, in which case callers fall back to buffered fread/fwrite.
+BYTE* MapWaveFile(FILE*, HANDLE*);
+
+// Unmaps a view created by MapWaveFile and closes the mapping. Handles NULL pointers no problem.
+void UnmapWaveFile(BYTE*, HANDLE);
+
 // Copies the given source file into the destination.
 char CopyWaveFile(FILE*, FILE*);
 
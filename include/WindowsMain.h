@@ -3,6 +3,7 @@
 
 #include "WaveReadWriter.h"
 #include "SoundEditor.h"
+#include "SessionJournal.h"
 #include <windows.h>
 
 typedef enum
@@ -37,6 +38,10 @@ typedef struct
 	Function** channelsData;			// An array of function pointers. This can be either the waveform or the DFT, we swap between them.
 	SoundEditorCache* soundEditorCache;	// A cache that the sound editor uses to speed up calculations.
 	FunctionDomain* channelsDomain;		// An array that contains the current domains of all the channels (time if it currently has the waveform, frequency if it currently has the DFT).
+	SpectralShadow** channelsShadow;	// An array of each channel's copy in the opposite domain, so domain flips don't have to transform every time. Entries are NULL until the channel's first flip.
+	PeakPyramid** channelsPeaks;		// An array of each channel's min/max peak pyramid, which the waveform plotter queries instead of rescanning the samples. Entries are NULL until the first plot, and edits reset them.
+	MagnitudePyramid** channelsMagnitudes;	// An array of each channel's max magnitude pyramid, which the fourier plotter queries instead of rescanning the bins. Managed the same way as channelsPeaks.
+	MemoryArena* segmentArena;			// The arena all this file's segment storage comes from, so closing the file releases it in bulk instead of freeing the heap piece by piece.
 
 	HBITMAP* waveformGraphs;			// An array of bitmaps including graphs of all the channels' waveforms. NULL for channels that aren't drawn yet.
 	HBITMAP* fourierGraphs;				// An array of bitmaps including graphs of all the channels' fourier transforms. NULL for channels that aren't drawn yet.
@@ -48,9 +53,17 @@ typedef struct
 
 	char isSelecting;					// True iff the user is currently dragging the mouse around to select frequencies.
 	double selectionPivot;				// While isSelecting is true, this contains the frequency at which the selection started.
+	double fourierZoomFrom;				// Where the visible part of the fourier graph begins, as a fraction of the spectrum. 0 when fully zoomed out.
+	double fourierZoomTo;				// Where the visible part of the fourier graph ends, as a fraction of the spectrum. 1 when fully zoomed out.
 
 	Modification* modificationStack;	// A stack of all the changes the user applies, for undoing and redoing them. Only NULL when no file is open.
 	Modification* currentSaveState;		// The last change that was saved.
+	SessionJournal* sessionJournal;		// The append-only sidecar that records edits between full saves, so a crash doesn't lose them. NULL when journaling couldn't start.
+
+	HANDLE saveThread;					// The thread that's writing the file in the background, or NULL when no save is in progress.
+	Function** saveSnapshot;			// Time-domain clones of the channels which the save thread writes from, so that edits made during a save apply to the live copy.
+	Modification* saveThreadState;		// The top of the modification stack when the snapshot was taken. Becomes currentSaveState if the save succeeds.
+	char saveResult;					// Whether the background save succeeded. Only valid once the save thread is done.
 
 	// The following fields are just handles to some important windows of the file editor.
 	HWND channelTabs;					// The tab control that lets you switch between channels.
@@ -122,6 +135,9 @@ LRESULT ProcessRMBUp(LPARAM lparam);
 // If a selection is ongoing, updates it.
 LRESULT ProcessMouseMove(LPARAM);
 
+// Zooms the fourier graph when the wheel is scrolled over it. Holding shift pans instead.
+LRESULT ProcessMouseWheel(WPARAM, LPARAM);
+
 // Carries out WM_NOTIFY messages of any sort.
 LRESULT ProcessNotification(WPARAM, LPNMHDR);
 
@@ -140,6 +156,9 @@ LRESULT ProcessMainWindowCommand(HWND, WPARAM, LPARAM);
 // Sets the file editor to the currently selected channel in the tab control.
 void UpdateEditorToCurrentChannel();
 
+// Flips whether files opened from now on get processed in single precision, and checks/unchecks the menu option accordingly.
+void ToggleSinglePrecision(HWND);
+
 // Initiates the procedure of creating a new file.
 void FileNew(HWND);
 
@@ -149,12 +168,24 @@ void PromptFileOpen(HWND);
 // Opens and reads the file with the given path into memory.
 void FileOpen(LPCTSTR, HWND);
 
-// Saves the current file, or saves-as if the file is new and not saved anywhere yet.
+// Saves the current file, or saves-as if the file is new and not saved anywhere yet. The save runs on a background thread when memory allows it.
 void FileSave(HWND);
 
 // Prompts the user to select a save location for the edited file, and saves it there.
 void FileSaveAs(HWND);
 
+// The procedure that the background save thread runs: writes the snapshot out and notifies the main window when it's done.
+unsigned int __stdcall BackgroundSaveProcedure(void*);
+
+// Blocks until the background save is done (if one is going) and does its completion bookkeeping. Returns zero iff there was a save in progress and it failed.
+char WaitForBackgroundSave();
+
+// Frees the channel clones that were made for the save thread.
+void DeallocateSaveSnapshot();
+
+// Processes the WM_SAVEDONE message: reaps the save thread and reports how the save went.
+LRESULT ProcessSaveDone(HWND);
+
 // Undoes the last change.
 void Undo(HWND);
 
@@ -164,12 +195,21 @@ void Redo(HWND);
 // Applies the modification from the contents of the input controls.
 void ApplyModificationFromInput(HWND);
 
+// Starts auditioning the current channel, or stops the audition that's going. Playback follows edits as they're applied.
+void TogglePlayback(HWND);
+
 // Prompts the user to choose if he wants to save his progress before it's lost. Returns zero iff the user chose to abort the operation that was about to cause progress to be lost.
 char PromptSaveProgress();
 
 // Using the currently open file, sets it up for editing. Returns zero iff it encountered an error.
 void InitializeFileEditor();
 
+// Reapplies every action the session journal holds, the same way the user originally made them. For when a file opens after a crash left edits behind.
+void ReplayJournalEntries();
+
+// The procedure that builds the sound editor cache for the file being opened. Runs on its own thread so the twiddle tables generate while the PCM still loads.
+unsigned int __stdcall InitializeSoundEditorProcedure(void*);
+
 // Paints all the GUI for editing the open file onto the main window.
 void PaintFileEditor();
 
@@ -209,6 +249,21 @@ void PlotAndDisplayChannelGraphs(unsigned short);
 // Returns the amount of samples to skip in each step when plotting graphs.
 unsigned long long GetPlottingStepSize();
 
+// Maps an x pixel on the fourier graph to the frequency it currently shows, taking the zoom into account.
+double FourierPixelToFrequency(int);
+
+// Zooms the fourier graph in or out by the given number of wheel clicks, anchored so the frequency under the given x pixel stays put. Negative clicks zoom out.
+void ZoomFourierGraph(int, int);
+
+// Slides the visible part of the fourier graph sideways by the given number of wheel clicks without changing the zoom. Negative clicks slide towards 0Hz.
+void PanFourierGraph(int);
+
+// Replots every channel's fourier graph at the current zoom, updates the axis labels, and redisplays the graph that's on screen.
+void ReplotFourierGraphs();
+
+// Sets the min and max frequency statics to the frequencies at the edges of the visible part of the spectrum.
+void UpdateFrequencyAxisLabels();
+
 // Paints the selection, sets the textboxes to contain it, and sets the new values in fileEditor.
 void UpdateSelection();
 
@@ -218,6 +273,15 @@ void CloseFileEditor();
 // Frees memory that was reserved for storing the PCM/fourier functions of all the channels.
 void DeallocateChannelsData();
 
+// Frees the opposite-domain copies kept for fast domain flips.
+void DeallocateChannelsShadows();
+
+// Frees the peak pyramids that the waveform plotter queries.
+void DeallocateChannelsPeaks();
+
+// Frees the magnitude pyramids that the fourier plotter queries.
+void DeallocateChannelsMagnitudes();
+
 // Frees memory held by bitmaps for the various channels' waveform and fourier graphs.
 void DeallocateChannelsGraphs();
 
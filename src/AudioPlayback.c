@@ -0,0 +1,254 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#define COBJMACROS // So the WASAPI interfaces can be called from C without spelling out the vtables.
+
+#include "AudioPlayback.h"
+#include <windows.h>
+#include <mmdeviceapi.h> // For finding the default render device.
+#include <audioclient.h> // For the WASAPI render client that the audio goes out through.
+#include <process.h>	 // For _beginthreadex, which unlike CreateThread plays nice with the CRT.
+#include <stdio.h>		 // For fprintf.
+
+// The class and interface IDs this engine needs, spelled out by hand so linking doesn't depend on the uuid library.
+static const CLSID classIdMMDeviceEnumerator = {0xBCDE0395, 0xE52F, 0x467C, {0x8E, 0x3D, 0xC4, 0x57, 0x92, 0x91, 0x69, 0x2E}};
+static const IID interfaceIdIMMDeviceEnumerator = {0xA95664D2, 0x9614, 0x4F35, {0xA7, 0x46, 0xDE, 0x8D, 0xB6, 0x36, 0x17, 0xE6}};
+static const IID interfaceIdIAudioClient = {0x1CB9AD4C, 0xDBFA, 0x4CC7, {0x90, 0x3D, 0x00, 0xAA, 0xE3, 0x93, 0xAD, 0xB8}};
+static const IID interfaceIdIAudioRenderClient = {0xF294ACFC, 0x3146, 0x4483, {0xA7, 0xBF, 0xAD, 0xDC, 0xA7, 0xC2, 0x60, 0xE2}};
+
+// These flags tell the engine to convert our format to whatever the device runs at. Older SDK headers don't have them.
+#ifndef AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM
+#define AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM 0x80000000
+#define AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY 0x08000000
+#endif
+
+// How much audio the shared buffer holds, in 100-nanosecond units. A single block covers about half of it,
+// so this also bounds how long an applied edit takes to become audible.
+#define PLAYBACK_BUFFER_DURATION 1000000 // 100ms.
+
+// Everything about the playback that's currently going, if one is. There's at most one at a time, which is all auditioning calls for.
+static struct
+{
+	IAudioClient* client;			// The WASAPI session, in shared event-driven mode.
+	IAudioRenderClient* renderer;	// The render side of the session, where the blocks go.
+	HANDLE blockNeeded;				// The event the engine signals when it wants another block.
+	HANDLE thread;					// The worker that converts and feeds blocks.
+	UINT32 bufferFrames;			// How many frames the shared buffer holds.
+	Function** function;			// The address of the channel's slot in the channels array. Dereferenced fresh every block, see FillPlaybackBlock.
+	unsigned long long from;		// The first real sample of the playback range.
+	unsigned long long length;		// How many real samples the range covers.
+	unsigned long long position;	// How many of them have been fed so far.
+	volatile char muted;			// While set, the worker feeds silence and holds its position.
+	volatile char stopRequested;	// Tells the worker to bail instead of feeding another block.
+	volatile char playing;			// Whether playback is currently going. The worker turns it off when the range plays out.
+} playback = {0};
+
+// Converts one block of the live channel into the render buffer. The slot gets dereferenced fresh every block because domain flips trade
+// the channel's buffer with its spectral shadow, and following the slot keeps us pointed at wherever the waveform currently lives.
+// An edit landing mid-block can tear a few samples, which at worst is one brief soft click in a preview - not worth a lock on the edit path.
+static void FillPlaybackBlock(float* dest, UINT32 frames)
+{
+	unsigned long long start = playback.from + playback.position;
+
+	if (GetType(*playback.function) == FloatComplexType)
+	{
+		Function_FloatReal func = ReadComplexFunctionAsReal_FloatComplex((Function_FloatComplex*)*playback.function);
+
+		for (UINT32 n = 0; n < frames; n++)
+		{
+			dest[n] = get(func, start + n);
+		}
+	}
+	else
+	{
+		Function_DoubleReal func = ReadComplexFunctionAsReal_DoubleComplex((Function_DoubleComplex*)*playback.function);
+
+		for (UINT32 n = 0; n < frames; n++)
+		{
+			dest[n] = (float)get(func, start + n);
+		}
+	}
+}
+
+// The loop the worker runs: wait until the engine wants audio, top the shared buffer up with converted samples, repeat until the range plays out.
+static unsigned int __stdcall AudioPlaybackProcedure(void* context)
+{
+	while (!playback.stopRequested && playback.position < playback.length)
+	{
+		// The timeout is paranoia against the engine going quiet on us, so a dead session can't hang the program on close.
+		if (WaitForSingleObject(playback.blockNeeded, 2000) != WAIT_OBJECT_0)
+		{
+			break;
+		}
+
+		UINT32 padding = 0;
+
+		if (FAILED(IAudioClient_GetCurrentPadding(playback.client, &padding)))
+		{
+			break;
+		}
+
+		UINT32 frames = playback.bufferFrames - padding;
+		BYTE* buffer = NULL;
+
+		if (frames == 0)
+		{
+			continue;
+		}
+
+		if (FAILED(IAudioRenderClient_GetBuffer(playback.renderer, frames, &buffer)))
+		{
+			break;
+		}
+
+		if (playback.muted)
+		{
+			// Muted playback feeds silence and holds its position, so unmuting picks up right where the sound left off.
+			IAudioRenderClient_ReleaseBuffer(playback.renderer, frames, AUDCLNT_BUFFERFLAGS_SILENT);
+		}
+		else
+		{
+			frames = min(frames, playback.length - playback.position);
+			FillPlaybackBlock((float*)buffer, frames);
+			IAudioRenderClient_ReleaseBuffer(playback.renderer, frames, 0);
+			playback.position += frames;
+		}
+	}
+
+	// Letting the tail of the sound drain out of the buffer before the stream stops, unless we were told to cut it.
+	if (!playback.stopRequested)
+	{
+		Sleep(PLAYBACK_BUFFER_DURATION / 10000);
+	}
+
+	IAudioClient_Stop(playback.client);
+	playback.playing = FALSE;
+	return 0;
+}
+
+// Tears down whatever part of the audio stack is up. The worker has to be gone by the time this runs.
+static void ReleasePlayback()
+{
+	if (playback.renderer != NULL)
+	{
+		IAudioRenderClient_Release(playback.renderer);
+	}
+
+	if (playback.client != NULL)
+	{
+		IAudioClient_Release(playback.client);
+	}
+
+	if (playback.blockNeeded != NULL)
+	{
+		CloseHandle(playback.blockNeeded);
+	}
+
+	memset(&playback, 0, sizeof(playback));
+}
+
+char StartAudioPlayback(Function** function, unsigned long long fromSample, unsigned long long length, unsigned int sampleRate)
+{
+	StopAudioPlayback();
+
+	// COM may already be up in whatever mode the UI put it in, which the RPC_E_CHANGED_MODE result says is fine to piggyback on.
+	HRESULT comResult = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+
+	if (FAILED(comResult) && comResult != RPC_E_CHANGED_MODE)
+	{
+		return FALSE;
+	}
+
+	// The worker feeds mono 32-bit floats at the file's sample rate, and the auto-conversion flags have the engine turn that into whatever the device runs at.
+	WAVEFORMATEX format = {0};
+	format.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+	format.nChannels = 1;
+	format.nSamplesPerSec = sampleRate;
+	format.wBitsPerSample = sizeof(float) * 8;
+	format.nBlockAlign = sizeof(float);
+	format.nAvgBytesPerSec = sampleRate * sizeof(float);
+
+	IMMDeviceEnumerator* enumerator = NULL;
+	IMMDevice* device = NULL;
+
+	char success =
+		SUCCEEDED(CoCreateInstance(&classIdMMDeviceEnumerator, NULL, CLSCTX_ALL, &interfaceIdIMMDeviceEnumerator, (void**)&enumerator)) &&
+		SUCCEEDED(IMMDeviceEnumerator_GetDefaultAudioEndpoint(enumerator, eRender, eConsole, &device)) &&
+		SUCCEEDED(IMMDevice_Activate(device, &interfaceIdIAudioClient, CLSCTX_ALL, NULL, (void**)&(playback.client))) &&
+		SUCCEEDED(IAudioClient_Initialize(playback.client, AUDCLNT_SHAREMODE_SHARED,
+			AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM | AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY,
+			PLAYBACK_BUFFER_DURATION, 0, &format, NULL)) &&
+		SUCCEEDED(IAudioClient_GetBufferSize(playback.client, &(playback.bufferFrames))) &&
+		(playback.blockNeeded = CreateEvent(NULL, FALSE, FALSE, NULL)) != NULL &&
+		SUCCEEDED(IAudioClient_SetEventHandle(playback.client, playback.blockNeeded)) &&
+		SUCCEEDED(IAudioClient_GetService(playback.client, &interfaceIdIAudioRenderClient, (void**)&(playback.renderer)));
+
+	// The enumerator and device only existed to get us the client.
+	if (device != NULL)
+	{
+		IMMDevice_Release(device);
+	}
+
+	if (enumerator != NULL)
+	{
+		IMMDeviceEnumerator_Release(enumerator);
+	}
+
+	if (success)
+	{
+		playback.function = function;
+		playback.from = fromSample;
+		playback.length = length;
+		playback.position = 0;
+		playback.playing = TRUE;
+		success = SUCCEEDED(IAudioClient_Start(playback.client)) &&
+			(playback.thread = (HANDLE)_beginthreadex(NULL, 0, AudioPlaybackProcedure, NULL, 0, NULL)) != NULL;
+	}
+
+	if (!success)
+	{
+		fprintf(stderr, "Setting up WASAPI playback failed.\n");
+		ReleasePlayback();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void StopAudioPlayback()
+{
+	if (playback.thread != NULL)
+	{
+		// The worker waits on the same event the engine signals, so poking it is enough to make it notice the request promptly.
+		playback.stopRequested = TRUE;
+		SetEvent(playback.blockNeeded);
+		WaitForSingleObject(playback.thread, INFINITE);
+		CloseHandle(playback.thread);
+		playback.thread = NULL;
+	}
+
+	ReleasePlayback();
+}
+
+char IsAudioPlaying()
+{
+	return playback.playing;
+}
+
+void MuteAudioPlayback(char muted)
+{
+	playback.muted = muted;
+}
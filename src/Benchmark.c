@@ -0,0 +1,385 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "SoundEditor.h"
+#include "SoundEditorInternal.h"
+#include "SampledFunction.h"
+#include "WaveReadWriter.h"
+#include "MyUtils.h"
+#include <tchar.h>	// For dealing with strings that may be unicode or ANSI.
+#include <stdio.h>	// For printing the results.
+#include <stdlib.h>	// For malloc, rand, qsort.
+
+// This is a console program that times the hot paths of the editor, for checking that a change which was supposed to make things faster actually did.
+// Build it with 'make bench' and run bin/bench.exe. It takes one optional argument: the biggest log2 of the FFT lengths to time, 28 by default.
+// Every measurement is repeated this many times, and the reports show the best and median throughput over the repeats.
+#define BENCH_RUNS 7
+
+// Small timed regions are repeated until at least this many samples were processed, so the timer's resolution doesn't swallow them.
+#define MIN_SAMPLES_PER_RUN (1 << 22)
+
+// How long the synthetic files for the read/write measurements are, in seconds. At 44.1KHz this makes them around 13 million samples.
+#define BENCH_FILE_SECONDS 300
+#define BENCH_FILE_FREQUENCY 44100
+
+// The timer's ticks per second, so the measurements below can print seconds like civilized people.
+static double timerFrequency = 0.0;
+
+// Returns the current time in seconds. Only differences between two of these mean anything.
+static double Now()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart / timerFrequency;
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+	double diff = *((const double*)a) - *((const double*)b);
+	return diff < 0.0 ? -1 : diff > 0.0 ? 1 : 0;
+}
+
+// Prints one result line. 'seconds' holds how long each run took, and every run processed 'samplesPerRun' samples.
+static void Report(const char* name, double* seconds, unsigned long long samplesPerRun)
+{
+	qsort(seconds, BENCH_RUNS, sizeof(double), CompareDoubles);
+	double best = samplesPerRun / seconds[0];
+	double median = samplesPerRun / seconds[BENCH_RUNS / 2];
+	printf("%-44s best %9.2f Msamples/s, median %9.2f Msamples/s\n", name, best / 1000000.0, median / 1000000.0);
+	fflush(stdout);
+}
+
+// This macro contains the contents of BenchFFT that depend on the float precision. It needs to be declared at the start before it is used.
+#define BENCH_FFT_TYPED(precision)																									\
+Function_##precision##Complex* f = malloc(sizeof(Function_##precision##Complex));													\
+																																	\
+if (!AllocateFunctionInternals_##precision##Complex(f, length))																		\
+{																																	\
+	printf("Skipping " #precision " %llu*2^%u, not enough memory.\n", oddFactor, logLength);										\
+	free(f);																														\
+	return;																															\
+}																																	\
+																																	\
+for (unsigned long long i = 0; i < length; i++)																						\
+{																																	\
+	get(*f, i) = ((rand() % 2001) - 1000) / 1000.0 + (((rand() % 2001) - 1000) / 1000.0) * I;										\
+}																																	\
+																																	\
+SoundEditorCache* cache = InitializeSoundEditor(f);																					\
+																																	\
+if (cache == NULL)																													\
+{																																	\
+	printf("Skipping " #precision " %llu*2^%u, couldn't initialize the sound editor.\n", oddFactor, logLength);						\
+	DeallocateFunctionInternals(f);																									\
+	free(f);																														\
+	return;																															\
+}																																	\
+																																	\
+/* Small transforms repeat until the timer can see them. The inverse brings the data back so every forward run transforms the same thing.*/\
+unsigned long long reps = length < MIN_SAMPLES_PER_RUN ? MIN_SAMPLES_PER_RUN / length : 1;											\
+double forwardSeconds[BENCH_RUNS], inverseSeconds[BENCH_RUNS];																		\
+																																	\
+for (int run = 0; run < BENCH_RUNS; run++)																							\
+{																																	\
+	forwardSeconds[run] = 0.0;																										\
+	inverseSeconds[run] = 0.0;																										\
+																																	\
+	for (unsigned long long rep = 0; rep < reps; rep++)																				\
+	{																																\
+		double start = Now();																										\
+		RealInterleavedFFT(f, cache);																								\
+		forwardSeconds[run] += Now() - start;																						\
+																																	\
+		start = Now();																												\
+		InverseRealInterleavedFFT(f, cache);																						\
+		inverseSeconds[run] += Now() - start;																						\
+	}																																\
+}																																	\
+																																	\
+char name[64];																														\
+sprintf(name, "RealInterleavedFFT " #precision " %llu*2^%u", oddFactor, logLength);													\
+Report(name, forwardSeconds, reps * 2 * length);																					\
+sprintf(name, "InverseRealInterleavedFFT " #precision " %llu*2^%u", oddFactor, logLength);											\
+Report(name, inverseSeconds, reps * 2 * length);																					\
+																																	\
+DeallocateSoundEditorCache(cache);																									\
+DeallocateFunctionInternals(f);																										\
+free(f);
+
+// Times the forward and inverse transforms of complex interleaved length oddFactor * 2^logLength in the given precision.
+static void BenchFFT(unsigned int logLength, unsigned long long oddFactor, char doublePrecision)
+{
+	unsigned long long length = oddFactor << logLength;
+
+	if (doublePrecision)
+	{
+		BENCH_FFT_TYPED(Double)
+	}
+	else
+	{
+		BENCH_FFT_TYPED(Float)
+	}
+}
+
+// Frees channel functions that LoadPCMInterleaved allocated, the same way the editor does when a file closes.
+static void DeallocateChannels(FileInfo* fileInfo, Function** channelsData)
+{
+	unsigned short relevantChannels = GetRelevantChannelsCount(fileInfo);
+
+	for (unsigned short i = 0; i < relevantChannels; i++)
+	{
+		DeallocateFunctionInternals(channelsData[i]);
+		free(channelsData[i]);
+	}
+
+	free(channelsData);
+}
+
+// Times WriteWaveFile and LoadPCMInterleaved on a synthetic file of the given byte depth.
+static void BenchWaveFile(unsigned int byteDepth)
+{
+	FileInfo* fileInfo;
+	Function** channelsData;
+	CreateNewFile(&fileInfo, BENCH_FILE_SECONDS, BENCH_FILE_FREQUENCY, byteDepth);
+
+	if (!AllocateChannelsData(fileInfo, &channelsData) || !LoadPCMInterleaved(fileInfo, channelsData))
+	{
+		printf("Skipping depth %u, not enough memory.\n", byteDepth);
+		CloseWaveFile(fileInfo);
+		return;
+	}
+
+	TCHAR tempDir[MAX_PATH], tempPath[MAX_PATH];
+
+	if (GetTempPath(MAX_PATH, tempDir) == 0 || GetTempFileName(tempDir, TEXT("fbn"), 0, tempPath) == 0 ||
+		!WriteWaveFileAs(fileInfo, tempPath, channelsData))
+	{
+		printf("Skipping depth %u, couldn't create a temp file to write to.\n", byteDepth);
+		DeallocateChannels(fileInfo, channelsData);
+		CloseWaveFile(fileInfo);
+		return;
+	}
+
+	unsigned long long sampleLength = fileInfo->sampleLength;
+	double seconds[BENCH_RUNS];
+	char name[64];
+
+	// Timing in-place saves onto the file that the untimed WriteWaveFileAs above just readied.
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		double start = Now();
+
+		if (!WriteWaveFile(fileInfo->file, fileInfo, channelsData))
+		{
+			printf("Skipping depth %u, writing failed.\n", byteDepth);
+			DeallocateChannels(fileInfo, channelsData);
+			CloseWaveFile(fileInfo);
+			_tremove(tempPath);
+			return;
+		}
+
+		seconds[run] = Now() - start;
+	}
+
+	sprintf(name, "WriteWaveFile depth %u", byteDepth);
+	Report(name, seconds, sampleLength);
+	DeallocateChannels(fileInfo, channelsData);
+	CloseWaveFile(fileInfo);
+
+	// Now reading the same file back, deallocating between runs so each one really allocates and converts everything.
+	if (ResultHasError(ReadWaveFile(&fileInfo, tempPath)))
+	{
+		printf("Skipping depth %u reads, couldn't read the file back.\n", byteDepth);
+		_tremove(tempPath);
+		return;
+	}
+
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		double start = Now();
+
+		if (!AllocateChannelsData(fileInfo, &channelsData) || !LoadPCMInterleaved(fileInfo, channelsData))
+		{
+			printf("Skipping depth %u reads, not enough memory.\n", byteDepth);
+			CloseWaveFile(fileInfo);
+			_tremove(tempPath);
+			return;
+		}
+
+		seconds[run] = Now() - start;
+		DeallocateChannels(fileInfo, channelsData);
+	}
+
+	sprintf(name, "LoadPCMInterleaved depth %u", byteDepth);
+	Report(name, seconds, sampleLength);
+	CloseWaveFile(fileInfo);
+	_tremove(tempPath);
+}
+
+// Times ApplyModificationInternal for both change types, using the invert flag to put the samples back between runs.
+static void BenchModifications()
+{
+	unsigned long long length = 1ULL << 22;
+	Function_DoubleComplex* f = malloc(sizeof(Function_DoubleComplex));
+
+	if (!AllocateFunctionInternals_DoubleComplex(f, length))
+	{
+		printf("Skipping modifications, not enough memory.\n");
+		free(f);
+		return;
+	}
+
+	for (unsigned long long i = 0; i < length; i++)
+	{
+		get(*f, i) = ((rand() % 2001) - 1000) / 1000.0 + (((rand() % 2001) - 1000) / 1000.0) * I;
+	}
+
+	Function* channels[] = { f };
+	Modification modification = { 0 };
+	modification.startSample = 1;
+	modification.length = length - 1;
+	modification.changeType = MULTIPLY;
+	modification.changeAmount = 1.1;
+	modification.smoothing = 0.5;
+	modification.channel = 0;
+
+	double seconds[BENCH_RUNS];
+
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		double start = Now();
+		ApplyModificationInternal(channels, &modification, FALSE);
+		seconds[run] = Now() - start;
+		ApplyModificationInternal(channels, &modification, TRUE);
+	}
+
+	Report("ApplyModificationInternal MULTIPLY", seconds, modification.length);
+
+	modification.changeType = ADD;
+	modification.changeAmount = 0.25;
+
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		double start = Now();
+		ApplyModificationInternal(channels, &modification, FALSE);
+		seconds[run] = Now() - start;
+		ApplyModificationInternal(channels, &modification, TRUE);
+	}
+
+	Report("ApplyModificationInternal ADD", seconds, modification.length);
+	DeallocateFunctionInternals(f);
+	free(f);
+}
+
+// This macro contains the contents of BenchReductions that depend on the float precision. It needs to be declared at the start before it is used.
+#define BENCH_REDUCTIONS_TYPED(precision)																							\
+Function_##precision##Complex* f = malloc(sizeof(Function_##precision##Complex));													\
+																																	\
+if (!AllocateFunctionInternals_##precision##Complex(f, length))																		\
+{																																	\
+	printf("Skipping " #precision " reductions, not enough memory.\n");																\
+	free(f);																														\
+	return;																															\
+}																																	\
+																																	\
+for (unsigned long long i = 0; i < length; i++)																						\
+{																																	\
+	get(*f, i) = ((rand() % 2001) - 1000) / 1000.0 + (((rand() % 2001) - 1000) / 1000.0) * I;										\
+}																																	\
+																																	\
+Function_##precision##Real real = ReadComplexFunctionAsReal_##precision##Complex(f);												\
+double seconds[BENCH_RUNS];																											\
+volatile precision##Real sink;																										\
+																																	\
+for (int run = 0; run < BENCH_RUNS; run++)																							\
+{																																	\
+	double start = Now();																											\
+	sink = GetMax_##precision##Real(real, 0, real.totalLen, 1);																		\
+	seconds[run] = Now() - start;																									\
+}																																	\
+																																	\
+Report("GetMax " #precision "Real", seconds, real.totalLen);																		\
+																																	\
+for (int run = 0; run < BENCH_RUNS; run++)																							\
+{																																	\
+	double start = Now();																											\
+	sink = GetMin_##precision##Real(real, 0, real.totalLen, 1);																		\
+	seconds[run] = Now() - start;																									\
+}																																	\
+																																	\
+Report("GetMin " #precision "Real", seconds, real.totalLen);																		\
+																																	\
+for (int run = 0; run < BENCH_RUNS; run++)																							\
+{																																	\
+	double start = Now();																											\
+	sink = abs_##precision##Complex(GetMax_##precision##Complex(*f, 0, length, 1));													\
+	seconds[run] = Now() - start;																									\
+}																																	\
+																																	\
+(void)sink;																															\
+Report("GetMax " #precision "Complex", seconds, length);																			\
+DeallocateFunctionInternals(f);																										\
+free(f);
+
+// Times the min/max scans the plotting code leans on.
+static void BenchReductions(char doublePrecision)
+{
+	unsigned long long length = 1ULL << 23;
+
+	if (doublePrecision)
+	{
+		BENCH_REDUCTIONS_TYPED(Double)
+	}
+	else
+	{
+		BENCH_REDUCTIONS_TYPED(Float)
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	timerFrequency = (double)frequency.QuadPart;
+	srand(42); // Fixed seed so every invocation times the same data.
+
+	unsigned int maxLogLength = argc > 1 ? atoi(argv[1]) : 28;
+	maxLogLength = ClampInt(maxLogLength, 16, 28);
+
+	printf("Timing FFTs from 2^16 up to 2^%u (give a smaller max exponent as an argument if this takes too long).\n", maxLogLength);
+
+	for (unsigned int logLength = 16; logLength <= maxLogLength; logLength++)
+	{
+		BenchFFT(logLength, 1, FALSE);
+		BenchFFT(logLength, 1, TRUE);
+
+		// The mixed-radix lengths that land between this power of two and the next: 5*2^(k-2) = 1.25*2^k and 3*2^(k-1) = 1.5*2^k.
+		BenchFFT(logLength - 2, 5, FALSE);
+		BenchFFT(logLength - 2, 5, TRUE);
+		BenchFFT(logLength - 1, 3, FALSE);
+		BenchFFT(logLength - 1, 3, TRUE);
+	}
+
+	for (unsigned int byteDepth = FILE_MIN_DEPTH; byteDepth <= FILE_MAX_DEPTH; byteDepth++)
+	{
+		BenchWaveFile(byteDepth);
+	}
+
+	BenchModifications();
+	BenchReductions(FALSE);
+	BenchReductions(TRUE);
+	return 0;
+}
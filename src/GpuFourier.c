@@ -0,0 +1,399 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "GpuFourier.h"
+#include "MyUtils.h" // For IsPowerOfTwo and CountTrailingZeroes.
+#include <windows.h> // For loading the OpenCL driver dynamically, so the program still runs on machines that don't have one.
+#include <stdlib.h>	 // For malloc and friends.
+#include <string.h>	 // For checking the device's extension list.
+
+// The sliver of the OpenCL API this engine uses, declared by hand so building doesn't require the OpenCL SDK.
+// The driver gets loaded with LoadLibrary below, so machines without one simply never get a GPU plan.
+typedef void* cl_platform_id;
+typedef void* cl_device_id;
+typedef void* cl_context;
+typedef void* cl_command_queue;
+typedef void* cl_program;
+typedef void* cl_kernel;
+typedef void* cl_mem;
+typedef int cl_int;
+typedef unsigned int cl_uint;
+typedef unsigned long long cl_ulong;
+typedef unsigned long long cl_bitfield;
+
+#define CL_SUCCESS 0
+#define CL_TRUE 1
+#define CL_DEVICE_TYPE_GPU (1 << 2)
+#define CL_DEVICE_EXTENSIONS 0x1030
+#define CL_MEM_READ_WRITE (1 << 0)
+
+typedef cl_int (__stdcall *clGetPlatformIDsProc)(cl_uint, cl_platform_id*, cl_uint*);
+typedef cl_int (__stdcall *clGetDeviceIDsProc)(cl_platform_id, cl_bitfield, cl_uint, cl_device_id*, cl_uint*);
+typedef cl_int (__stdcall *clGetDeviceInfoProc)(cl_device_id, cl_uint, size_t, void*, size_t*);
+typedef cl_context (__stdcall *clCreateContextProc)(const intptr_t*, cl_uint, const cl_device_id*, void*, void*, cl_int*);
+typedef cl_command_queue (__stdcall *clCreateCommandQueueProc)(cl_context, cl_device_id, cl_bitfield, cl_int*);
+typedef cl_program (__stdcall *clCreateProgramWithSourceProc)(cl_context, cl_uint, const char**, const size_t*, cl_int*);
+typedef cl_int (__stdcall *clBuildProgramProc)(cl_program, cl_uint, const cl_device_id*, const char*, void*, void*);
+typedef cl_kernel (__stdcall *clCreateKernelProc)(cl_program, const char*, cl_int*);
+typedef cl_mem (__stdcall *clCreateBufferProc)(cl_context, cl_bitfield, size_t, void*, cl_int*);
+typedef cl_int (__stdcall *clSetKernelArgProc)(cl_kernel, cl_uint, size_t, const void*);
+typedef cl_int (__stdcall *clEnqueueWriteBufferProc)(cl_command_queue, cl_mem, cl_uint, size_t, size_t, const void*, cl_uint, const void*, void*);
+typedef cl_int (__stdcall *clEnqueueReadBufferProc)(cl_command_queue, cl_mem, cl_uint, size_t, size_t, void*, cl_uint, const void*, void*);
+typedef cl_int (__stdcall *clEnqueueNDRangeKernelProc)(cl_command_queue, cl_kernel, cl_uint, const size_t*, const size_t*, const size_t*, cl_uint, const void*, void*);
+typedef cl_int (__stdcall *clFinishProc)(cl_command_queue);
+typedef cl_int (__stdcall *clReleaseMemObjectProc)(cl_mem);
+typedef cl_int (__stdcall *clReleaseKernelProc)(cl_kernel);
+typedef cl_int (__stdcall *clReleaseProgramProc)(cl_program);
+typedef cl_int (__stdcall *clReleaseCommandQueueProc)(cl_command_queue);
+typedef cl_int (__stdcall *clReleaseContextProc)(cl_context);
+
+// The driver's entry points, looked up once and kept for the lifetime of the program.
+static struct
+{
+	HMODULE library;
+	char attempted;	// Whether we tried loading already, successfully or not. No point retrying every file open.
+	char usable;	// Whether the driver loaded and every entry point was found.
+	clGetPlatformIDsProc GetPlatformIDs;
+	clGetDeviceIDsProc GetDeviceIDs;
+	clGetDeviceInfoProc GetDeviceInfo;
+	clCreateContextProc CreateContext;
+	clCreateCommandQueueProc CreateCommandQueue;
+	clCreateProgramWithSourceProc CreateProgramWithSource;
+	clBuildProgramProc BuildProgram;
+	clCreateKernelProc CreateKernel;
+	clCreateBufferProc CreateBuffer;
+	clSetKernelArgProc SetKernelArg;
+	clEnqueueWriteBufferProc EnqueueWriteBuffer;
+	clEnqueueReadBufferProc EnqueueReadBuffer;
+	clEnqueueNDRangeKernelProc EnqueueNDRangeKernel;
+	clFinishProc Finish;
+	clReleaseMemObjectProc ReleaseMemObject;
+	clReleaseKernelProc ReleaseKernel;
+	clReleaseProgramProc ReleaseProgram;
+	clReleaseCommandQueueProc ReleaseCommandQueue;
+	clReleaseContextProc ReleaseContext;
+} cl = {0};
+
+struct GpuFourierContext
+{
+	cl_context context;			// The device context the plan lives in.
+	cl_command_queue queue;		// The in-order queue the levels get submitted to.
+	cl_program program;			// The butterfly program, built for the plan's precision.
+	cl_kernel butterfly;		// One radix-2 level of the transform.
+	cl_mem samples;				// The device buffer holding the interleaved complex samples.
+	void* staging;				// A host-side linear copy of the samples, since the function's segments can't be handed to the driver as one range.
+	CRITICAL_SECTION lock;		// The plan is single-occupancy - one staging buffer, one device buffer, one kernel object - and channels transform concurrently on save.
+	unsigned long long length;	// The complex interleaved length the plan was built for.
+	unsigned int logLength;		// log2 of that length.
+	FunctionType type;			// The precision the plan was built for.
+	size_t elementSize;			// Bytes per complex sample: 8 for floats, 16 for doubles.
+};
+
+// One radix-2 butterfly level. The host enqueues this once per level with halfStride doubling each time, global size N/2.
+// Twiddles are computed in-kernel from the angle, which keeps the device memory traffic to just the samples themselves.
+static const char* gpuFourierKernelSource =
+	"#ifdef DOUBLE\n"
+	"#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+	"typedef double real;\n"
+	"typedef double2 real2;\n"
+	"#define NEG_PI -3.14159265358979323846\n"
+	"#else\n"
+	"typedef float real;\n"
+	"typedef float2 real2;\n"
+	"#define NEG_PI -3.141592653589793f\n"
+	"#endif\n"
+	"\n"
+	"__kernel void Butterfly(__global real2* samples, ulong halfStride)\n"
+	"{\n"
+	"\tulong i = get_global_id(0);\n"
+	"\tulong top = ((i / halfStride) * 2 * halfStride) + (i % halfStride);\n"
+	"\tulong bottom = top + halfStride;\n"
+	"\treal angle = ((real)NEG_PI * (real)(i % halfStride)) / (real)halfStride;\n"
+	"\treal2 twiddle = (real2)(cos(angle), sin(angle));\n"
+	"\treal2 a = samples[top], b = samples[bottom];\n"
+	"\treal2 product = (real2)((twiddle.x * b.x) - (twiddle.y * b.y), (twiddle.x * b.y) + (twiddle.y * b.x));\n"
+	"\tsamples[top] = a + product;\n"
+	"\tsamples[bottom] = a - product;\n"
+	"}\n";
+
+// Loads the driver and looks up the entry points, once. A machine without the driver just never gets GPU plans.
+static char LoadOpenCL()
+{
+	if (!cl.attempted)
+	{
+		cl.attempted = TRUE;
+		cl.library = LoadLibrary(TEXT("OpenCL.dll"));
+
+		if (cl.library != NULL)
+		{
+			cl.GetPlatformIDs = (clGetPlatformIDsProc)GetProcAddress(cl.library, "clGetPlatformIDs");
+			cl.GetDeviceIDs = (clGetDeviceIDsProc)GetProcAddress(cl.library, "clGetDeviceIDs");
+			cl.GetDeviceInfo = (clGetDeviceInfoProc)GetProcAddress(cl.library, "clGetDeviceInfo");
+			cl.CreateContext = (clCreateContextProc)GetProcAddress(cl.library, "clCreateContext");
+			cl.CreateCommandQueue = (clCreateCommandQueueProc)GetProcAddress(cl.library, "clCreateCommandQueue");
+			cl.CreateProgramWithSource = (clCreateProgramWithSourceProc)GetProcAddress(cl.library, "clCreateProgramWithSource");
+			cl.BuildProgram = (clBuildProgramProc)GetProcAddress(cl.library, "clBuildProgram");
+			cl.CreateKernel = (clCreateKernelProc)GetProcAddress(cl.library, "clCreateKernel");
+			cl.CreateBuffer = (clCreateBufferProc)GetProcAddress(cl.library, "clCreateBuffer");
+			cl.SetKernelArg = (clSetKernelArgProc)GetProcAddress(cl.library, "clSetKernelArg");
+			cl.EnqueueWriteBuffer = (clEnqueueWriteBufferProc)GetProcAddress(cl.library, "clEnqueueWriteBuffer");
+			cl.EnqueueReadBuffer = (clEnqueueReadBufferProc)GetProcAddress(cl.library, "clEnqueueReadBuffer");
+			cl.EnqueueNDRangeKernel = (clEnqueueNDRangeKernelProc)GetProcAddress(cl.library, "clEnqueueNDRangeKernel");
+			cl.Finish = (clFinishProc)GetProcAddress(cl.library, "clFinish");
+			cl.ReleaseMemObject = (clReleaseMemObjectProc)GetProcAddress(cl.library, "clReleaseMemObject");
+			cl.ReleaseKernel = (clReleaseKernelProc)GetProcAddress(cl.library, "clReleaseKernel");
+			cl.ReleaseProgram = (clReleaseProgramProc)GetProcAddress(cl.library, "clReleaseProgram");
+			cl.ReleaseCommandQueue = (clReleaseCommandQueueProc)GetProcAddress(cl.library, "clReleaseCommandQueue");
+			cl.ReleaseContext = (clReleaseContextProc)GetProcAddress(cl.library, "clReleaseContext");
+
+			cl.usable = cl.GetPlatformIDs != NULL && cl.GetDeviceIDs != NULL && cl.GetDeviceInfo != NULL && cl.CreateContext != NULL &&
+				cl.CreateCommandQueue != NULL && cl.CreateProgramWithSource != NULL && cl.BuildProgram != NULL && cl.CreateKernel != NULL &&
+				cl.CreateBuffer != NULL && cl.SetKernelArg != NULL && cl.EnqueueWriteBuffer != NULL && cl.EnqueueReadBuffer != NULL &&
+				cl.EnqueueNDRangeKernel != NULL && cl.Finish != NULL && cl.ReleaseMemObject != NULL && cl.ReleaseKernel != NULL &&
+				cl.ReleaseProgram != NULL && cl.ReleaseCommandQueue != NULL && cl.ReleaseContext != NULL;
+		}
+	}
+
+	return cl.usable;
+}
+
+// The same bit reversal the CPU engine sorts with. Redone locally because it's three lines and this file shouldn't reach into the sound editor's internals.
+static unsigned long long ReverseIndex(unsigned long long index, unsigned int digits)
+{
+	unsigned long long reversed = 0;
+
+	for (unsigned int i = 0; i < digits; i++)
+	{
+		reversed = (reversed << 1) | ((index >> i) & 1);
+	}
+
+	return reversed;
+}
+
+// This macro contains the parts of this file that need to be generated per-precision, namely moving samples between the function's segments and the staging buffer.
+#define GPU_FOURIER_C_PRECISION_CONTENTS(precision)																												\
+/* Copies the function into the staging buffer in bit-reversed order, which is the order the butterfly levels want their input in.*/							\
+static void GatherReversed_##precision##Complex(GpuFourierContext* context, Function_##precision##Complex f)													\
+{																																								\
+	precision##Complex* staging = context->staging;																												\
+	unsigned long long len = context->length;																													\
+	unsigned int logLen = context->logLength;																													\
+																																								\
+	for (unsigned long long i = 0; i < len; i++)																												\
+	{																																							\
+		staging[ReverseIndex(i, logLen)] = get(f, i);																											\
+	}																																							\
+}																																								\
+																																								\
+/* Copies the finished transform from the staging buffer back into the function's segments.*/																	\
+static void Scatter_##precision##Complex(GpuFourierContext* context, Function_##precision##Complex f)															\
+{																																								\
+	precision##Complex* staging = context->staging;																												\
+	unsigned long long len = context->length;																													\
+																																								\
+	for (unsigned long long i = 0; i < len; i++)																												\
+	{																																							\
+		get(f, i) = staging[i];																																	\
+	}																																							\
+}
+
+GPU_FOURIER_C_PRECISION_CONTENTS(Double)
+GPU_FOURIER_C_PRECISION_CONTENTS(Float)
+
+GpuFourierContext* CreateGpuFourierContext(unsigned long long length, FunctionType type)
+{
+	// The engine only speaks radix-2, and below the threshold the transfers would eat any win.
+	if (length < GPU_FOURIER_MIN_LENGTH || !IsPowerOfTwo(length) || !LoadOpenCL())
+	{
+		return NULL;
+	}
+
+	// Taking the first GPU device any platform offers. The machines this feature targets have exactly one worth using anyway.
+	cl_platform_id platforms[8];
+	cl_uint platformCount = 0;
+	cl_device_id device = NULL;
+
+	if (cl.GetPlatformIDs(sizeof(platforms) / sizeof(platforms[0]), platforms, &platformCount) != CL_SUCCESS)
+	{
+		return NULL;
+	}
+
+	for (cl_uint i = 0; i < platformCount && device == NULL; i++)
+	{
+		if (cl.GetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL) != CL_SUCCESS)
+		{
+			device = NULL; // Some drivers scribble on the output even when they fail.
+		}
+	}
+
+	if (device == NULL)
+	{
+		return NULL;
+	}
+
+	// Double precision is an extension that plenty of consumer devices skip or cripple. No device support means no plan, not a silent downgrade.
+	if (type == DoubleComplexType)
+	{
+		char extensions[4096] = {0};
+
+		if (cl.GetDeviceInfo(device, CL_DEVICE_EXTENSIONS, sizeof(extensions) - 1, extensions, NULL) != CL_SUCCESS || strstr(extensions, "cl_khr_fp64") == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	GpuFourierContext* context = calloc(1, sizeof(GpuFourierContext));
+
+	if (context == NULL)
+	{
+		return NULL;
+	}
+
+	context->length = length;
+	context->logLength = CountTrailingZeroes(length);
+	context->type = type;
+	context->elementSize = type == DoubleComplexType ? sizeof(DoubleComplex) : sizeof(FloatComplex);
+	InitializeCriticalSection(&(context->lock));
+
+	cl_int error = CL_SUCCESS;
+	char success = (context->context = cl.CreateContext(NULL, 1, &device, NULL, NULL, &error)) != NULL &&
+		(context->queue = cl.CreateCommandQueue(context->context, device, 0, &error)) != NULL &&
+		(context->program = cl.CreateProgramWithSource(context->context, 1, &gpuFourierKernelSource, NULL, &error)) != NULL &&
+		cl.BuildProgram(context->program, 1, &device, type == DoubleComplexType ? "-D DOUBLE" : NULL, NULL, NULL) == CL_SUCCESS &&
+		(context->butterfly = cl.CreateKernel(context->program, "Butterfly", &error)) != NULL &&
+		(context->samples = cl.CreateBuffer(context->context, CL_MEM_READ_WRITE, length * context->elementSize, NULL, &error)) != NULL &&
+		(context->staging = malloc(length * context->elementSize)) != NULL;
+
+	if (!success)
+	{
+		DeallocateGpuFourierContext(context);
+		return NULL;
+	}
+
+	return context;
+}
+
+// The body of GpuFFT, which must be called with the plan's lock held. Split out so the early returns don't each need to give the lock back.
+static char GpuFFTUnderLock(GpuFourierContext* context, Function* f)
+{
+	// The plan only fits functions of the length and type it was built from, which InitializeSoundEditor guarantees.
+	if (GetType(f) != context->type || NumOfSamples(f) != context->length)
+	{
+		return FALSE;
+	}
+
+	// Linearizing into the staging buffer in bit-reversed order, which is the order the butterfly levels start from.
+	switch (context->type)
+	{
+		case FloatComplexType:
+			GatherReversed_FloatComplex(context, *CAST(f, Function_FloatComplex*));
+			break;
+		case DoubleComplexType:
+			GatherReversed_DoubleComplex(context, *CAST(f, Function_DoubleComplex*));
+			break;
+		default:
+			return FALSE;
+	}
+
+	if (cl.EnqueueWriteBuffer(context->queue, context->samples, CL_TRUE, 0, context->length * context->elementSize, context->staging, 0, NULL, NULL) != CL_SUCCESS ||
+		cl.SetKernelArg(context->butterfly, 0, sizeof(cl_mem), &(context->samples)) != CL_SUCCESS)
+	{
+		return FALSE;
+	}
+
+	// One dispatch per level, the same climb up the recursion tree the CPU engine does, except a level's N/2 butterflies fan out across the whole device.
+	// The queue is in-order so each level waits for the one before it without explicit events.
+	size_t globalSize = context->length / 2;
+
+	for (unsigned int level = 0; level < context->logLength; level++)
+	{
+		cl_ulong halfStride = 1ULL << level;
+
+		if (cl.SetKernelArg(context->butterfly, 1, sizeof(cl_ulong), &halfStride) != CL_SUCCESS ||
+			cl.EnqueueNDRangeKernel(context->queue, context->butterfly, 1, NULL, &globalSize, NULL, 0, NULL, NULL) != CL_SUCCESS)
+		{
+			return FALSE;
+		}
+	}
+
+	// The blocking read doubles as the fence that waits out all the levels. The function is only written once everything came back fine.
+	if (cl.EnqueueReadBuffer(context->queue, context->samples, CL_TRUE, 0, context->length * context->elementSize, context->staging, 0, NULL, NULL) != CL_SUCCESS)
+	{
+		return FALSE;
+	}
+
+	switch (context->type)
+	{
+		case FloatComplexType:
+			Scatter_FloatComplex(context, *CAST(f, Function_FloatComplex*));
+			break;
+		case DoubleComplexType:
+			Scatter_DoubleComplex(context, *CAST(f, Function_DoubleComplex*));
+			break;
+		default:
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+char GpuFFT(GpuFourierContext* context, Function* f)
+{
+	// Channels transform concurrently on save, and everything in the plan from the staging buffer to the kernel object (which the OpenCL spec
+	// says outright isn't thread-safe to set arguments on) is built for one transform at a time, so whole transforms take turns on it.
+	EnterCriticalSection(&(context->lock));
+	char success = GpuFFTUnderLock(context, f);
+	LeaveCriticalSection(&(context->lock));
+	return success;
+}
+
+void DeallocateGpuFourierContext(GpuFourierContext* context)
+{
+	if (context == NULL)
+	{
+		return;
+	}
+
+	free(context->staging);
+
+	if (context->samples != NULL)
+	{
+		cl.ReleaseMemObject(context->samples);
+	}
+
+	if (context->butterfly != NULL)
+	{
+		cl.ReleaseKernel(context->butterfly);
+	}
+
+	if (context->program != NULL)
+	{
+		cl.ReleaseProgram(context->program);
+	}
+
+	if (context->queue != NULL)
+	{
+		cl.ReleaseCommandQueue(context->queue);
+	}
+
+	if (context->context != NULL)
+	{
+		cl.ReleaseContext(context->context);
+	}
+
+	DeleteCriticalSection(&(context->lock));
+	free(context);
+}
@@ -0,0 +1,105 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Instrumentation.h"
+
+// This whole file compiles to nothing unless instrumentation is switched on, so it can always be linked.
+#ifdef INSTRUMENT
+
+#include "MyUtils.h" // For windows.h, which has the performance counter.
+#include <stdio.h>	 // For writing the reports out.
+
+// What each slot gets called in the reports. Has to match the order of the InstrumentSlot enum.
+static const char* slotNames[INSTRUMENT_SLOT_COUNT] = { "I/O", "Convert", "Transform", "Paint" };
+
+// The slots being accumulated for the operation that's going right now.
+// The background save thread and the UI thread could in principle write these at the same time, but a diagnostic build can live with a garbled sample.
+static double slotStarts[INSTRUMENT_SLOT_COUNT];
+static double slotSeconds[INSTRUMENT_SLOT_COUNT];
+static unsigned long long slotUnits[INSTRUMENT_SLOT_COUNT];
+
+// The last report we printed, for showing it on screen.
+static char lastReport[256] = "";
+
+// Returns the current time in seconds from some fixed point. Only differences between two of these mean anything.
+static double InstrumentNow()
+{
+	static double frequency = 0.0;
+
+	if (frequency == 0.0)
+	{
+		LARGE_INTEGER ticksPerSecond;
+		QueryPerformanceFrequency(&ticksPerSecond);
+		frequency = (double)ticksPerSecond.QuadPart;
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart / frequency;
+}
+
+void InstrumentBeginSlot(InstrumentSlot slot)
+{
+	slotStarts[slot] = InstrumentNow();
+}
+
+void InstrumentEndSlot(InstrumentSlot slot)
+{
+	slotSeconds[slot] += InstrumentNow() - slotStarts[slot];
+}
+
+void InstrumentCountUnits(InstrumentSlot slot, unsigned long long amount)
+{
+	slotUnits[slot] += amount;
+}
+
+void InstrumentReport(const char* operation)
+{
+	int written = snprintf(lastReport, sizeof(lastReport), "%s:", operation);
+
+	for (int slot = 0; slot < INSTRUMENT_SLOT_COUNT; slot++)
+	{
+		// Slots that weren't touched during this operation stay out of its report.
+		if (slotSeconds[slot] == 0.0 && slotUnits[slot] == 0)
+		{
+			continue;
+		}
+
+		if (written < (int)sizeof(lastReport))
+		{
+			written += snprintf(lastReport + written, sizeof(lastReport) - written, " %s %.1fms", slotNames[slot], slotSeconds[slot] * 1000.0);
+		}
+
+		if (slotUnits[slot] != 0 && written < (int)sizeof(lastReport))
+		{
+			written += snprintf(lastReport + written, sizeof(lastReport) - written, " (%llu units)", slotUnits[slot]);
+		}
+
+		slotStarts[slot] = 0.0;
+		slotSeconds[slot] = 0.0;
+		slotUnits[slot] = 0;
+	}
+
+	fprintf(stderr, "[instrument] %s\n", lastReport);
+	fflush(stderr);
+}
+
+const char* InstrumentLastReport()
+{
+	return lastReport;
+}
+
+#endif
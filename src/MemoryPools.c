@@ -0,0 +1,235 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "MemoryPools.h"
+#include "MyUtils.h" // For the size macros.
+#include <windows.h> // For the critical section the arena carries.
+#include <stdlib.h>	 // For malloc, which the pools grab their blocks with.
+
+// How many bytes of chunk memory an arena grabs at a time. Requests bigger than this get a block of their own.
+#define ARENA_BLOCK_BYTES MEGAS(64)
+
+// What chunks and elements are aligned to, like malloc aligns.
+#define POOL_ALIGNMENT 16
+
+// One contiguous block an arena carves chunks out of. The chunk memory follows right after this header.
+typedef struct ArenaBlock
+{
+	struct ArenaBlock* next;		// The block that was being carved before this one. Whatever tail it has left goes unused, but blocks are big enough that it hardly matters.
+	unsigned long long capacity;	// How many bytes of chunk memory this block holds.
+	unsigned long long used;		// How many of them have been handed out.
+} ArenaBlock;
+
+// Sits right before every chunk an arena hands out.
+typedef struct ChunkHeader
+{
+	unsigned long long size;	// The size that was asked for, so freed chunks can be matched to later requests.
+	struct ChunkHeader* next;	// The chunk freed before this one. Meaningless while the chunk is in use.
+} ChunkHeader;
+
+struct MemoryArena
+{
+	ArenaBlock* blocks;		// Every block this arena ever grabbed, newest first. Chunks are carved from the newest.
+	ChunkHeader* freeList;	// Chunks that were freed and can be handed out again.
+	CRITICAL_SECTION lock;	// Guards both lists, because arenas get allocated from inside concurrent pool jobs - see ArenaAlloc.
+};
+
+// One slab of pool elements. The element memory follows right after this header.
+typedef struct Slab
+{
+	struct Slab* next;
+} Slab;
+
+struct SlabPool
+{
+	unsigned long long elementSize;	// How many bytes each element takes up, after rounding up for alignment.
+	unsigned int elementsPerSlab;	// How many elements each slab holds.
+	Slab* slabs;					// Every slab this pool ever grabbed, so destroying the pool can release them.
+	void* freeList;					// Elements that can be handed out, chained through their own first bytes.
+};
+
+// Rounds a size up to the pools' alignment.
+ __attribute__((always_inline)) inline
+static unsigned long long AlignSize(unsigned long long size)
+{
+	return (size + POOL_ALIGNMENT - 1) & ~CAST(POOL_ALIGNMENT - 1, unsigned long long);
+}
+
+// Where a block's chunk memory starts. Offset by the aligned header size so the first chunk is as aligned as the rest.
+ __attribute__((always_inline)) inline
+static char* BlockMemory(ArenaBlock* block)
+{
+	return CAST(block, char*) + AlignSize(sizeof(ArenaBlock));
+}
+
+MemoryArena* CreateMemoryArena()
+{
+	MemoryArena* arena = calloc(1, sizeof(MemoryArena));
+
+	if (arena != NULL)
+	{
+		InitializeCriticalSection(&(arena->lock));
+	}
+
+	return arena;
+}
+
+// The body of ArenaAlloc, which must be called with the arena's lock held. Split out so the returns don't each need to give the lock back.
+static void* ArenaAllocUnderLock(MemoryArena* arena, unsigned long long size)
+{
+	// First choice is recycling a freed chunk. Only exact fits are taken, because the edit path frees and reallocates the same handful of sizes
+	// over and over - handing out a big chunk for a small request would slowly turn the arena into the fragmented heap it's meant to replace.
+	ChunkHeader** link = &(arena->freeList);
+
+	for (ChunkHeader* chunk = arena->freeList; chunk != NULL; link = &(chunk->next), chunk = chunk->next)
+	{
+		if (chunk->size == size)
+		{
+			*link = chunk->next;
+			return chunk + 1;
+		}
+	}
+
+	// No luck, carving a fresh chunk instead. The chunk takes up its aligned size so the one after it starts aligned too.
+	unsigned long long needed = sizeof(ChunkHeader) + AlignSize(size);
+	ArenaBlock* block = arena->blocks;
+
+	if (block == NULL || block->capacity - block->used < needed)
+	{
+		unsigned long long capacity = needed > ARENA_BLOCK_BYTES ? needed : ARENA_BLOCK_BYTES;
+
+		if ((block = malloc(AlignSize(sizeof(ArenaBlock)) + capacity)) == NULL)
+		{
+			return NULL;
+		}
+
+		block->next = arena->blocks;
+		block->capacity = capacity;
+		block->used = 0;
+		arena->blocks = block;
+	}
+
+	ChunkHeader* chunk = CAST(BlockMemory(block) + block->used, ChunkHeader*);
+	block->used += needed;
+	chunk->size = size;
+	return chunk + 1;
+}
+
+void* ArenaAlloc(MemoryArena* arena, unsigned long long size)
+{
+	// Arenas get used from concurrent pool jobs - a domain flip allocates a spectral shadow when the channel is missing one - so the lists are guarded.
+	EnterCriticalSection(&(arena->lock));
+	void* chunk = ArenaAllocUnderLock(arena, size);
+	LeaveCriticalSection(&(arena->lock));
+	return chunk;
+}
+
+void ArenaFree(MemoryArena* arena, void* chunk)
+{
+	if (chunk != NULL)
+	{
+		ChunkHeader* header = CAST(chunk, ChunkHeader*) - 1;
+		EnterCriticalSection(&(arena->lock));
+		header->next = arena->freeList;
+		arena->freeList = header;
+		LeaveCriticalSection(&(arena->lock));
+	}
+}
+
+void DestroyMemoryArena(MemoryArena* arena)
+{
+	if (arena != NULL)
+	{
+		ArenaBlock* block = arena->blocks;
+
+		while (block != NULL)
+		{
+			ArenaBlock* next = block->next;
+			free(block);
+			block = next;
+		}
+
+		DeleteCriticalSection(&(arena->lock));
+		free(arena);
+	}
+}
+
+SlabPool* CreateSlabPool(unsigned long long elementSize, unsigned int elementsPerSlab)
+{
+	SlabPool* pool = calloc(1, sizeof(SlabPool));
+
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+
+	// Elements are rounded up so each one can hold the free list pointer and they all start aligned.
+	unsigned long long pointerSize = sizeof(void*);
+	pool->elementSize = AlignSize(elementSize > pointerSize ? elementSize : pointerSize);
+	pool->elementsPerSlab = elementsPerSlab;
+	return pool;
+}
+
+void* SlabPoolAlloc(SlabPool* pool)
+{
+	if (pool->freeList == NULL)
+	{
+		Slab* slab = malloc(AlignSize(sizeof(Slab)) + (pool->elementSize * pool->elementsPerSlab));
+
+		if (slab == NULL)
+		{
+			return NULL;
+		}
+
+		slab->next = pool->slabs;
+		pool->slabs = slab;
+
+		// Threading the fresh elements onto the free list. Same trick as BlockMemory for keeping them aligned.
+		char* elements = CAST(slab, char*) + AlignSize(sizeof(Slab));
+
+		for (unsigned int i = 0; i < pool->elementsPerSlab; i++)
+		{
+			SlabPoolFree(pool, elements + (i * pool->elementSize));
+		}
+	}
+
+	void* element = pool->freeList;
+	pool->freeList = *CAST(element, void**);
+	return element;
+}
+
+void SlabPoolFree(SlabPool* pool, void* element)
+{
+	*CAST(element, void**) = pool->freeList;
+	pool->freeList = element;
+}
+
+void DestroySlabPool(SlabPool* pool)
+{
+	if (pool != NULL)
+	{
+		Slab* slab = pool->slabs;
+
+		while (slab != NULL)
+		{
+			Slab* next = slab->next;
+			free(slab);
+			slab = next;
+		}
+
+		free(pool);
+	}
+}
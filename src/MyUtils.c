@@ -130,6 +130,20 @@ unsigned long long NextPowerOfTwo(unsigned long long N)
 	}
 }
 
+unsigned long long NextMixedRadixLength(unsigned long long N)
+{
+	unsigned long long best = NextPowerOfTwo(N);
+
+	// Checking if a 3 * 2^k or 5 * 2^k length fits below that power of two. m * 2^k >= N iff 2^k >= ceil(N / m).
+	for (unsigned long long m = 3; m <= 5; m += 2)
+	{
+		unsigned long long candidate = m * NextPowerOfTwo(DivCeilInt(N, m));
+		best = candidate < best ? candidate : best;
+	}
+
+	return best;
+}
+
 char FileExists(LPCTSTR path)
 {
 	WIN32_FIND_DATA data = {0};
@@ -15,55 +15,106 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "SampledFunction.h"
+#include "SimdKernels.h"
 #include "MyUtils.h"
 #include <math.h> // for min, log, etc.
+#include <stdio.h> // For logging spill file errors.
 
 // Important to use a power of two here.
 #define MAX_SEGMENT_LEN MEGAS(16)
 
+// How many samples each block at the bottom level of a peak pyramid covers. Small enough that scanning the partial blocks at a queried range's edges stays cheap.
+#define PEAK_PYRAMID_BASE_LEN 64
+
+// The arena function internals get allocated from, set by whoever owns the current session. When it's NULL everything comes straight from the heap.
+static MemoryArena* functionArena = NULL;
+
+// Grabs memory for function internals from the given arena when there is one, and straight from the heap otherwise.
+static void* FunctionAlloc(MemoryArena* arena, unsigned long long bytes)
+{
+	return arena != NULL ? ArenaAlloc(arena, bytes) : malloc(bytes);
+}
+
+// Returns memory gotten from FunctionAlloc with the same arena it was allocated with.
+static void FunctionFree(MemoryArena* arena, void* memory)
+{
+	if (arena != NULL)
+	{
+		ArenaFree(arena, memory);
+	}
+	else
+	{
+		free(memory);
+	}
+}
+
 #define SAMPLED_FUNCTION_C_TYPED_CONTENTS(type)																												\
 char AllocateFunctionInternals_##type(Function_##type* f, unsigned long long length)																		\
 {																																							\
 	f->funcType = type##Type;																																\
 																																							\
-	/* Choosing the segment length and count such that we can hold at least 'length' many samples.*/														\
+	/* Choosing the segment length and count such that we can hold at least 'length' many samples. The length gets rounded up to a power of two*/			\
+	/* so that get() can index with a shift and a mask - only the last segment's actual allocation is sized by what's left, so nothing is wasted.*/			\
 	f->totalLen = length;																																	\
-	f->segmentLen = min(length, MAX_SEGMENT_LEN);																											\
+	f->segmentLen = min(NextPowerOfTwo(length), MAX_SEGMENT_LEN);																							\
+	f->segmentShift = CountTrailingZeroes(f->segmentLen);																									\
+	f->segmentMask = f->segmentLen - 1;																														\
 	f->segmentCount = DivCeilInt(length, f->segmentLen);																									\
+	f->spillFile = NULL;																																	\
+	f->spillMapping = NULL;																																	\
+	f->arena = functionArena;																																\
 																																							\
-	if ((f->samples = calloc(f->segmentCount, sizeof(type*))) == NULL)																						\
+	if ((f->samples = FunctionAlloc(f->arena, f->segmentCount * sizeof(type*))) == NULL)																	\
 	{																																						\
 		return FALSE;																																		\
 	}																																						\
 																																							\
-	for (unsigned long i = 0; i < f->segmentCount - 1; i++)																									\
+	/* Zeroing so the cleanup paths can tell which segments got allocated.*/																				\
+	memset(f->samples, 0, f->segmentCount * sizeof(type*));																									\
+																																							\
+	/* The last segment may be shorter than segmentLen. Its size is however many samples are left to allocate for.*/										\
+	unsigned long long lastSegmentLen = f->totalLen - ((f->segmentCount - 1) * f->segmentLen);																\
+	char heapSuccess = TRUE;																																\
+																																							\
+	for (unsigned long i = 0; i < f->segmentCount && heapSuccess; i++)																						\
 	{																																						\
-		if ((f->samples[i] = malloc(sizeof(type) * f->segmentLen)) == NULL)																					\
-		{																																					\
-			return FALSE;																																	\
-		}																																					\
+		unsigned long long segmentLen = i == f->segmentCount - 1 ? lastSegmentLen : f->segmentLen;															\
+		heapSuccess = (f->samples[i] = FunctionAlloc(f->arena, sizeof(type) * segmentLen)) != NULL;															\
 	}																																						\
 																																							\
-	/* The last segment may be shorter than segmentLen. Its size is however many samples are left to allocate for.*/										\
-	if ((f->samples[f->segmentCount - 1] = malloc(sizeof(type) * (f->totalLen - ((f->segmentCount - 1) * f->segmentLen)))) == NULL)							\
+	if (heapSuccess)																																		\
 	{																																						\
-		return FALSE;																																		\
+		return TRUE;																																		\
+	}																																						\
+																																							\
+	/* Not enough memory to hold the function on the heap. Spilling it to a temp file on disk instead, so only the parts being worked on have to occupy RAM.*/\
+	for (unsigned long i = 0; i < f->segmentCount; i++)																										\
+	{																																						\
+		FunctionFree(f->arena, f->samples[i]);																												\
+		f->samples[i] = NULL;																																\
 	}																																						\
 																																							\
-	return TRUE;																																			\
+	return MapSpillFileSegments((void**)f->samples, f->segmentCount, sizeof(type) * f->segmentLen, sizeof(type) * lastSegmentLen, &(f->spillFile), &(f->spillMapping));\
 }																																							\
 																																							\
 void DeallocateFunctionInternals_##type(Function_##type* f)																									\
 {																																							\
 	if (f != NULL && f->samples != NULL)																													\
 	{																																						\
-		for (unsigned long i = 0; i < f->segmentCount; i++)																									\
+		if (f->spillFile != NULL)																															\
 		{																																					\
-			/* It's possible that some of these are NULL, but that's ok because free doesn't throw errors on NULL pointers.*/								\
-			free(f->samples[i]);																															\
+			UnmapSpillFileSegments((void**)f->samples, f->segmentCount, f->spillFile, f->spillMapping);														\
+		}																																					\
+		else																																				\
+		{																																					\
+			for (unsigned long i = 0; i < f->segmentCount; i++)																								\
+			{																																				\
+				/* It's possible that some of these are NULL, but that's ok because freeing NULL pointers is harmless.*/									\
+				FunctionFree(f->arena, f->samples[i]);																										\
+			}																																				\
 		}																																					\
 																																							\
-		free(f->samples);																																	\
+		FunctionFree(f->arena, f->samples);																													\
 	}																																						\
 }																																							\
 																																							\
@@ -93,8 +144,8 @@ void CopySamples_##type(Function_##type dest, Function_##type src, unsigned long
 	{																																						\
 		/* We could've just had a simple for loop of get(dest, destFrom + i) = get(src, srcFrom + i), but it's more efficient to copy in bulk.*/			\
 		/* For that we need to calculate how many samples are there to copy in the current block of each function, and copy as many as we can.*/			\
-		unsigned long long destRemainingSamplesInBlock = dest.segmentLen - ((destFrom + amountCopied) % dest.segmentLen);									\
-		unsigned long long srcRemainingSamplesInBlock = src.segmentLen - ((srcFrom + amountCopied) % src.segmentLen);										\
+		unsigned long long destRemainingSamplesInBlock = dest.segmentLen - ((destFrom + amountCopied) & dest.segmentMask);									\
+		unsigned long long srcRemainingSamplesInBlock = src.segmentLen - ((srcFrom + amountCopied) & src.segmentMask);										\
 		unsigned long long amountToCopy = ClampInt(length - amountCopied, 0, min(destRemainingSamplesInBlock, srcRemainingSamplesInBlock));					\
 		memcpy(&get(dest, destFrom + amountCopied), &get(src, srcFrom + amountCopied), amountToCopy * sizeof(type));										\
 		amountCopied += amountToCopy;																														\
@@ -106,6 +157,20 @@ precision##Real GetMax_##precision##Real(Function_##precision##Real f, unsigned
 {																																							\
 	precision##Real max = -INFINITY;																														\
 																																							\
+	/* When nothing gets skipped, every segment is a contiguous run that the vectorized kernels can chew through without the division in get().*/			\
+	if (step == 1 && SimdKernelsSupported())																												\
+	{																																						\
+		for (unsigned long long i = from; i < to;)																											\
+		{																																					\
+			unsigned long long runLen = min(to - i, f.segmentLen - (i % f.segmentLen));																		\
+			precision##Real runMax = ReduceMax_##precision##Real(&get(f, i), runLen);																		\
+			max = runMax > max ? runMax : max;																												\
+			i += runLen;																																	\
+		}																																					\
+																																							\
+		return max;																																			\
+	}																																						\
+																																							\
 	for (unsigned long long i = from; i < to; i += step)																									\
 	{																																						\
 		precision##Real sample = get(f, i);																													\
@@ -123,6 +188,19 @@ precision##Real GetMin_##precision##Real(Function_##precision##Real f, unsigned
 {																																							\
 	precision##Real min = INFINITY;																															\
 																																							\
+	if (step == 1 && SimdKernelsSupported())																												\
+	{																																						\
+		for (unsigned long long i = from; i < to;)																											\
+		{																																					\
+			unsigned long long runLen = min(to - i, f.segmentLen - (i % f.segmentLen));																		\
+			precision##Real runMin = ReduceMin_##precision##Real(&get(f, i), runLen);																		\
+			min = runMin < min ? runMin : min;																												\
+			i += runLen;																																	\
+		}																																					\
+																																							\
+		return min;																																			\
+	}																																						\
+																																							\
 	for (unsigned long long i = from; i < to; i += step)																									\
 	{																																						\
 		precision##Real sample = get(f, i);																													\
@@ -141,6 +219,27 @@ precision##Complex GetMax_##precision##Complex(Function_##precision##Complex f,
 	precision##Real maxSqrMagnitude = -INFINITY;																											\
 	precision##Complex maxSample = NAN;																														\
 																																							\
+	/* Same deal as with the real version, except the kernel also fuses the magnitude computation into the comparison.*/									\
+	if (step == 1 && SimdKernelsSupported())																												\
+	{																																						\
+		for (unsigned long long i = from; i < to;)																											\
+		{																																					\
+			unsigned long long runLen = min(to - i, f.segmentLen - (i % f.segmentLen));																		\
+			precision##Complex runMax = ReduceMaxMagnitude_##precision##Complex(&get(f, i), runLen);														\
+			precision##Real sqrMag = SquareMagnitude##precision##Complex(runMax);																			\
+																																							\
+			if (sqrMag > maxSqrMagnitude)																													\
+			{																																				\
+				maxSample = runMax;																															\
+				maxSqrMagnitude = sqrMag;																													\
+			}																																				\
+																																							\
+			i += runLen;																																	\
+		}																																					\
+																																							\
+		return maxSample;																																	\
+	}																																						\
+																																							\
 	for (unsigned long long i = from; i < to; i += step)																									\
 	{																																						\
 		precision##Complex sample = get(f, i);																												\
@@ -181,10 +280,409 @@ Function_##precision##Real ReadComplexFunctionAsReal_##precision##Complex(Functi
 	Function_##precision##Real fReal;																														\
 	fReal.funcType = precision##Real##Type;																													\
 	fReal.segmentLen = 2 * f->segmentLen;																													\
+	fReal.segmentShift = f->segmentShift + 1;																												\
+	fReal.segmentMask = fReal.segmentLen - 1;																												\
 	fReal.segmentCount = f->segmentCount;																													\
 	fReal.totalLen = 2 * f->totalLen;																														\
 	fReal.samples = ((precision##Real**)f->samples);																										\
+	fReal.spillFile = f->spillFile;																															\
+	fReal.spillMapping = f->spillMapping;																													\
+	fReal.arena = f->arena;																																	\
 	return fReal;																																			\
+}																																							\
+																																							\
+PeakPyramid_##precision##Real* CreatePeakPyramid_##precision##Real(Function_##precision##Real f, unsigned long long length)									\
+{																																							\
+	PeakPyramid_##precision##Real* pyramid = calloc(1, sizeof(PeakPyramid_##precision##Real));																\
+																																							\
+	if (pyramid == NULL)																																	\
+	{																																						\
+		return NULL;																																		\
+	}																																						\
+																																							\
+	pyramid->funcType = precision##Real##Type;																												\
+	pyramid->baseBlockLen = PEAK_PYRAMID_BASE_LEN;																											\
+																																							\
+	/* Every level has half as many blocks as the one below it (rounded up), until a single block covers the whole function.*/								\
+	pyramid->levelCount = 1;																																\
+																																							\
+	for (unsigned long long blocks = DivCeilInt(length, pyramid->baseBlockLen); blocks > 1; blocks = DivCeilInt(blocks, 2))									\
+	{																																						\
+		pyramid->levelCount++;																																\
+	}																																						\
+																																							\
+	char success = (pyramid->levelLengths = malloc(pyramid->levelCount * sizeof(unsigned long long))) != NULL &&											\
+		(pyramid->mins = calloc(pyramid->levelCount, sizeof(precision##Real*))) != NULL &&																	\
+		(pyramid->maxes = calloc(pyramid->levelCount, sizeof(precision##Real*))) != NULL;																	\
+																																							\
+	unsigned long long blocks = DivCeilInt(length, pyramid->baseBlockLen);																					\
+																																							\
+	for (unsigned long long level = 0; success && level < pyramid->levelCount; level++)																		\
+	{																																						\
+		pyramid->levelLengths[level] = blocks;																												\
+		success = (pyramid->mins[level] = malloc(blocks * sizeof(precision##Real))) != NULL &&																\
+			(pyramid->maxes[level] = malloc(blocks * sizeof(precision##Real))) != NULL;																		\
+		blocks = DivCeilInt(blocks, 2);																														\
+	}																																						\
+																																							\
+	if (!success)																																			\
+	{																																						\
+		DeallocatePeakPyramid_##precision##Real(pyramid);																									\
+		return NULL;																																		\
+	}																																						\
+																																							\
+	/* Filling the bottom level with a single streaming pass over the samples.*/																			\
+	unsigned long long baseBlocks = DivCeilInt(length, pyramid->baseBlockLen);																				\
+																																							\
+	for (unsigned long long block = 0; block < baseBlocks; block++)																							\
+	{																																						\
+		unsigned long long from = block * pyramid->baseBlockLen;																							\
+		unsigned long long to = min(length, from + pyramid->baseBlockLen);																					\
+		precision##Real min = INFINITY;																														\
+		precision##Real max = -INFINITY;																													\
+																																							\
+		for (unsigned long long i = from; i < to; i++)																										\
+		{																																					\
+			precision##Real sample = get(f, i);																												\
+			min = sample < min ? sample : min;																												\
+			max = sample > max ? sample : max;																												\
+		}																																					\
+																																							\
+		pyramid->mins[0][block] = min;																														\
+		pyramid->maxes[0][block] = max;																														\
+	}																																						\
+																																							\
+	/* Every block above that takes the min/max of the two blocks below it. When a level has an odd block out, it carries straight up.*/					\
+	for (unsigned long long level = 1; level < pyramid->levelCount; level++)																				\
+	{																																						\
+		for (unsigned long long block = 0; block < pyramid->levelLengths[level]; block++)																	\
+		{																																					\
+			unsigned long long left = 2 * block;																											\
+			unsigned long long right = left + 1;																											\
+			precision##Real min = pyramid->mins[level - 1][left];																							\
+			precision##Real max = pyramid->maxes[level - 1][left];																							\
+																																							\
+			if (right < pyramid->levelLengths[level - 1])																									\
+			{																																				\
+				min = pyramid->mins[level - 1][right] < min ? pyramid->mins[level - 1][right] : min;														\
+				max = pyramid->maxes[level - 1][right] > max ? pyramid->maxes[level - 1][right] : max;														\
+			}																																				\
+																																							\
+			pyramid->mins[level][block] = min;																												\
+			pyramid->maxes[level][block] = max;																												\
+		}																																					\
+	}																																						\
+																																							\
+	return pyramid;																																			\
+}																																							\
+																																							\
+void DeallocatePeakPyramid_##precision##Real(PeakPyramid_##precision##Real* pyramid)																		\
+{																																							\
+	if (pyramid == NULL)																																	\
+	{																																						\
+		return;																																				\
+	}																																						\
+																																							\
+	for (unsigned long long level = 0; level < pyramid->levelCount; level++)																				\
+	{																																						\
+		if (pyramid->mins != NULL)																															\
+		{																																					\
+			free(pyramid->mins[level]);																														\
+		}																																					\
+																																							\
+		if (pyramid->maxes != NULL)																															\
+		{																																					\
+			free(pyramid->maxes[level]);																													\
+		}																																					\
+	}																																						\
+																																							\
+	free(pyramid->levelLengths);																															\
+	free(pyramid->mins);																																	\
+	free(pyramid->maxes);																																	\
+	free(pyramid);																																			\
+}																																							\
+																																							\
+precision##Real GetPeakPyramidMax_##precision##Real(PeakPyramid_##precision##Real* pyramid, Function_##precision##Real f, unsigned long long from, unsigned long long to)\
+{																																							\
+	/* Whole blocks are answered by the pyramid. The partial blocks the range starts and ends with get scanned directly, so no peak is ever missed.*/		\
+	unsigned long long firstBlock = DivCeilInt(from, pyramid->baseBlockLen);																				\
+	unsigned long long lastBlock = to / pyramid->baseBlockLen;																								\
+																																							\
+	if (firstBlock >= lastBlock)																															\
+	{																																						\
+		return GetMax_##precision##Real(f, from, to, 1);																									\
+	}																																						\
+																																							\
+	precision##Real max = GetMax_##precision##Real(f, from, firstBlock * pyramid->baseBlockLen, 1);															\
+	precision##Real edgeMax = GetMax_##precision##Real(f, lastBlock * pyramid->baseBlockLen, to, 1);														\
+	max = edgeMax > max ? edgeMax : max;																													\
+																																							\
+	/* The classic bottom-up segment tree walk. Each level takes the odd blocks sticking out at the range's edges, then hands the rest to the level above.*/\
+	for (unsigned long long level = 0; firstBlock < lastBlock; level++)																						\
+	{																																						\
+		if (firstBlock % 2 == 1)																															\
+		{																																					\
+			max = pyramid->maxes[level][firstBlock] > max ? pyramid->maxes[level][firstBlock] : max;														\
+			firstBlock++;																																	\
+		}																																					\
+																																							\
+		if (lastBlock % 2 == 1)																																\
+		{																																					\
+			lastBlock--;																																	\
+			max = pyramid->maxes[level][lastBlock] > max ? pyramid->maxes[level][lastBlock] : max;															\
+		}																																					\
+																																							\
+		firstBlock /= 2;																																	\
+		lastBlock /= 2;																																		\
+	}																																						\
+																																							\
+	return max;																																				\
+}																																							\
+																																							\
+precision##Real GetPeakPyramidMin_##precision##Real(PeakPyramid_##precision##Real* pyramid, Function_##precision##Real f, unsigned long long from, unsigned long long to)\
+{																																							\
+	unsigned long long firstBlock = DivCeilInt(from, pyramid->baseBlockLen);																				\
+	unsigned long long lastBlock = to / pyramid->baseBlockLen;																								\
+																																							\
+	if (firstBlock >= lastBlock)																															\
+	{																																						\
+		return GetMin_##precision##Real(f, from, to, 1);																									\
+	}																																						\
+																																							\
+	precision##Real min = GetMin_##precision##Real(f, from, firstBlock * pyramid->baseBlockLen, 1);															\
+	precision##Real edgeMin = GetMin_##precision##Real(f, lastBlock * pyramid->baseBlockLen, to, 1);														\
+	min = edgeMin < min ? edgeMin : min;																													\
+																																							\
+	for (unsigned long long level = 0; firstBlock < lastBlock; level++)																						\
+	{																																						\
+		if (firstBlock % 2 == 1)																															\
+		{																																					\
+			min = pyramid->mins[level][firstBlock] < min ? pyramid->mins[level][firstBlock] : min;															\
+			firstBlock++;																																	\
+		}																																					\
+																																							\
+		if (lastBlock % 2 == 1)																																\
+		{																																					\
+			lastBlock--;																																	\
+			min = pyramid->mins[level][lastBlock] < min ? pyramid->mins[level][lastBlock] : min;															\
+		}																																					\
+																																							\
+		firstBlock /= 2;																																	\
+		lastBlock /= 2;																																		\
+	}																																						\
+																																							\
+	return min;																																				\
+}																																							\
+MagnitudePyramid_##precision##Complex* CreateMagnitudePyramid_##precision##Complex(Function_##precision##Complex f, unsigned long long length)				\
+{																																							\
+	MagnitudePyramid_##precision##Complex* pyramid = calloc(1, sizeof(MagnitudePyramid_##precision##Complex));												\
+																																							\
+	if (pyramid == NULL)																																	\
+	{																																						\
+		return NULL;																																		\
+	}																																						\
+																																							\
+	pyramid->funcType = precision##Complex##Type;																											\
+	pyramid->baseBlockLen = PEAK_PYRAMID_BASE_LEN;																											\
+																																							\
+	/* Every level has half as many blocks as the one below it (rounded up), until a single block covers the whole spectrum.*/								\
+	pyramid->levelCount = 1;																																\
+																																							\
+	for (unsigned long long blocks = DivCeilInt(length, pyramid->baseBlockLen); blocks > 1; blocks = DivCeilInt(blocks, 2))									\
+	{																																						\
+		pyramid->levelCount++;																																\
+	}																																						\
+																																							\
+	char success = (pyramid->levelLengths = malloc(pyramid->levelCount * sizeof(unsigned long long))) != NULL &&											\
+		(pyramid->maxes = calloc(pyramid->levelCount, sizeof(precision##Real*))) != NULL;																	\
+																																							\
+	unsigned long long blocks = DivCeilInt(length, pyramid->baseBlockLen);																					\
+																																							\
+	for (unsigned long long level = 0; success && level < pyramid->levelCount; level++)																		\
+	{																																						\
+		pyramid->levelLengths[level] = blocks;																												\
+		success = (pyramid->maxes[level] = malloc(blocks * sizeof(precision##Real))) != NULL;																\
+		blocks = DivCeilInt(blocks, 2);																														\
+	}																																						\
+																																							\
+	if (!success)																																			\
+	{																																						\
+		DeallocateMagnitudePyramid_##precision##Complex(pyramid);																							\
+		return NULL;																																		\
+	}																																						\
+																																							\
+	/* Filling the bottom level with a single streaming pass over the bins. Square magnitudes are compared so each block only takes one root.*/				\
+	unsigned long long baseBlocks = DivCeilInt(length, pyramid->baseBlockLen);																				\
+																																							\
+	for (unsigned long long block = 0; block < baseBlocks; block++)																							\
+	{																																						\
+		unsigned long long from = block * pyramid->baseBlockLen;																							\
+		unsigned long long to = min(length, from + pyramid->baseBlockLen);																					\
+		precision##Real maxSqr = 0;																															\
+																																							\
+		for (unsigned long long i = from; i < to; i++)																										\
+		{																																					\
+			precision##Real sqrMag = SquareMagnitude##precision##Complex(get(f, i));																		\
+			maxSqr = sqrMag > maxSqr ? sqrMag : maxSqr;																										\
+		}																																					\
+																																							\
+		pyramid->maxes[0][block] = sqrt_##precision##Real(maxSqr);																							\
+	}																																						\
+																																							\
+	/* Every block above that takes the bigger of the two blocks below it. When a level has an odd block out, it carries straight up.*/						\
+	for (unsigned long long level = 1; level < pyramid->levelCount; level++)																				\
+	{																																						\
+		for (unsigned long long block = 0; block < pyramid->levelLengths[level]; block++)																	\
+		{																																					\
+			unsigned long long left = 2 * block;																											\
+			unsigned long long right = left + 1;																											\
+			precision##Real max = pyramid->maxes[level - 1][left];																							\
+																																							\
+			if (right < pyramid->levelLengths[level - 1])																									\
+			{																																				\
+				max = pyramid->maxes[level - 1][right] > max ? pyramid->maxes[level - 1][right] : max;														\
+			}																																				\
+																																							\
+			pyramid->maxes[level][block] = max;																												\
+		}																																					\
+	}																																						\
+																																							\
+	/* The top block covers the whole spectrum, which makes the global peak free for the taking.*/															\
+	pyramid->globalMax = pyramid->maxes[pyramid->levelCount - 1][0];																						\
+	return pyramid;																																			\
+}																																							\
+																																							\
+void DeallocateMagnitudePyramid_##precision##Complex(MagnitudePyramid_##precision##Complex* pyramid)														\
+{																																							\
+	if (pyramid == NULL)																																	\
+	{																																						\
+		return;																																				\
+	}																																						\
+																																							\
+	for (unsigned long long level = 0; level < pyramid->levelCount; level++)																				\
+	{																																						\
+		if (pyramid->maxes != NULL)																															\
+		{																																					\
+			free(pyramid->maxes[level]);																													\
+		}																																					\
+	}																																						\
+																																							\
+	free(pyramid->levelLengths);																															\
+	free(pyramid->maxes);																																	\
+	free(pyramid);																																			\
+}																																							\
+																																							\
+precision##Real GetMagnitudePyramidMax_##precision##Complex(MagnitudePyramid_##precision##Complex* pyramid, Function_##precision##Complex f, unsigned long long from, unsigned long long to)\
+{																																							\
+	/* Whole blocks are answered by the pyramid. The partial blocks the range starts and ends with get scanned directly, so the result is exact.*/			\
+	unsigned long long firstBlock = DivCeilInt(from, pyramid->baseBlockLen);																				\
+	unsigned long long lastBlock = to / pyramid->baseBlockLen;																								\
+																																							\
+	if (firstBlock >= lastBlock)																															\
+	{																																						\
+		return abs_##precision##Complex(GetMax_##precision##Complex(f, from, to, 1));																		\
+	}																																						\
+																																							\
+	/* Magnitudes are never negative, so 0 stands in for an edge scan when the range starts or ends exactly on a block boundary (where GetMax would hand back NAN).*/\
+	precision##Real max = from < firstBlock * pyramid->baseBlockLen ? abs_##precision##Complex(GetMax_##precision##Complex(f, from, firstBlock * pyramid->baseBlockLen, 1)) : 0;\
+	precision##Real edgeMax = to > lastBlock * pyramid->baseBlockLen ? abs_##precision##Complex(GetMax_##precision##Complex(f, lastBlock * pyramid->baseBlockLen, to, 1)) : 0;\
+	max = edgeMax > max ? edgeMax : max;																													\
+																																							\
+	/* The classic bottom-up segment tree walk. Each level takes the odd blocks sticking out at the range's edges, then hands the rest to the level above.*/\
+	for (unsigned long long level = 0; firstBlock < lastBlock; level++)																						\
+	{																																						\
+		if (firstBlock % 2 == 1)																															\
+		{																																					\
+			max = pyramid->maxes[level][firstBlock] > max ? pyramid->maxes[level][firstBlock] : max;														\
+			firstBlock++;																																	\
+		}																																					\
+																																							\
+		if (lastBlock % 2 == 1)																																\
+		{																																					\
+			lastBlock--;																																	\
+			max = pyramid->maxes[level][lastBlock] > max ? pyramid->maxes[level][lastBlock] : max;															\
+		}																																					\
+																																							\
+		firstBlock /= 2;																																	\
+		lastBlock /= 2;																																		\
+	}																																						\
+																																							\
+	return max;																																				\
+}
+
+// Creates a temp file for the samples of a function to spill into and maps every segment of it as a view of that file.
+// The memory manager pages the views in and out of RAM on demand, which is what makes functions bigger than RAM editable. get() doesn't know the difference.
+// Segment offsets in the file are always aligned to the allocation granularity because MAX_SEGMENT_LEN is a big power of two, so the views are legal.
+// Returns zero iff there was an error, in which case everything that was allocated here gets released.
+static char MapSpillFileSegments(void** segments, unsigned long long segmentCount, unsigned long long segmentBytes, unsigned long long lastSegmentBytes, void** spillFile, void** spillMapping)
+{
+	TCHAR tempDir[MAX_PATH], tempPath[MAX_PATH];
+
+	if (GetTempPath(MAX_PATH, tempDir) == 0 || GetTempFileName(tempDir, TEXT("fur"), 0, tempPath) == 0)
+	{
+		fprintf(stderr, "Making a name for a spill file failed with error code %lu.\n", GetLastError());
+		return FALSE;
+	}
+
+	// DELETE_ON_CLOSE means we don't have to worry about removing the file ourselves, even if the program dies without deallocating.
+	HANDLE file = CreateFile(tempPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Creating a spill file failed with error code %lu.\n", GetLastError());
+		return FALSE;
+	}
+
+	// Creating the mapping with the full size extends the file to that size.
+	unsigned long long totalBytes = ((segmentCount - 1) * segmentBytes) + lastSegmentBytes;
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READWRITE, (DWORD)(totalBytes >> (sizeof(DWORD) * CHAR_BIT)), (DWORD)totalBytes, NULL);
+
+	if (mapping == NULL)
+	{
+		fprintf(stderr, "Creating a spill file mapping failed with error code %lu.\n", GetLastError());
+		CloseHandle(file);
+		return FALSE;
+	}
+
+	for (unsigned long i = 0; i < segmentCount; i++)
+	{
+		unsigned long long offset = i * segmentBytes;
+		unsigned long long viewBytes = i == segmentCount - 1 ? lastSegmentBytes : segmentBytes;
+
+		if ((segments[i] = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, (DWORD)(offset >> (sizeof(DWORD) * CHAR_BIT)), (DWORD)offset, viewBytes)) == NULL)
+		{
+			fprintf(stderr, "Mapping segment %lu of a spill file failed with error code %lu.\n", i, GetLastError());
+
+			for (unsigned long j = 0; j < i; j++)
+			{
+				UnmapViewOfFile(segments[j]);
+				segments[j] = NULL;
+			}
+
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return FALSE;
+		}
+	}
+
+	*spillFile = file;
+	*spillMapping = mapping;
+	return TRUE;
+}
+
+// Releases a disk-backed function's segment views along with its spill file. The file deletes itself when its handle closes.
+static void UnmapSpillFileSegments(void** segments, unsigned long long segmentCount, void* spillFile, void* spillMapping)
+{
+	for (unsigned long i = 0; i < segmentCount; i++)
+	{
+		if (segments[i] != NULL)
+		{
+			UnmapViewOfFile(segments[i]);
+		}
+	}
+
+	CloseHandle((HANDLE)spillMapping);
+	CloseHandle((HANDLE)spillFile);
 }
 
 unsigned long long NumOfSamples(Function* f)
@@ -214,6 +712,11 @@ void DeallocateFunctionInternals(Function* f)
 	}
 }
 
+void SetFunctionArena(MemoryArena* arena)
+{
+	functionArena = arena;
+}
+
 Function* CreatePartialClone(Function* f, unsigned long long from, unsigned long long to)
 {
 	switch (GetType(f))
@@ -242,6 +745,73 @@ void CopySamples(Function* dest, Function* src, unsigned long long destFrom, uns
 	}
 }
 
+PeakPyramid* CreatePeakPyramid(Function* f, unsigned long long length)
+{
+	// The pyramid is built over the real sequence that the complex interleaved function encodes, which is how the waveform plotter reads it.
+	switch (GetType(f))
+	{
+		case FloatComplexType:
+			return CreatePeakPyramid_FloatReal(ReadComplexFunctionAsReal_FloatComplex((Function_FloatComplex*)f), length);
+		case DoubleComplexType:
+			return CreatePeakPyramid_DoubleReal(ReadComplexFunctionAsReal_DoubleComplex((Function_DoubleComplex*)f), length);
+		default:
+			return NULL;
+	}
+}
+
+void DeallocatePeakPyramid(PeakPyramid* pyramid)
+{
+	if (pyramid == NULL)
+	{
+		return;
+	}
+
+	switch (*((FunctionType*)pyramid))
+	{
+		case FloatRealType:
+			DeallocatePeakPyramid_FloatReal((PeakPyramid_FloatReal*)pyramid);
+			break;
+		case DoubleRealType:
+			DeallocatePeakPyramid_DoubleReal((PeakPyramid_DoubleReal*)pyramid);
+			break;
+		default:
+			break;
+	}
+}
+
+MagnitudePyramid* CreateMagnitudePyramid(Function* f, unsigned long long length)
+{
+	switch (GetType(f))
+	{
+		case FloatComplexType:
+			return CreateMagnitudePyramid_FloatComplex(*((Function_FloatComplex*)f), length);
+		case DoubleComplexType:
+			return CreateMagnitudePyramid_DoubleComplex(*((Function_DoubleComplex*)f), length);
+		default:
+			return NULL;
+	}
+}
+
+void DeallocateMagnitudePyramid(MagnitudePyramid* pyramid)
+{
+	if (pyramid == NULL)
+	{
+		return;
+	}
+
+	switch (*((FunctionType*)pyramid))
+	{
+		case FloatComplexType:
+			DeallocateMagnitudePyramid_FloatComplex((MagnitudePyramid_FloatComplex*)pyramid);
+			break;
+		case DoubleComplexType:
+			DeallocateMagnitudePyramid_DoubleComplex((MagnitudePyramid_DoubleComplex*)pyramid);
+			break;
+		default:
+			break;
+	}
+}
+
 SAMPLED_FUNCTION_C_TYPED_CONTENTS(FloatComplex)
 SAMPLED_FUNCTION_C_TYPED_CONTENTS(DoubleComplex)
 SAMPLED_FUNCTION_C_TYPED_CONTENTS(FloatReal)
@@ -0,0 +1,226 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "SessionJournal.h"
+#include <stdio.h>	 // For file I/O.
+#include <stdlib.h>	 // For malloc and friends.
+#include <string.h>	 // For checking the header stamp.
+#include <tchar.h>	 // For dealing with the journal file's path.
+#include <share.h>	 // For shflags to _tfsopen.
+#include <io.h>		 // For _commit, which is what actually pushes an entry past the OS cache onto the disk.
+
+// Stamped at the start of every journal so stale or foreign files get recognized and thrown out. Bump the digit when the format changes.
+#define JOURNAL_MAGIC "FOURJRN1"
+
+// What gets appended to the wave file's path to name its journal. Weird enough that it shouldn't collide with anything a user would make.
+#define JOURNAL_SUFFIX TEXT(".fourier-journal")
+
+// Sits at the start of the file, before the entries. A journal only counts when this matches the wave file as it opens now,
+// because entries recorded against a different length or channel layout would replay onto the wrong samples.
+typedef struct
+{
+	char magic[sizeof(JOURNAL_MAGIC)];	// JOURNAL_MAGIC, terminator included.
+	unsigned long long length;			// How many samples per channel the wave file had.
+	unsigned short channels;			// How many relevant channels it had.
+} JournalHeader;
+
+struct SessionJournal
+{
+	FILE* file;					// The sidecar file, opened for both reading and writing.
+	TCHAR path[MAX_PATH];		// Kept around so closing an empty journal can delete the file.
+	unsigned long long entries;	// How many whole entries the file holds. A torn entry from a crash mid-append doesn't count.
+	char broken;				// Set when a write fails. A broken journal ignores writes from then on, but what it already holds stays readable.
+};
+
+// Formats the journal's path into the given MAX_PATH-sized buffer. Returns zero iff it doesn't fit.
+static char SessionJournalPath(TCHAR* path, LPCTSTR wavePath)
+{
+	if (_tcslen(wavePath) + _tcslen(JOURNAL_SUFFIX) >= MAX_PATH)
+	{
+		return FALSE;
+	}
+
+	_stprintf_s(path, MAX_PATH, TEXT("%s%s"), wavePath, JOURNAL_SUFFIX);
+	return TRUE;
+}
+
+SessionJournal* OpenSessionJournal(LPCTSTR wavePath, unsigned long long length, unsigned short channels)
+{
+	SessionJournal* journal = calloc(1, sizeof(SessionJournal));
+
+	if (journal == NULL || !SessionJournalPath(journal->path, wavePath))
+	{
+		free(journal);
+		return NULL;
+	}
+
+	// Trying to keep an existing journal's entries first, falling back to creating a fresh file. Other writers get denied like with the
+	// twiddle cache, so two instances editing the same wave file can't interleave their entries.
+	journal->file = _tfsopen(journal->path, TEXT("r+b"), _SH_DENYWR);
+	char fresh = journal->file == NULL;
+
+	if (fresh && (journal->file = _tfsopen(journal->path, TEXT("w+b"), _SH_DENYWR)) == NULL)
+	{
+		free(journal);
+		return NULL;
+	}
+
+	JournalHeader header;
+
+	if (!fresh)
+	{
+		char valid = fread(&header, sizeof(JournalHeader), 1, journal->file) == 1 &&
+			memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) == 0 &&
+			header.length == length && header.channels == channels;
+
+		if (valid && fseek(journal->file, 0, SEEK_END) == 0)
+		{
+			// The division throws away a torn entry at the end, if a crash left one. The stray bytes get overwritten by the next append.
+			journal->entries = (ftell(journal->file) - sizeof(JournalHeader)) / sizeof(JournalEntry);
+		}
+		else
+		{
+			fresh = TRUE; // Stale or unreadable. Starting it over.
+		}
+	}
+
+	if (fresh)
+	{
+		memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+		header.length = length;
+		header.channels = channels;
+		journal->entries = 0;
+
+		if (_chsize_s(_fileno(journal->file), 0) != 0 || fseek(journal->file, 0, SEEK_SET) != 0 ||
+			fwrite(&header, sizeof(JournalHeader), 1, journal->file) != 1 || fflush(journal->file) != 0)
+		{
+			fclose(journal->file);
+			free(journal);
+			return NULL;
+		}
+	}
+
+	return journal;
+}
+
+unsigned long long SessionJournalEntries(SessionJournal* journal)
+{
+	return journal == NULL ? 0 : journal->entries;
+}
+
+char ReadSessionJournalEntry(SessionJournal* journal, unsigned long long n, JournalEntry* entry)
+{
+	return journal != NULL && n < journal->entries &&
+		fseek(journal->file, sizeof(JournalHeader) + (n * sizeof(JournalEntry)), SEEK_SET) == 0 &&
+		fread(entry, sizeof(JournalEntry), 1, journal->file) == 1;
+}
+
+void AppendSessionJournalEntry(SessionJournal* journal, const JournalEntry* entry)
+{
+	if (journal == NULL || journal->broken)
+	{
+		return;
+	}
+
+	// The entry doesn't count until it's on the platter. fflush only hands it to the OS, _commit is what makes it survive a crash.
+	if (fseek(journal->file, sizeof(JournalHeader) + (journal->entries * sizeof(JournalEntry)), SEEK_SET) != 0 ||
+		fwrite(entry, sizeof(JournalEntry), 1, journal->file) != 1 ||
+		fflush(journal->file) != 0 || _commit(_fileno(journal->file)) != 0)
+	{
+		fprintf(stderr, "Appending to the session journal failed. Journaling is off until the file is reopened.\n");
+		journal->broken = TRUE;
+		return;
+	}
+
+	journal->entries++;
+}
+
+void ResetSessionJournal(SessionJournal* journal)
+{
+	if (journal == NULL || journal->broken)
+	{
+		return;
+	}
+
+	if (_chsize_s(_fileno(journal->file), sizeof(JournalHeader)) != 0)
+	{
+		fprintf(stderr, "Emptying the session journal failed. Journaling is off until the file is reopened.\n");
+		journal->broken = TRUE;
+		return;
+	}
+
+	journal->entries = 0;
+}
+
+// Appends one apply entry per modification on the (exclusive) path from 'from' up to 'top', deepest first, by recursing before recording.
+static void RelogModifications(SessionJournal* journal, Modification* from, Modification* top)
+{
+	if (top == from)
+	{
+		return;
+	}
+
+	RelogModifications(journal, from, top->prev);
+
+	// The stack stores additive smoothing already reshaped into its real range, so it gets mapped back to the raw 0-1 value the journal
+	// records and ApplyModification expects. The round trip can wobble the last bit or two, which no one can hear.
+	double smoothing = top->changeType == MULTIPLY ? top->smoothing :
+		(top->smoothing - MAX_ADDITIVE_SMOOTHING) / (MIN_ADDITIVE_SMOOTHING - MAX_ADDITIVE_SMOOTHING);
+	JournalEntry entry = { JOURNAL_APPLY, top->changeType, top->channel, top->startSample, top->startSample + top->length - 1, top->changeAmount, smoothing };
+	AppendSessionJournalEntry(journal, &entry);
+}
+
+void RewriteSessionJournal(SessionJournal* journal, Modification* savedState, Modification* top)
+{
+	if (journal == NULL)
+	{
+		return;
+	}
+
+	// Checking that the saved state actually sits below the top. When it doesn't (the user undid past it while the save ran), there's no
+	// telling the journal's story relative to the saved file, so it just empties and the newer edits go without protection this once.
+	Modification* current = top;
+
+	while (current != NULL && current != savedState)
+	{
+		current = current->prev;
+	}
+
+	ResetSessionJournal(journal);
+
+	if (current != NULL)
+	{
+		RelogModifications(journal, savedState, top);
+	}
+}
+
+void CloseSessionJournal(SessionJournal* journal)
+{
+	if (journal == NULL)
+	{
+		return;
+	}
+
+	char empty = journal->entries == 0 && !journal->broken;
+	fclose(journal->file);
+
+	if (empty)
+	{
+		_tremove(journal->path);
+	}
+
+	free(journal);
+}
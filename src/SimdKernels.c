@@ -0,0 +1,1266 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "SimdKernels.h"
+#include "MyUtils.h"
+#include <immintrin.h>	// For AVX2 and FMA intrinsics.
+#include <complex.h>	// For the scalar tails of the kernels.
+
+// Everything in this file that touches a vector register is compiled for AVX2 and FMA no matter what the rest of the program is compiled for.
+// That's why callers have to check SimdKernelsSupported before calling anything here - on older CPUs these functions are illegal instructions waiting to happen.
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+
+// An AVX register holds 4 complex floats or 2 complex doubles, laid out as (real, imaginary) pairs just like the C complex types.
+#define FLOAT_LANES 4
+#define DOUBLE_LANES 2
+
+// For kernels that work on plain reals instead of complex numbers, a register holds twice as many.
+#define FLOAT_REAL_LANES 8
+#define DOUBLE_REAL_LANES 4
+
+// Masks for flipping the sign of the imaginary parts (conjugation), the real parts (FlipReal), or both, and a register full of complex ones.
+#define CONJ_MASK_PS _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f)
+#define FLIP_REAL_MASK_PS _mm256_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f)
+#define NEGATE_MASK_PS _mm256_set1_ps(-0.0f)
+#define ONES_PS _mm256_setr_ps(1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f)
+
+// How many samples TukeyRamp generates from one batch of libm-seeded cosine lanes before reseeding them.
+// Its rotation recurrence drifts by about an ulp per step, so short blocks keep the window essentially exact.
+#define RAMP_RESEED_LEN 256
+
+#define CONJ_MASK_PD _mm256_setr_pd(0.0, -0.0, 0.0, -0.0)
+#define FLIP_REAL_MASK_PD _mm256_setr_pd(-0.0, 0.0, -0.0, 0.0)
+#define NEGATE_MASK_PD _mm256_set1_pd(-0.0)
+#define ONES_PD _mm256_setr_pd(1.0, 0.0, 1.0, 0.0)
+
+char SimdKernelsSupported(void)
+{
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#pragma region Float kernels
+
+// Like conjugate, but flips the real part instead of the imaginary. Scalar version for the kernel tails.
+ __attribute__((always_inline)) inline
+static FloatComplex FlipReal_FloatComplex(FloatComplex x)
+{
+	return -crealf(x) + I * cimagf(x);
+}
+
+// Loads 4 complex floats which sit 'stride' elements apart from each other. A complex float is conveniently 8 bytes, which gathers support directly.
+SIMD_TARGET
+static __m256 LoadStrided_FloatComplex(const FloatComplex* base, long long stride)
+{
+	__m256i indices = _mm256_setr_epi64x(0, stride, 2 * stride, 3 * stride);
+	return _mm256_castsi256_ps(_mm256_i64gather_epi64(CAST(base, const long long*), indices, sizeof(FloatComplex)));
+}
+
+// Stores 4 complex floats 'stride' elements apart from each other. There's no scatter in AVX2 so this goes through memory.
+SIMD_TARGET
+static void StoreStrided_FloatComplex(FloatComplex* base, long long stride, __m256 vals)
+{
+	FloatComplex lanes[FLOAT_LANES];
+	_mm256_storeu_ps(CAST(lanes, float*), vals);
+	base[0] = lanes[0];
+	base[stride] = lanes[1];
+	base[2 * stride] = lanes[2];
+	base[3 * stride] = lanes[3];
+}
+
+// Multiplies 4 pairs of complex floats. The usual shuffle-and-fmaddsub dance.
+SIMD_TARGET
+static __m256 Multiply_FloatComplex(__m256 a, __m256 b)
+{
+	__m256 bSwapped = _mm256_permute_ps(b, 0xB1);
+	__m256 aRealParts = _mm256_moveldup_ps(a);
+	__m256 aImagParts = _mm256_movehdup_ps(a);
+	return _mm256_fmaddsub_ps(aRealParts, b, _mm256_mul_ps(aImagParts, bSwapped));
+}
+
+SIMD_TARGET
+void FFTButterflies_FloatComplex(FloatComplex* evens, FloatComplex* odds, const FloatComplex* twiddles, long long twiddleStride, char flipReal,
+								 unsigned long long count)
+{
+	__m256 twiddleSigns = flipReal ? FLIP_REAL_MASK_PS : _mm256_setzero_ps();
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_LANES <= count; n += FLOAT_LANES)
+	{
+		__m256 factors = twiddleStride == 1 ?
+						 _mm256_loadu_ps(CAST(twiddles + n, const float*)) :
+						 LoadStrided_FloatComplex(twiddles + CAST(n, long long) * twiddleStride, twiddleStride);
+		factors = _mm256_xor_ps(factors, twiddleSigns);
+
+		__m256 evenSums = _mm256_loadu_ps(CAST(evens + n, const float*));
+		__m256 oddSums = Multiply_FloatComplex(factors, _mm256_loadu_ps(CAST(odds + n, const float*)));
+		_mm256_storeu_ps(CAST(evens + n, float*), _mm256_add_ps(evenSums, oddSums));
+		_mm256_storeu_ps(CAST(odds + n, float*), _mm256_sub_ps(evenSums, oddSums));
+	}
+
+	for (; n < count; n++)
+	{
+		FloatComplex factor = twiddles[CAST(n, long long) * twiddleStride];
+		factor = flipReal ? FlipReal_FloatComplex(factor) : factor;
+
+		FloatComplex evenSum = evens[n];
+		FloatComplex oddSum = factor * odds[n];
+		evens[n] = evenSum + oddSum;
+		odds[n] = evenSum - oddSum;
+	}
+}
+
+// Loads the n'th group of 4 twiddle factors from a stream, with the stream's sign flips applied.
+SIMD_TARGET
+static __m256 LoadTwiddles_FloatComplex(TwiddleStream_FloatComplex stream, unsigned long long n)
+{
+	const FloatComplex* at = stream.base + (CAST(n, long long) * stream.stride);
+	__m256 factors = stream.stride == 1 ? _mm256_loadu_ps(CAST(at, const float*)) : LoadStrided_FloatComplex(at, stream.stride);
+	__m256 signs = _mm256_setzero_ps();
+	signs = stream.flipReal ? _mm256_xor_ps(signs, FLIP_REAL_MASK_PS) : signs;
+	signs = stream.conjugate ? _mm256_xor_ps(signs, CONJ_MASK_PS) : signs;
+	return _mm256_xor_ps(factors, signs);
+}
+
+// Scalar version of LoadTwiddles for the kernel tails.
+ __attribute__((always_inline)) inline
+static FloatComplex LoadTwiddleScalar_FloatComplex(TwiddleStream_FloatComplex stream, unsigned long long n)
+{
+	FloatComplex factor = stream.base[CAST(n, long long) * stream.stride];
+	factor = stream.flipReal ? FlipReal_FloatComplex(factor) : factor;
+	return stream.conjugate ? conjf(factor) : factor;
+}
+
+SIMD_TARGET
+void FFTButterflies4_FloatComplex(FloatComplex* run0, FloatComplex* run1, FloatComplex* run2, FloatComplex* run3,
+								  TwiddleStream_FloatComplex twiddles1, TwiddleStream_FloatComplex twiddles2,
+								  TwiddleStream_FloatComplex twiddles3, unsigned long long count)
+{
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_LANES <= count; n += FLOAT_LANES)
+	{
+		__m256 x0 = _mm256_loadu_ps(CAST(run0 + n, const float*));
+		__m256 t1 = Multiply_FloatComplex(LoadTwiddles_FloatComplex(twiddles1, n), _mm256_loadu_ps(CAST(run1 + n, const float*)));
+		__m256 t2 = Multiply_FloatComplex(LoadTwiddles_FloatComplex(twiddles2, n), _mm256_loadu_ps(CAST(run2 + n, const float*)));
+		__m256 t3 = Multiply_FloatComplex(LoadTwiddles_FloatComplex(twiddles3, n), _mm256_loadu_ps(CAST(run3 + n, const float*)));
+
+		// The radix-4 combine: two radix-2 combines of half-sums, where the odd half of the second pair is rotated by -i.
+		// -i*z is z with its parts swapped and the (new) imaginary one negated.
+		__m256 u0 = _mm256_add_ps(x0, t2);
+		__m256 u1 = _mm256_sub_ps(x0, t2);
+		__m256 u2 = _mm256_add_ps(t1, t3);
+		__m256 u3 = _mm256_xor_ps(_mm256_permute_ps(_mm256_sub_ps(t1, t3), 0xB1), CONJ_MASK_PS);
+
+		_mm256_storeu_ps(CAST(run0 + n, float*), _mm256_add_ps(u0, u2));
+		_mm256_storeu_ps(CAST(run1 + n, float*), _mm256_add_ps(u1, u3));
+		_mm256_storeu_ps(CAST(run2 + n, float*), _mm256_sub_ps(u0, u2));
+		_mm256_storeu_ps(CAST(run3 + n, float*), _mm256_sub_ps(u1, u3));
+	}
+
+	for (; n < count; n++)
+	{
+		FloatComplex x0 = run0[n];
+		FloatComplex t1 = LoadTwiddleScalar_FloatComplex(twiddles1, n) * run1[n];
+		FloatComplex t2 = LoadTwiddleScalar_FloatComplex(twiddles2, n) * run2[n];
+		FloatComplex t3 = LoadTwiddleScalar_FloatComplex(twiddles3, n) * run3[n];
+
+		FloatComplex u0 = x0 + t2;
+		FloatComplex u1 = x0 - t2;
+		FloatComplex u2 = t1 + t3;
+		FloatComplex diff = t1 - t3;
+		FloatComplex u3 = cimagf(diff) - (I * crealf(diff));
+
+		run0[n] = u0 + u2;
+		run1[n] = u1 + u3;
+		run2[n] = u0 - u2;
+		run3[n] = u1 - u3;
+	}
+}
+
+// Applies the postprocessing step to 4 pairs of samples whose roots of unity are in 'roots'.
+// The math is the same as ForwardPostprocessSymmetric in SoundEditor.c, after noticing that with A = 1 - i*r and B = 1 + i*r,
+// the new pair is (0.5 * (s*A + conj(o)*B), conj(0.5 * (conj(o)*A + s*B))), so both halves share the same coefficients.
+SIMD_TARGET
+static void PostprocessPairs_FloatComplex(__m256* samples, __m256* oppositeSamples, __m256 roots)
+{
+	// i*r is r with its parts swapped and the real one negated.
+	__m256 rotatedRoots = _mm256_xor_ps(_mm256_permute_ps(roots, 0xB1), FLIP_REAL_MASK_PS);
+	__m256 coeffsA = _mm256_sub_ps(ONES_PS, rotatedRoots);
+	__m256 coeffsB = _mm256_add_ps(ONES_PS, rotatedRoots);
+
+	__m256 halves = _mm256_set1_ps(0.5f);
+	__m256 s = *samples;
+	__m256 oConj = _mm256_xor_ps(*oppositeSamples, CONJ_MASK_PS);
+
+	*samples = _mm256_mul_ps(halves, _mm256_add_ps(Multiply_FloatComplex(s, coeffsA), Multiply_FloatComplex(oConj, coeffsB)));
+	*oppositeSamples = _mm256_xor_ps(_mm256_mul_ps(halves, _mm256_add_ps(Multiply_FloatComplex(oConj, coeffsA), Multiply_FloatComplex(s, coeffsB))),
+									 CONJ_MASK_PS);
+}
+
+// Scalar version of PostprocessPairs for the kernel tails.
+ __attribute__((always_inline)) inline
+static void PostprocessPairScalar_FloatComplex(FloatComplex* sample, FloatComplex* oppositeSample, FloatComplex root)
+{
+	FloatComplex coeffA = 1.0f - (I * root);
+	FloatComplex coeffB = 1.0f + (I * root);
+	FloatComplex s = *sample;
+	FloatComplex oConj = conjf(*oppositeSample);
+	*sample = 0.5f * ((s * coeffA) + (oConj * coeffB));
+	*oppositeSample = conjf(0.5f * ((oConj * coeffA) + (s * coeffB)));
+}
+
+SIMD_TARGET
+void PostprocessEvenIndices_FloatComplex(FloatComplex* samples, FloatComplex* oppositeSamples, const FloatComplex* roots, char inverse,
+										 unsigned long long count)
+{
+	// The backward transform is the forward one with every root of unity real-flipped, because FlipReal(r) turns both coefficients into their conjugates.
+	__m256 rootSigns = inverse ? FLIP_REAL_MASK_PS : _mm256_setzero_ps();
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_LANES <= count; n += FLOAT_LANES)
+	{
+		long long offset = 2 * CAST(n, long long);
+		__m256 r = _mm256_xor_ps(_mm256_loadu_ps(CAST(roots + n, const float*)), rootSigns);
+		__m256 s = LoadStrided_FloatComplex(samples + offset, 2);
+		__m256 o = LoadStrided_FloatComplex(oppositeSamples - offset, -2);
+		PostprocessPairs_FloatComplex(&s, &o, r);
+		StoreStrided_FloatComplex(samples + offset, 2, s);
+		StoreStrided_FloatComplex(oppositeSamples - offset, -2, o);
+	}
+
+	for (; n < count; n++)
+	{
+		long long offset = 2 * CAST(n, long long);
+		FloatComplex root = inverse ? FlipReal_FloatComplex(roots[n]) : roots[n];
+		PostprocessPairScalar_FloatComplex(samples + offset, oppositeSamples - offset, root);
+	}
+}
+
+// Computes the principal square root of 4 roots of unity. sqrt(z) for a unit-length z is z + 1 normalized back to unit length,
+// because e^(i*theta) + 1 = 2*cos(theta/2)*e^(i*theta/2). This cancels badly when z is close to -1, which our callers never pass.
+SIMD_TARGET
+static __m256 UnitSqrt_FloatComplex(__m256 roots)
+{
+	__m256 shifted = _mm256_add_ps(roots, ONES_PS);
+	__m256 squares = _mm256_mul_ps(shifted, shifted);
+	__m256 lengths = _mm256_sqrt_ps(_mm256_add_ps(squares, _mm256_permute_ps(squares, 0xB1)));
+	return _mm256_div_ps(shifted, lengths);
+}
+
+SIMD_TARGET
+void PostprocessOddIndices_FloatComplex(FloatComplex* samples, FloatComplex* oppositeSamples, FloatComplex* samplesBeforeHalf,
+										FloatComplex* samplesAfterHalf, const FloatComplex* roots, char inverse, unsigned long long count)
+{
+	__m256 rootSigns = inverse ? FLIP_REAL_MASK_PS : _mm256_setzero_ps();
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_LANES <= count; n += FLOAT_LANES)
+	{
+		long long offset = 2 * CAST(n, long long);
+		__m256 r = LoadStrided_FloatComplex(roots + offset, 2);
+
+		// sqrt(r) is the root for the index k. The root for halfLen-k is sqrt(FlipReal(r)), which equals -i*conj(sqrt(r)),
+		// so we can derive it from the first square root with a shuffle instead of computing a second one.
+		__m256 rootsBeforeHalf = UnitSqrt_FloatComplex(r);
+		__m256 rootsAfterHalf = _mm256_xor_ps(_mm256_permute_ps(rootsBeforeHalf, 0xB1), NEGATE_MASK_PS);
+		rootsBeforeHalf = _mm256_xor_ps(rootsBeforeHalf, rootSigns);
+		rootsAfterHalf = _mm256_xor_ps(rootsAfterHalf, rootSigns);
+
+		__m256 s = LoadStrided_FloatComplex(samples + offset, 2);
+		__m256 o = LoadStrided_FloatComplex(oppositeSamples - offset, -2);
+		PostprocessPairs_FloatComplex(&s, &o, rootsBeforeHalf);
+		StoreStrided_FloatComplex(samples + offset, 2, s);
+		StoreStrided_FloatComplex(oppositeSamples - offset, -2, o);
+
+		s = LoadStrided_FloatComplex(samplesBeforeHalf - offset, -2);
+		o = LoadStrided_FloatComplex(samplesAfterHalf + offset, 2);
+		PostprocessPairs_FloatComplex(&s, &o, rootsAfterHalf);
+		StoreStrided_FloatComplex(samplesBeforeHalf - offset, -2, s);
+		StoreStrided_FloatComplex(samplesAfterHalf + offset, 2, o);
+	}
+
+	for (; n < count; n++)
+	{
+		long long offset = 2 * CAST(n, long long);
+		FloatComplex root = roots[offset];
+		FloatComplex rootBeforeHalf = csqrtf(root);
+		FloatComplex rootAfterHalf = csqrtf(FlipReal_FloatComplex(root));
+		rootBeforeHalf = inverse ? FlipReal_FloatComplex(rootBeforeHalf) : rootBeforeHalf;
+		rootAfterHalf = inverse ? FlipReal_FloatComplex(rootAfterHalf) : rootAfterHalf;
+
+		PostprocessPairScalar_FloatComplex(samples + offset, oppositeSamples - offset, rootBeforeHalf);
+		PostprocessPairScalar_FloatComplex(samplesBeforeHalf - offset, samplesAfterHalf + offset, rootAfterHalf);
+	}
+}
+
+SIMD_TARGET
+void ConvertPcmToReal_FloatReal(FloatReal* dest, const unsigned char* src, unsigned long long count, int depth, int stride)
+{
+	float maxPlusHalf = CAST((1u << ((depth * CHAR_BIT) - 1)) - 1, float) + 0.5f;
+	__m256 divisor = _mm256_set1_ps(maxPlusHalf);
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256i offsets = _mm256_mullo_epi32(_mm256_set1_epi32(stride), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	unsigned long long b = 0;
+
+	// The gathers read a full 4 bytes per sample no matter the depth, which would run past the end of the data on the very last samples,
+	// so the vector loop stops a few samples short and leaves them for the scalar one.
+	for (; b + FLOAT_REAL_LANES + 3 <= count; b += FLOAT_REAL_LANES)
+	{
+		__m256i raw = _mm256_i32gather_epi32(CAST(src + (b * stride), const int*), offsets, 1);
+
+		// 8-bit samples are biased instead of two's complement so they get unbiased, and the narrower two's complement formats get sign-extended with a shift up and back down.
+		__m256i samples = depth == 1 ?
+						  _mm256_sub_epi32(_mm256_and_si256(raw, _mm256_set1_epi32(0xFF)), _mm256_set1_epi32(128)) :
+						  depth == 2 ? _mm256_srai_epi32(_mm256_slli_epi32(raw, 16), 16) :
+						  depth == 3 ? _mm256_srai_epi32(_mm256_slli_epi32(raw, 8), 8) : raw;
+		_mm256_storeu_ps(dest + b, _mm256_div_ps(_mm256_add_ps(_mm256_cvtepi32_ps(samples), half), divisor));
+	}
+
+	for (; b < count; b++)
+	{
+		unsigned int raw = 0;
+		memcpy(&raw, src + (b * stride), depth);
+		int sample = depth == 1 ? CAST(raw, int) - 128 :
+					 depth == 2 ? CAST(raw << 16, int) >> 16 :
+					 depth == 3 ? CAST(raw << 8, int) >> 8 : CAST(raw, int);
+		dest[b] = (sample + 0.5f) / maxPlusHalf;
+	}
+}
+
+// The rounding here is the one place this diverges from the scalar path: float to int conversions round ties to even while lround
+// rounds them away from zero. A tie can only happen on the exact boundary between two integers, which the dither makes as good as random.
+SIMD_TARGET
+void ConvertRealToPcm_FloatReal(unsigned char* dest, const FloatReal* src, unsigned long long count, int depth, int stride)
+{
+	// Depth 4's top of range isn't representable as a float and would round up past what the int conversion can hold, so it clamps to the biggest float below it.
+	float maxVal = depth == 4 ? 2147483520.0f : CAST((1u << ((depth * CHAR_BIT) - 1)) - 1, float);
+	__m256 maxVec = _mm256_set1_ps(maxVal);
+	__m256 minVec = _mm256_set1_ps(-maxVal - 1.0f);
+	__m256 negHalf = _mm256_set1_ps(-0.5f);
+	unsigned long long b = 0;
+
+	for (; b + FLOAT_REAL_LANES <= count; b += FLOAT_REAL_LANES)
+	{
+		// The dither has to come out of rand() one sample at a time like the scalar path, so the vectors only take over the arithmetic.
+		float dither[FLOAT_REAL_LANES];
+
+		for (int i = 0; i < FLOAT_REAL_LANES; i++)
+		{
+			dither[i] = RandRangeFloat(-1.0f, 0.0f) + RandRangeFloat(0.0f, 1.0f);
+		}
+
+		__m256 samples = _mm256_fmadd_ps(_mm256_loadu_ps(src + b), maxVec, negHalf);
+		samples = _mm256_add_ps(samples, _mm256_loadu_ps(dither));
+		samples = _mm256_max_ps(_mm256_min_ps(samples, maxVec), minVec);
+		__m256i quantized = _mm256_cvtps_epi32(samples);
+		quantized = depth == 1 ? _mm256_add_epi32(quantized, _mm256_set1_epi32(128)) : quantized;
+
+		// There's no scatter in AVX2 so the stores go through memory.
+		int lanes[FLOAT_REAL_LANES];
+		_mm256_storeu_si256(CAST(lanes, __m256i*), quantized);
+
+		for (int i = 0; i < FLOAT_REAL_LANES; i++)
+		{
+			memcpy(dest + ((b + i) * stride), &lanes[i], depth);
+		}
+	}
+
+	for (; b < count; b++)
+	{
+		float sample = (maxVal * src[b]) - 0.5f;
+		sample += RandRangeFloat(-1.0f, 0.0f) + RandRangeFloat(0.0f, 1.0f);
+		sample = ClampFloat(sample, -maxVal - 1.0f, maxVal);
+		int quantized = CAST(lroundf(sample), int);
+		quantized = depth == 1 ? quantized + 128 : quantized;
+		memcpy(dest + (b * stride), &quantized, depth);
+	}
+}
+
+
+SIMD_TARGET
+FloatReal ReduceMax_FloatReal(const FloatReal* src, unsigned long long count)
+{
+	__m256 maxes = _mm256_set1_ps(-INFINITY);
+	unsigned long long i = 0;
+
+	for (; i + FLOAT_REAL_LANES <= count; i += FLOAT_REAL_LANES)
+	{
+		maxes = _mm256_max_ps(maxes, _mm256_loadu_ps(src + i));
+	}
+
+	// Folding the register in half three times brings the biggest lane down to the bottom one.
+	__m128 quad = _mm_max_ps(_mm256_castps256_ps128(maxes), _mm256_extractf128_ps(maxes, 1));
+	__m128 pair = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+	float max = _mm_cvtss_f32(_mm_max_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+
+	for (; i < count; i++)
+	{
+		max = src[i] > max ? src[i] : max;
+	}
+
+	return max;
+}
+
+SIMD_TARGET
+FloatReal ReduceMin_FloatReal(const FloatReal* src, unsigned long long count)
+{
+	__m256 mins = _mm256_set1_ps(INFINITY);
+	unsigned long long i = 0;
+
+	for (; i + FLOAT_REAL_LANES <= count; i += FLOAT_REAL_LANES)
+	{
+		mins = _mm256_min_ps(mins, _mm256_loadu_ps(src + i));
+	}
+
+	__m128 quad = _mm_min_ps(_mm256_castps256_ps128(mins), _mm256_extractf128_ps(mins, 1));
+	__m128 pair = _mm_min_ps(quad, _mm_movehl_ps(quad, quad));
+	float min = _mm_cvtss_f32(_mm_min_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+
+	for (; i < count; i++)
+	{
+		min = src[i] < min ? src[i] : min;
+	}
+
+	return min;
+}
+
+SIMD_TARGET
+FloatComplex ReduceMaxMagnitude_FloatComplex(const FloatComplex* src, unsigned long long count)
+{
+	__m256 bestSqrMags = _mm256_set1_ps(-INFINITY);
+	__m256 bestSamples = _mm256_setzero_ps();
+	unsigned long long i = 0;
+
+	for (; i + FLOAT_LANES <= count; i += FLOAT_LANES)
+	{
+		__m256 samples = _mm256_loadu_ps(CAST(src + i, const float*));
+
+		// Squaring and adding each lane to its pair partner puts every sample's squared magnitude in both of its lanes,
+		// so the comparison mask below always moves (real, imaginary) pairs around together.
+		__m256 products = _mm256_mul_ps(samples, samples);
+		__m256 sqrMags = _mm256_add_ps(products, _mm256_permute_ps(products, 0xB1));
+		__m256 isBigger = _mm256_cmp_ps(sqrMags, bestSqrMags, _CMP_GT_OQ);
+		bestSqrMags = _mm256_blendv_ps(bestSqrMags, sqrMags, isBigger);
+		bestSamples = _mm256_blendv_ps(bestSamples, samples, isBigger);
+	}
+
+	FloatComplex laneSamples[FLOAT_LANES];
+	float laneSqrMags[FLOAT_REAL_LANES];
+	_mm256_storeu_ps(CAST(laneSamples, float*), bestSamples);
+	_mm256_storeu_ps(laneSqrMags, bestSqrMags);
+
+	FloatComplex max = NAN;
+	float maxSqrMag = -INFINITY;
+
+	for (int lane = 0; lane < FLOAT_LANES; lane++)
+	{
+		if (laneSqrMags[2 * lane] > maxSqrMag)
+		{
+			max = laneSamples[lane];
+			maxSqrMag = laneSqrMags[2 * lane];
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		float sqrMag = SquareMagnitudeFloatComplex(src[i]);
+
+		if (sqrMag > maxSqrMag)
+		{
+			max = src[i];
+			maxSqrMag = sqrMag;
+		}
+	}
+
+	return max;
+}
+
+// The magnitude of a complex number, by the same multiply-add-sqrt sequence the vector parts of the modification kernels use.
+// Their scalar tails have to compute magnitudes with this instead of cabs so a sample gets the same magnitude no matter which part handles it.
+ __attribute__((always_inline)) inline
+static float KernelMagnitude_FloatComplex(FloatComplex x)
+{
+	return sqrtf((crealf(x) * crealf(x)) + (cimagf(x) * cimagf(x)));
+}
+
+SIMD_TARGET
+void Magnitudes_FloatComplex(FloatReal* dest, const FloatComplex* src, long long stride, unsigned long long count)
+{
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_LANES <= count; n += FLOAT_LANES)
+	{
+		const FloatComplex* at = src + (CAST(n, long long) * stride);
+		__m256 samples = stride == 1 ? _mm256_loadu_ps(CAST(at, const float*)) : LoadStrided_FloatComplex(at, stride);
+		__m256 products = _mm256_mul_ps(samples, samples);
+		__m256 mags = _mm256_sqrt_ps(_mm256_add_ps(products, _mm256_permute_ps(products, 0xB1)));
+
+		// Every magnitude sits in both of its sample's lanes, so compacting the even lanes into the bottom half gives the 4 results in order.
+		__m256 packed = _mm256_permutevar8x32_ps(mags, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+		_mm_storeu_ps(dest + n, _mm256_castps256_ps128(packed));
+	}
+
+	for (; n < count; n++)
+	{
+		dest[n] = KernelMagnitude_FloatComplex(src[CAST(n, long long) * stride]);
+	}
+}
+
+// Spreads 4 packed floats into (real, imaginary) pair layout so they can meet 4 complex numbers lane for lane.
+SIMD_TARGET
+static __m256 LoadPaired_FloatReal(const float* src)
+{
+	return _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(src)), _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+}
+
+// MagnitudeAdd for one of the two runs, which walks from its pointer in the given direction (1 or -1).
+SIMD_TARGET
+static void MagnitudeAddRun_FloatComplex(FloatComplex* samples, long long stride, const FloatReal* additions, unsigned long long count)
+{
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_LANES <= count; n += FLOAT_LANES)
+	{
+		FloatComplex* at = samples + (CAST(n, long long) * stride);
+		__m256 vals = stride == 1 ? _mm256_loadu_ps(CAST(at, const float*)) : LoadStrided_FloatComplex(at, stride);
+		__m256 adds = LoadPaired_FloatReal(additions + n);
+
+		__m256 products = _mm256_mul_ps(vals, vals);
+		__m256 mags = _mm256_sqrt_ps(_mm256_add_ps(products, _mm256_permute_ps(products, 0xB1)));
+		__m256 newMags = _mm256_max_ps(_mm256_add_ps(mags, adds), _mm256_setzero_ps());
+
+		// Scaling by the ratio of new magnitude to old keeps the phase without ever computing it. Zero-magnitude samples have no phase
+		// to keep and would turn the ratio into NaN, so they become the new magnitude as a plain real, which is what carg=0 would give.
+		__m256 scaled = _mm256_mul_ps(vals, _mm256_div_ps(newMags, mags));
+		__m256 flattened = _mm256_blend_ps(newMags, _mm256_setzero_ps(), 0xAA);
+		__m256 results = _mm256_blendv_ps(scaled, flattened, _mm256_cmp_ps(mags, _mm256_setzero_ps(), _CMP_EQ_OQ));
+
+		if (stride == 1)
+		{
+			_mm256_storeu_ps(CAST(at, float*), results);
+		}
+		else
+		{
+			StoreStrided_FloatComplex(at, stride, results);
+		}
+	}
+
+	for (; n < count; n++)
+	{
+		FloatComplex* at = samples + (CAST(n, long long) * stride);
+		float magnitude = KernelMagnitude_FloatComplex(*at);
+		float newMagnitude = fmaxf(magnitude + additions[n], 0.0f);
+		*at = magnitude == 0.0f ? newMagnitude : *at * (newMagnitude / magnitude);
+	}
+}
+
+SIMD_TARGET
+void MagnitudeAdd_FloatComplex(FloatComplex* samples, FloatComplex* oppositeSamples, const FloatReal* additions, unsigned long long count)
+{
+	// The two runs never overlap - the caller stops them before they'd meet in the middle - so they can just go one after the other.
+	MagnitudeAddRun_FloatComplex(samples, 1, additions, count);
+	MagnitudeAddRun_FloatComplex(oppositeSamples, -1, additions, count);
+}
+
+// e^x for 8 nonpositive floats, by the usual Cody-Waite reduction x = k*ln(2) + r and a polynomial for e^r. Accurate to an ulp or two.
+SIMD_TARGET
+static __m256 Exp_FloatReal(__m256 x)
+{
+	__m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(0.693359375f), x);
+	r = _mm256_fnmadd_ps(k, _mm256_set1_ps(-2.12194440e-4f), r);
+
+	// e^r = 1 + r + r^2*p(r) on [-ln(2)/2, ln(2)/2].
+	__m256 p = _mm256_set1_ps(1.9875691500e-4f);
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+	p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+	// Scaling by 2^k happens right in the exponent bits. Inputs so negative that this would underflow just flush to zero.
+	__m256i biased = _mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127));
+	__m256 scaled = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(biased, 23)));
+	return _mm256_and_ps(scaled, _mm256_cmp_ps(x, _mm256_set1_ps(-87.0f), _CMP_GT_OQ));
+}
+
+SIMD_TARGET
+void GaussianAdditions_FloatReal(FloatReal* dest, FloatReal x, FloatReal step, FloatReal changeAmount, unsigned long long count)
+{
+	__m256 amounts = _mm256_set1_ps(changeAmount);
+	__m256 starts = _mm256_set1_ps(x);
+	__m256 steps = _mm256_set1_ps(step);
+
+	// The points get recomputed from their indices every iteration instead of accumulating, because integer adds on floats are exact
+	// while a running sum of steps would drift.
+	__m256 indices = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	unsigned long long n = 0;
+
+	for (; n + FLOAT_REAL_LANES <= count; n += FLOAT_REAL_LANES)
+	{
+		__m256 xs = _mm256_fmadd_ps(steps, indices, starts);
+		__m256 exps = Exp_FloatReal(_mm256_xor_ps(_mm256_mul_ps(xs, xs), NEGATE_MASK_PS));
+		_mm256_storeu_ps(dest + n, _mm256_mul_ps(amounts, exps));
+		indices = _mm256_add_ps(indices, _mm256_set1_ps(FLOAT_REAL_LANES));
+	}
+
+	for (; n < count; n++)
+	{
+		float at = x + (n * step);
+		dest[n] = changeAmount * expf(-(at * at));
+	}
+}
+
+SIMD_TARGET
+void TukeyRamp_FloatComplex(FloatComplex* samples, FloatComplex* oppositeSamples, FloatReal phase, FloatReal phaseStep,
+							FloatReal changeAmountMinusOne, char invert, unsigned long long count)
+{
+	// One vector iteration advances every lane's angle by this much, which rotating its (cos, sin) pair by the same angle accomplishes.
+	float turn = FLOAT_LANES * phaseStep;
+	__m256 turnCosines = _mm256_set1_ps(cosf(turn));
+	__m256 turnSines = _mm256_set1_ps(sinf(turn));
+	__m256 halves = _mm256_set1_ps(0.5f);
+	__m256 amounts = _mm256_set1_ps(changeAmountMinusOne);
+	unsigned long long n = 0;
+
+	while (n + FLOAT_LANES <= count)
+	{
+		// Seeding the lanes from libm once per block and rotating them the rest of the way, so libm only hears about one sample in hundreds.
+		float angle = phase + (n * phaseStep);
+		float c0 = cosf(angle), c1 = cosf(angle + phaseStep), c2 = cosf(angle + (2 * phaseStep)), c3 = cosf(angle + (3 * phaseStep));
+		float s0 = sinf(angle), s1 = sinf(angle + phaseStep), s2 = sinf(angle + (2 * phaseStep)), s3 = sinf(angle + (3 * phaseStep));
+		__m256 cosines = _mm256_setr_ps(c0, c0, c1, c1, c2, c2, c3, c3);
+		__m256 sines = _mm256_setr_ps(s0, s0, s1, s1, s2, s2, s3, s3);
+		unsigned long long blockEnd = n + RAMP_RESEED_LEN;
+
+		for (; n + FLOAT_LANES <= count && n < blockEnd; n += FLOAT_LANES)
+		{
+			__m256 multipliers = _mm256_fmadd_ps(amounts, _mm256_fnmadd_ps(halves, cosines, halves), _mm256_set1_ps(1.0f));
+			__m256 s = _mm256_loadu_ps(CAST(samples + n, const float*));
+			__m256 o = LoadStrided_FloatComplex(oppositeSamples - n, -1);
+			s = invert ? _mm256_div_ps(s, multipliers) : _mm256_mul_ps(s, multipliers);
+			o = invert ? _mm256_div_ps(o, multipliers) : _mm256_mul_ps(o, multipliers);
+			_mm256_storeu_ps(CAST(samples + n, float*), s);
+			StoreStrided_FloatComplex(oppositeSamples - n, -1, o);
+
+			__m256 rotated = _mm256_fnmadd_ps(sines, turnSines, _mm256_mul_ps(cosines, turnCosines));
+			sines = _mm256_fmadd_ps(sines, turnCosines, _mm256_mul_ps(cosines, turnSines));
+			cosines = rotated;
+		}
+	}
+
+	for (; n < count; n++)
+	{
+		float multiplier = 1.0f + (changeAmountMinusOne * (0.5f - (0.5f * cosf(phase + (n * phaseStep)))));
+		samples[n] = invert ? samples[n] / multiplier : samples[n] * multiplier;
+		oppositeSamples[-CAST(n, long long)] = invert ? oppositeSamples[-CAST(n, long long)] / multiplier :
+												oppositeSamples[-CAST(n, long long)] * multiplier;
+	}
+}
+
+#pragma endregion // Float kernels.
+
+#pragma region Double kernels
+
+// Same as the float one.
+ __attribute__((always_inline)) inline
+static DoubleComplex FlipReal_DoubleComplex(DoubleComplex x)
+{
+	return -creal(x) + I * cimag(x);
+}
+
+// Loads 2 complex doubles which sit 'stride' elements apart from each other. Complex doubles are 16 bytes so gathers don't fit them, but two halves do.
+SIMD_TARGET
+static __m256d LoadStrided_DoubleComplex(const DoubleComplex* base, long long stride)
+{
+	__m128d low = _mm_loadu_pd(CAST(base, const double*));
+	__m128d high = _mm_loadu_pd(CAST(base + stride, const double*));
+	return _mm256_insertf128_pd(_mm256_castpd128_pd256(low), high, 1);
+}
+
+// Stores 2 complex doubles 'stride' elements apart from each other.
+SIMD_TARGET
+static void StoreStrided_DoubleComplex(DoubleComplex* base, long long stride, __m256d vals)
+{
+	_mm_storeu_pd(CAST(base, double*), _mm256_castpd256_pd128(vals));
+	_mm_storeu_pd(CAST(base + stride, double*), _mm256_extractf128_pd(vals, 1));
+}
+
+// Multiplies 2 pairs of complex doubles.
+SIMD_TARGET
+static __m256d Multiply_DoubleComplex(__m256d a, __m256d b)
+{
+	__m256d bSwapped = _mm256_permute_pd(b, 0x5);
+	__m256d aRealParts = _mm256_movedup_pd(a);
+	__m256d aImagParts = _mm256_permute_pd(a, 0xF);
+	return _mm256_fmaddsub_pd(aRealParts, b, _mm256_mul_pd(aImagParts, bSwapped));
+}
+
+SIMD_TARGET
+void FFTButterflies_DoubleComplex(DoubleComplex* evens, DoubleComplex* odds, const DoubleComplex* twiddles, long long twiddleStride, char flipReal,
+								  unsigned long long count)
+{
+	__m256d twiddleSigns = flipReal ? FLIP_REAL_MASK_PD : _mm256_setzero_pd();
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_LANES <= count; n += DOUBLE_LANES)
+	{
+		__m256d factors = twiddleStride == 1 ?
+						  _mm256_loadu_pd(CAST(twiddles + n, const double*)) :
+						  LoadStrided_DoubleComplex(twiddles + CAST(n, long long) * twiddleStride, twiddleStride);
+		factors = _mm256_xor_pd(factors, twiddleSigns);
+
+		__m256d evenSums = _mm256_loadu_pd(CAST(evens + n, const double*));
+		__m256d oddSums = Multiply_DoubleComplex(factors, _mm256_loadu_pd(CAST(odds + n, const double*)));
+		_mm256_storeu_pd(CAST(evens + n, double*), _mm256_add_pd(evenSums, oddSums));
+		_mm256_storeu_pd(CAST(odds + n, double*), _mm256_sub_pd(evenSums, oddSums));
+	}
+
+	for (; n < count; n++)
+	{
+		DoubleComplex factor = twiddles[CAST(n, long long) * twiddleStride];
+		factor = flipReal ? FlipReal_DoubleComplex(factor) : factor;
+
+		DoubleComplex evenSum = evens[n];
+		DoubleComplex oddSum = factor * odds[n];
+		evens[n] = evenSum + oddSum;
+		odds[n] = evenSum - oddSum;
+	}
+}
+
+// Loads the n'th group of 2 twiddle factors from a stream, with the stream's sign flips applied.
+SIMD_TARGET
+static __m256d LoadTwiddles_DoubleComplex(TwiddleStream_DoubleComplex stream, unsigned long long n)
+{
+	const DoubleComplex* at = stream.base + (CAST(n, long long) * stream.stride);
+	__m256d factors = stream.stride == 1 ? _mm256_loadu_pd(CAST(at, const double*)) : LoadStrided_DoubleComplex(at, stream.stride);
+	__m256d signs = _mm256_setzero_pd();
+	signs = stream.flipReal ? _mm256_xor_pd(signs, FLIP_REAL_MASK_PD) : signs;
+	signs = stream.conjugate ? _mm256_xor_pd(signs, CONJ_MASK_PD) : signs;
+	return _mm256_xor_pd(factors, signs);
+}
+
+// Scalar version of LoadTwiddles for the kernel tails.
+ __attribute__((always_inline)) inline
+static DoubleComplex LoadTwiddleScalar_DoubleComplex(TwiddleStream_DoubleComplex stream, unsigned long long n)
+{
+	DoubleComplex factor = stream.base[CAST(n, long long) * stream.stride];
+	factor = stream.flipReal ? FlipReal_DoubleComplex(factor) : factor;
+	return stream.conjugate ? conj(factor) : factor;
+}
+
+SIMD_TARGET
+void FFTButterflies4_DoubleComplex(DoubleComplex* run0, DoubleComplex* run1, DoubleComplex* run2, DoubleComplex* run3,
+								   TwiddleStream_DoubleComplex twiddles1, TwiddleStream_DoubleComplex twiddles2,
+								   TwiddleStream_DoubleComplex twiddles3, unsigned long long count)
+{
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_LANES <= count; n += DOUBLE_LANES)
+	{
+		__m256d x0 = _mm256_loadu_pd(CAST(run0 + n, const double*));
+		__m256d t1 = Multiply_DoubleComplex(LoadTwiddles_DoubleComplex(twiddles1, n), _mm256_loadu_pd(CAST(run1 + n, const double*)));
+		__m256d t2 = Multiply_DoubleComplex(LoadTwiddles_DoubleComplex(twiddles2, n), _mm256_loadu_pd(CAST(run2 + n, const double*)));
+		__m256d t3 = Multiply_DoubleComplex(LoadTwiddles_DoubleComplex(twiddles3, n), _mm256_loadu_pd(CAST(run3 + n, const double*)));
+
+		__m256d u0 = _mm256_add_pd(x0, t2);
+		__m256d u1 = _mm256_sub_pd(x0, t2);
+		__m256d u2 = _mm256_add_pd(t1, t3);
+		__m256d u3 = _mm256_xor_pd(_mm256_permute_pd(_mm256_sub_pd(t1, t3), 0x5), CONJ_MASK_PD);
+
+		_mm256_storeu_pd(CAST(run0 + n, double*), _mm256_add_pd(u0, u2));
+		_mm256_storeu_pd(CAST(run1 + n, double*), _mm256_add_pd(u1, u3));
+		_mm256_storeu_pd(CAST(run2 + n, double*), _mm256_sub_pd(u0, u2));
+		_mm256_storeu_pd(CAST(run3 + n, double*), _mm256_sub_pd(u1, u3));
+	}
+
+	for (; n < count; n++)
+	{
+		DoubleComplex x0 = run0[n];
+		DoubleComplex t1 = LoadTwiddleScalar_DoubleComplex(twiddles1, n) * run1[n];
+		DoubleComplex t2 = LoadTwiddleScalar_DoubleComplex(twiddles2, n) * run2[n];
+		DoubleComplex t3 = LoadTwiddleScalar_DoubleComplex(twiddles3, n) * run3[n];
+
+		DoubleComplex u0 = x0 + t2;
+		DoubleComplex u1 = x0 - t2;
+		DoubleComplex u2 = t1 + t3;
+		DoubleComplex diff = t1 - t3;
+		DoubleComplex u3 = cimag(diff) - (I * creal(diff));
+
+		run0[n] = u0 + u2;
+		run1[n] = u1 + u3;
+		run2[n] = u0 - u2;
+		run3[n] = u1 - u3;
+	}
+}
+
+// Same derivation as the float version.
+SIMD_TARGET
+static void PostprocessPairs_DoubleComplex(__m256d* samples, __m256d* oppositeSamples, __m256d roots)
+{
+	__m256d rotatedRoots = _mm256_xor_pd(_mm256_permute_pd(roots, 0x5), FLIP_REAL_MASK_PD);
+	__m256d coeffsA = _mm256_sub_pd(ONES_PD, rotatedRoots);
+	__m256d coeffsB = _mm256_add_pd(ONES_PD, rotatedRoots);
+
+	__m256d halves = _mm256_set1_pd(0.5);
+	__m256d s = *samples;
+	__m256d oConj = _mm256_xor_pd(*oppositeSamples, CONJ_MASK_PD);
+
+	*samples = _mm256_mul_pd(halves, _mm256_add_pd(Multiply_DoubleComplex(s, coeffsA), Multiply_DoubleComplex(oConj, coeffsB)));
+	*oppositeSamples = _mm256_xor_pd(_mm256_mul_pd(halves, _mm256_add_pd(Multiply_DoubleComplex(oConj, coeffsA), Multiply_DoubleComplex(s, coeffsB))),
+									 CONJ_MASK_PD);
+}
+
+// Scalar version of PostprocessPairs for the kernel tails.
+ __attribute__((always_inline)) inline
+static void PostprocessPairScalar_DoubleComplex(DoubleComplex* sample, DoubleComplex* oppositeSample, DoubleComplex root)
+{
+	DoubleComplex coeffA = 1.0 - (I * root);
+	DoubleComplex coeffB = 1.0 + (I * root);
+	DoubleComplex s = *sample;
+	DoubleComplex oConj = conj(*oppositeSample);
+	*sample = 0.5 * ((s * coeffA) + (oConj * coeffB));
+	*oppositeSample = conj(0.5 * ((oConj * coeffA) + (s * coeffB)));
+}
+
+SIMD_TARGET
+void PostprocessEvenIndices_DoubleComplex(DoubleComplex* samples, DoubleComplex* oppositeSamples, const DoubleComplex* roots, char inverse,
+										  unsigned long long count)
+{
+	__m256d rootSigns = inverse ? FLIP_REAL_MASK_PD : _mm256_setzero_pd();
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_LANES <= count; n += DOUBLE_LANES)
+	{
+		long long offset = 2 * CAST(n, long long);
+		__m256d r = _mm256_xor_pd(_mm256_loadu_pd(CAST(roots + n, const double*)), rootSigns);
+		__m256d s = LoadStrided_DoubleComplex(samples + offset, 2);
+		__m256d o = LoadStrided_DoubleComplex(oppositeSamples - offset, -2);
+		PostprocessPairs_DoubleComplex(&s, &o, r);
+		StoreStrided_DoubleComplex(samples + offset, 2, s);
+		StoreStrided_DoubleComplex(oppositeSamples - offset, -2, o);
+	}
+
+	for (; n < count; n++)
+	{
+		long long offset = 2 * CAST(n, long long);
+		DoubleComplex root = inverse ? FlipReal_DoubleComplex(roots[n]) : roots[n];
+		PostprocessPairScalar_DoubleComplex(samples + offset, oppositeSamples - offset, root);
+	}
+}
+
+// Same derivation as the float version.
+SIMD_TARGET
+static __m256d UnitSqrt_DoubleComplex(__m256d roots)
+{
+	__m256d shifted = _mm256_add_pd(roots, ONES_PD);
+	__m256d squares = _mm256_mul_pd(shifted, shifted);
+	__m256d lengths = _mm256_sqrt_pd(_mm256_add_pd(squares, _mm256_permute_pd(squares, 0x5)));
+	return _mm256_div_pd(shifted, lengths);
+}
+
+SIMD_TARGET
+void PostprocessOddIndices_DoubleComplex(DoubleComplex* samples, DoubleComplex* oppositeSamples, DoubleComplex* samplesBeforeHalf,
+										 DoubleComplex* samplesAfterHalf, const DoubleComplex* roots, char inverse, unsigned long long count)
+{
+	__m256d rootSigns = inverse ? FLIP_REAL_MASK_PD : _mm256_setzero_pd();
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_LANES <= count; n += DOUBLE_LANES)
+	{
+		long long offset = 2 * CAST(n, long long);
+		__m256d r = LoadStrided_DoubleComplex(roots + offset, 2);
+
+		__m256d rootsBeforeHalf = UnitSqrt_DoubleComplex(r);
+		__m256d rootsAfterHalf = _mm256_xor_pd(_mm256_permute_pd(rootsBeforeHalf, 0x5), NEGATE_MASK_PD);
+		rootsBeforeHalf = _mm256_xor_pd(rootsBeforeHalf, rootSigns);
+		rootsAfterHalf = _mm256_xor_pd(rootsAfterHalf, rootSigns);
+
+		__m256d s = LoadStrided_DoubleComplex(samples + offset, 2);
+		__m256d o = LoadStrided_DoubleComplex(oppositeSamples - offset, -2);
+		PostprocessPairs_DoubleComplex(&s, &o, rootsBeforeHalf);
+		StoreStrided_DoubleComplex(samples + offset, 2, s);
+		StoreStrided_DoubleComplex(oppositeSamples - offset, -2, o);
+
+		s = LoadStrided_DoubleComplex(samplesBeforeHalf - offset, -2);
+		o = LoadStrided_DoubleComplex(samplesAfterHalf + offset, 2);
+		PostprocessPairs_DoubleComplex(&s, &o, rootsAfterHalf);
+		StoreStrided_DoubleComplex(samplesBeforeHalf - offset, -2, s);
+		StoreStrided_DoubleComplex(samplesAfterHalf + offset, 2, o);
+	}
+
+	for (; n < count; n++)
+	{
+		long long offset = 2 * CAST(n, long long);
+		DoubleComplex root = roots[offset];
+		DoubleComplex rootBeforeHalf = csqrt(root);
+		DoubleComplex rootAfterHalf = csqrt(FlipReal_DoubleComplex(root));
+		rootBeforeHalf = inverse ? FlipReal_DoubleComplex(rootBeforeHalf) : rootBeforeHalf;
+		rootAfterHalf = inverse ? FlipReal_DoubleComplex(rootAfterHalf) : rootAfterHalf;
+
+		PostprocessPairScalar_DoubleComplex(samples + offset, oppositeSamples - offset, rootBeforeHalf);
+		PostprocessPairScalar_DoubleComplex(samplesBeforeHalf - offset, samplesAfterHalf + offset, rootAfterHalf);
+	}
+}
+
+SIMD_TARGET
+void ConvertPcmToReal_DoubleReal(DoubleReal* dest, const unsigned char* src, unsigned long long count, int depth, int stride)
+{
+	double maxPlusHalf = CAST((1u << ((depth * CHAR_BIT) - 1)) - 1, double) + 0.5;
+	__m256d divisor = _mm256_set1_pd(maxPlusHalf);
+	__m256d half = _mm256_set1_pd(0.5);
+	__m128i offsets = _mm_mullo_epi32(_mm_set1_epi32(stride), _mm_setr_epi32(0, 1, 2, 3));
+	unsigned long long b = 0;
+
+	// Same deal as the float version: 24-bit samples make the gathers read a byte too far on the very last sample, so it stays scalar.
+	for (; b + DOUBLE_REAL_LANES + (depth == 3 ? 1 : 0) <= count; b += DOUBLE_REAL_LANES)
+	{
+		__m128i raw = _mm_i32gather_epi32(CAST(src + (b * stride), const int*), offsets, 1);
+		__m128i samples = depth == 3 ? _mm_srai_epi32(_mm_slli_epi32(raw, 8), 8) : raw;
+		_mm256_storeu_pd(dest + b, _mm256_div_pd(_mm256_add_pd(_mm256_cvtepi32_pd(samples), half), divisor));
+	}
+
+	for (; b < count; b++)
+	{
+		unsigned int raw = 0;
+		memcpy(&raw, src + (b * stride), depth);
+		int sample = depth == 3 ? CAST(raw << 8, int) >> 8 : CAST(raw, int);
+		dest[b] = (sample + 0.5) / maxPlusHalf;
+	}
+}
+
+// Same rounding caveat as the float version: ties go to even instead of away from zero, which the dither makes moot.
+SIMD_TARGET
+void ConvertRealToPcm_DoubleReal(unsigned char* dest, const DoubleReal* src, unsigned long long count, int depth, int stride)
+{
+	double maxVal = CAST(CAST((1u << ((depth * CHAR_BIT) - 1)) - 1, int), double);
+	__m256d maxVec = _mm256_set1_pd(maxVal);
+	__m256d minVec = _mm256_set1_pd(-maxVal - 1.0);
+	__m256d negHalf = _mm256_set1_pd(-0.5);
+	unsigned long long b = 0;
+
+	for (; b + DOUBLE_REAL_LANES <= count; b += DOUBLE_REAL_LANES)
+	{
+		double dither[DOUBLE_REAL_LANES];
+
+		for (int i = 0; i < DOUBLE_REAL_LANES; i++)
+		{
+			dither[i] = RandRangeDouble(-1.0, 0.0) + RandRangeDouble(0.0, 1.0);
+		}
+
+		__m256d samples = _mm256_fmadd_pd(_mm256_loadu_pd(src + b), maxVec, negHalf);
+		samples = _mm256_add_pd(samples, _mm256_loadu_pd(dither));
+		samples = _mm256_max_pd(_mm256_min_pd(samples, maxVec), minVec);
+		__m128i quantized = _mm256_cvtpd_epi32(samples);
+
+		int lanes[DOUBLE_REAL_LANES];
+		_mm_storeu_si128(CAST(lanes, __m128i*), quantized);
+
+		for (int i = 0; i < DOUBLE_REAL_LANES; i++)
+		{
+			memcpy(dest + ((b + i) * stride), &lanes[i], depth);
+		}
+	}
+
+	for (; b < count; b++)
+	{
+		double sample = (maxVal * src[b]) - 0.5;
+		sample += RandRangeDouble(-1.0, 0.0) + RandRangeDouble(0.0, 1.0);
+		sample = ClampDouble(sample, -maxVal - 1.0, maxVal);
+		int quantized = CAST(lround(sample), int);
+		memcpy(dest + (b * stride), &quantized, depth);
+	}
+}
+
+
+SIMD_TARGET
+DoubleReal ReduceMax_DoubleReal(const DoubleReal* src, unsigned long long count)
+{
+	__m256d maxes = _mm256_set1_pd(-INFINITY);
+	unsigned long long i = 0;
+
+	for (; i + DOUBLE_REAL_LANES <= count; i += DOUBLE_REAL_LANES)
+	{
+		maxes = _mm256_max_pd(maxes, _mm256_loadu_pd(src + i));
+	}
+
+	// Folding the register in half twice brings the biggest lane down to the bottom one.
+	__m128d pair = _mm_max_pd(_mm256_castpd256_pd128(maxes), _mm256_extractf128_pd(maxes, 1));
+	double max = _mm_cvtsd_f64(_mm_max_sd(pair, _mm_unpackhi_pd(pair, pair)));
+
+	for (; i < count; i++)
+	{
+		max = src[i] > max ? src[i] : max;
+	}
+
+	return max;
+}
+
+SIMD_TARGET
+DoubleReal ReduceMin_DoubleReal(const DoubleReal* src, unsigned long long count)
+{
+	__m256d mins = _mm256_set1_pd(INFINITY);
+	unsigned long long i = 0;
+
+	for (; i + DOUBLE_REAL_LANES <= count; i += DOUBLE_REAL_LANES)
+	{
+		mins = _mm256_min_pd(mins, _mm256_loadu_pd(src + i));
+	}
+
+	__m128d pair = _mm_min_pd(_mm256_castpd256_pd128(mins), _mm256_extractf128_pd(mins, 1));
+	double min = _mm_cvtsd_f64(_mm_min_sd(pair, _mm_unpackhi_pd(pair, pair)));
+
+	for (; i < count; i++)
+	{
+		min = src[i] < min ? src[i] : min;
+	}
+
+	return min;
+}
+
+SIMD_TARGET
+DoubleComplex ReduceMaxMagnitude_DoubleComplex(const DoubleComplex* src, unsigned long long count)
+{
+	__m256d bestSqrMags = _mm256_set1_pd(-INFINITY);
+	__m256d bestSamples = _mm256_setzero_pd();
+	unsigned long long i = 0;
+
+	for (; i + DOUBLE_LANES <= count; i += DOUBLE_LANES)
+	{
+		__m256d samples = _mm256_loadu_pd(CAST(src + i, const double*));
+
+		// Squaring and adding each lane to its pair partner puts every sample's squared magnitude in both of its lanes,
+		// so the comparison mask below always moves (real, imaginary) pairs around together.
+		__m256d products = _mm256_mul_pd(samples, samples);
+		__m256d sqrMags = _mm256_add_pd(products, _mm256_permute_pd(products, 0x5));
+		__m256d isBigger = _mm256_cmp_pd(sqrMags, bestSqrMags, _CMP_GT_OQ);
+		bestSqrMags = _mm256_blendv_pd(bestSqrMags, sqrMags, isBigger);
+		bestSamples = _mm256_blendv_pd(bestSamples, samples, isBigger);
+	}
+
+	DoubleComplex laneSamples[DOUBLE_LANES];
+	double laneSqrMags[DOUBLE_REAL_LANES];
+	_mm256_storeu_pd(CAST(laneSamples, double*), bestSamples);
+	_mm256_storeu_pd(laneSqrMags, bestSqrMags);
+
+	DoubleComplex max = NAN;
+	double maxSqrMag = -INFINITY;
+
+	for (int lane = 0; lane < DOUBLE_LANES; lane++)
+	{
+		if (laneSqrMags[2 * lane] > maxSqrMag)
+		{
+			max = laneSamples[lane];
+			maxSqrMag = laneSqrMags[2 * lane];
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		double sqrMag = SquareMagnitudeDoubleComplex(src[i]);
+
+		if (sqrMag > maxSqrMag)
+		{
+			max = src[i];
+			maxSqrMag = sqrMag;
+		}
+	}
+
+	return max;
+}
+
+// Same as the float one.
+ __attribute__((always_inline)) inline
+static double KernelMagnitude_DoubleComplex(DoubleComplex x)
+{
+	return sqrt((creal(x) * creal(x)) + (cimag(x) * cimag(x)));
+}
+
+SIMD_TARGET
+void Magnitudes_DoubleComplex(DoubleReal* dest, const DoubleComplex* src, long long stride, unsigned long long count)
+{
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_LANES <= count; n += DOUBLE_LANES)
+	{
+		const DoubleComplex* at = src + (CAST(n, long long) * stride);
+		__m256d samples = stride == 1 ? _mm256_loadu_pd(CAST(at, const double*)) : LoadStrided_DoubleComplex(at, stride);
+		__m256d products = _mm256_mul_pd(samples, samples);
+		__m256d mags = _mm256_sqrt_pd(_mm256_add_pd(products, _mm256_permute_pd(products, 0x5)));
+
+		// Every magnitude sits in both of its sample's lanes, so compacting the even lanes into the bottom half gives the 2 results in order.
+		_mm_storeu_pd(dest + n, _mm256_castpd256_pd128(_mm256_permute4x64_pd(mags, 0x08)));
+	}
+
+	for (; n < count; n++)
+	{
+		dest[n] = KernelMagnitude_DoubleComplex(src[CAST(n, long long) * stride]);
+	}
+}
+
+// Spreads 2 packed doubles into (real, imaginary) pair layout so they can meet 2 complex numbers lane for lane.
+SIMD_TARGET
+static __m256d LoadPaired_DoubleReal(const double* src)
+{
+	return _mm256_permute4x64_pd(_mm256_castpd128_pd256(_mm_loadu_pd(src)), 0x50);
+}
+
+// Same as the float one.
+SIMD_TARGET
+static void MagnitudeAddRun_DoubleComplex(DoubleComplex* samples, long long stride, const DoubleReal* additions, unsigned long long count)
+{
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_LANES <= count; n += DOUBLE_LANES)
+	{
+		DoubleComplex* at = samples + (CAST(n, long long) * stride);
+		__m256d vals = stride == 1 ? _mm256_loadu_pd(CAST(at, const double*)) : LoadStrided_DoubleComplex(at, stride);
+		__m256d adds = LoadPaired_DoubleReal(additions + n);
+
+		__m256d products = _mm256_mul_pd(vals, vals);
+		__m256d mags = _mm256_sqrt_pd(_mm256_add_pd(products, _mm256_permute_pd(products, 0x5)));
+		__m256d newMags = _mm256_max_pd(_mm256_add_pd(mags, adds), _mm256_setzero_pd());
+
+		__m256d scaled = _mm256_mul_pd(vals, _mm256_div_pd(newMags, mags));
+		__m256d flattened = _mm256_blend_pd(newMags, _mm256_setzero_pd(), 0xA);
+		__m256d results = _mm256_blendv_pd(scaled, flattened, _mm256_cmp_pd(mags, _mm256_setzero_pd(), _CMP_EQ_OQ));
+
+		if (stride == 1)
+		{
+			_mm256_storeu_pd(CAST(at, double*), results);
+		}
+		else
+		{
+			StoreStrided_DoubleComplex(at, stride, results);
+		}
+	}
+
+	for (; n < count; n++)
+	{
+		DoubleComplex* at = samples + (CAST(n, long long) * stride);
+		double magnitude = KernelMagnitude_DoubleComplex(*at);
+		double newMagnitude = fmax(magnitude + additions[n], 0.0);
+		*at = magnitude == 0.0 ? newMagnitude : *at * (newMagnitude / magnitude);
+	}
+}
+
+SIMD_TARGET
+void MagnitudeAdd_DoubleComplex(DoubleComplex* samples, DoubleComplex* oppositeSamples, const DoubleReal* additions, unsigned long long count)
+{
+	MagnitudeAddRun_DoubleComplex(samples, 1, additions, count);
+	MagnitudeAddRun_DoubleComplex(oppositeSamples, -1, additions, count);
+}
+
+// e^x for 4 nonpositive doubles, by the same Cody-Waite reduction as the float one but with a rational approximation for e^r,
+// because a plain polynomial would need twice the degree to reach double precision.
+SIMD_TARGET
+static __m256d Exp_DoubleReal(__m256d x)
+{
+	__m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634073599)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(6.93145751953125e-1), x);
+	r = _mm256_fnmadd_pd(k, _mm256_set1_pd(1.42860682030941723212e-6), r);
+	__m256d rSquared = _mm256_mul_pd(r, r);
+
+	// e^r = 1 + 2*r*P(r^2) / (Q(r^2) - r*P(r^2)) on [-ln(2)/2, ln(2)/2].
+	__m256d p = _mm256_set1_pd(1.26177193074810590878e-4);
+	p = _mm256_fmadd_pd(p, rSquared, _mm256_set1_pd(3.02994407707441961300e-2));
+	p = _mm256_fmadd_pd(p, rSquared, _mm256_set1_pd(9.99999999999999999910e-1));
+	p = _mm256_mul_pd(p, r);
+
+	__m256d q = _mm256_set1_pd(3.00198505138664455042e-6);
+	q = _mm256_fmadd_pd(q, rSquared, _mm256_set1_pd(2.52448340349684104192e-3));
+	q = _mm256_fmadd_pd(q, rSquared, _mm256_set1_pd(2.27265548208155028766e-1));
+	q = _mm256_fmadd_pd(q, rSquared, _mm256_set1_pd(2.00000000000000000005e0));
+	__m256d expR = _mm256_add_pd(_mm256_set1_pd(1.0), _mm256_div_pd(_mm256_add_pd(p, p), _mm256_sub_pd(q, p)));
+
+	__m256i biased = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k)), _mm256_set1_epi64x(1023));
+	__m256d scaled = _mm256_mul_pd(expR, _mm256_castsi256_pd(_mm256_slli_epi64(biased, 52)));
+	return _mm256_and_pd(scaled, _mm256_cmp_pd(x, _mm256_set1_pd(-708.0), _CMP_GT_OQ));
+}
+
+SIMD_TARGET
+void GaussianAdditions_DoubleReal(DoubleReal* dest, DoubleReal x, DoubleReal step, DoubleReal changeAmount, unsigned long long count)
+{
+	__m256d amounts = _mm256_set1_pd(changeAmount);
+	__m256d starts = _mm256_set1_pd(x);
+	__m256d steps = _mm256_set1_pd(step);
+
+	// Same index trick as the float one.
+	__m256d indices = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+	unsigned long long n = 0;
+
+	for (; n + DOUBLE_REAL_LANES <= count; n += DOUBLE_REAL_LANES)
+	{
+		__m256d xs = _mm256_fmadd_pd(steps, indices, starts);
+		__m256d exps = Exp_DoubleReal(_mm256_xor_pd(_mm256_mul_pd(xs, xs), NEGATE_MASK_PD));
+		_mm256_storeu_pd(dest + n, _mm256_mul_pd(amounts, exps));
+		indices = _mm256_add_pd(indices, _mm256_set1_pd(DOUBLE_REAL_LANES));
+	}
+
+	for (; n < count; n++)
+	{
+		double at = x + (n * step);
+		dest[n] = changeAmount * exp(-(at * at));
+	}
+}
+
+SIMD_TARGET
+void TukeyRamp_DoubleComplex(DoubleComplex* samples, DoubleComplex* oppositeSamples, DoubleReal phase, DoubleReal phaseStep,
+							 DoubleReal changeAmountMinusOne, char invert, unsigned long long count)
+{
+	double turn = DOUBLE_LANES * phaseStep;
+	__m256d turnCosines = _mm256_set1_pd(cos(turn));
+	__m256d turnSines = _mm256_set1_pd(sin(turn));
+	__m256d halves = _mm256_set1_pd(0.5);
+	__m256d amounts = _mm256_set1_pd(changeAmountMinusOne);
+	unsigned long long n = 0;
+
+	while (n + DOUBLE_LANES <= count)
+	{
+		double angle = phase + (n * phaseStep);
+		double c0 = cos(angle), c1 = cos(angle + phaseStep);
+		double s0 = sin(angle), s1 = sin(angle + phaseStep);
+		__m256d cosines = _mm256_setr_pd(c0, c0, c1, c1);
+		__m256d sines = _mm256_setr_pd(s0, s0, s1, s1);
+		unsigned long long blockEnd = n + RAMP_RESEED_LEN;
+
+		for (; n + DOUBLE_LANES <= count && n < blockEnd; n += DOUBLE_LANES)
+		{
+			__m256d multipliers = _mm256_fmadd_pd(amounts, _mm256_fnmadd_pd(halves, cosines, halves), _mm256_set1_pd(1.0));
+			__m256d s = _mm256_loadu_pd(CAST(samples + n, const double*));
+			__m256d o = LoadStrided_DoubleComplex(oppositeSamples - n, -1);
+			s = invert ? _mm256_div_pd(s, multipliers) : _mm256_mul_pd(s, multipliers);
+			o = invert ? _mm256_div_pd(o, multipliers) : _mm256_mul_pd(o, multipliers);
+			_mm256_storeu_pd(CAST(samples + n, double*), s);
+			StoreStrided_DoubleComplex(oppositeSamples - n, -1, o);
+
+			__m256d rotated = _mm256_fnmadd_pd(sines, turnSines, _mm256_mul_pd(cosines, turnCosines));
+			sines = _mm256_fmadd_pd(sines, turnCosines, _mm256_mul_pd(cosines, turnSines));
+			cosines = rotated;
+		}
+	}
+
+	for (; n < count; n++)
+	{
+		double multiplier = 1.0 + (changeAmountMinusOne * (0.5 - (0.5 * cos(phase + (n * phaseStep)))));
+		samples[n] = invert ? samples[n] / multiplier : samples[n] * multiplier;
+		oppositeSamples[-CAST(n, long long)] = invert ? oppositeSamples[-CAST(n, long long)] / multiplier :
+												oppositeSamples[-CAST(n, long long)] * multiplier;
+	}
+}
+
+#pragma endregion // Double kernels.
@@ -18,14 +18,85 @@
 #define _USE_MATH_DEFINES
 
 #include "SoundEditorInternal.h"
+#include "SimdKernels.h"
+#include "MemoryPools.h"
+#include "Instrumentation.h"
 #include "MyUtils.h"
 #include <complex.h> // For dealing with complex numbers.
 #include <math.h>	 // For min.
 #include <limits.h>	 // For CHAR_BIT.
 #include <stdio.h>	 // For fprintf.
+#include <tchar.h>	 // For dealing with the twiddle cache file's path.
+#include <share.h>	 // For shflags to _tfsopen.
 
-#define MIN_ADDITIVE_SMOOTHING 0.4
-#define MAX_ADDITIVE_SMOOTHING 0.01
+// Whether the CPU we're running on supports the vectorized kernels in SimdKernels.c. Checked once when the sound editor is initialized.
+static char simdKernelsUsable = FALSE;
+
+// How many bits of an index make up one side of a reversal tile. A tile is 2^(2*REVERSAL_BLOCK_DIGITS) samples, which comfortably fits in L1
+// even at double precision. Has to stay even so base-4 digit pairs don't get split between the tile bits and the middle bits.
+#define REVERSAL_BLOCK_DIGITS 4
+#define REVERSAL_BLOCK_LEN (1ULL << REVERSAL_BLOCK_DIGITS)
+
+// The biggest odd factor a length can have. NextMixedRadixLength only hands out lengths of the form m * 2^k with odd m in {1, 3, 5}.
+#define MAX_ODD_FACTOR 5
+
+// Builds the reversal permutation table for functions with the given log-length. For lengths too small to tile it holds the whole permutation.
+// For everything else it only covers the middle digits of the indices - the tile digits are cheap enough to reverse on the fly.
+// Returns NULL in case of failure.
+static unsigned long long* CreateReversalTable(unsigned long long logLength, char radix4)
+{
+	unsigned int digits = logLength >= 2 * REVERSAL_BLOCK_DIGITS ? logLength - (2 * REVERSAL_BLOCK_DIGITS) : logLength;
+	unsigned long long tableLen = 1ULL << digits;
+	unsigned long long* table = malloc(tableLen * sizeof(unsigned long long));
+
+	if (table == NULL)
+	{
+		return NULL;
+	}
+
+	for (unsigned long long i = 0; i < tableLen; i++)
+	{
+		table[i] = radix4 ? DigitReverse4(digits / 2, i) : BitReverse(digits, i);
+	}
+
+	return table;
+}
+
+// How many twiddle factors the angle-addition recurrence below walks before it re-anchors with an exact sincos, so rounding errors can't snowball.
+// 256 keeps the drift down to a few ulps while still amortizing the libm calls practically to nothing.
+#define TWIDDLE_ANCHOR_INTERVAL 256
+
+// Writes the path of the on-disk cache file for twiddle tables with the given length and bytes per twiddle into the given MAX_PATH-sized buffer.
+// The tables live in the temp folder, where the system is free to clean them up whenever it feels like it. Returns zero iff there was an error.
+static char TwiddleCachePath(TCHAR* path, unsigned long long length, unsigned int twiddleSize)
+{
+	TCHAR tempDir[MAX_PATH];
+
+	if (GetTempPath(MAX_PATH, tempDir) == 0)
+	{
+		fprintf(stderr, "Making a name for a twiddle cache file failed with error code %lu.\n", GetLastError());
+		return FALSE;
+	}
+
+	_stprintf_s(path, MAX_PATH, TEXT("%sfourier-twiddles-%llu-%u.bin"), tempDir, length, twiddleSize);
+	return TRUE;
+}
+
+// The smaller of two unsigned numbers. The min macro we get from windows.h isn't available here.
+ __attribute__((always_inline)) inline
+static unsigned long long MinIndex(unsigned long long a, unsigned long long b)
+{
+	return a < b ? a : b;
+}
+
+// Given a position in a segmented function and a step size (possibly negative), returns how many steps can be taken (counting the current position)
+// before crossing into another segment. The vectorized kernels work on raw pointers, so they can only be handed runs that don't cross segments.
+ __attribute__((always_inline)) inline
+static unsigned long long StridedRunLength(unsigned long long index, long long step, unsigned long long segmentLen)
+{
+	unsigned long long posInSegment = index % segmentLen;
+	return step >= 0 ? ((segmentLen - posInSegment + step - 1) / step) : ((posInSegment / (-step)) + 1);
+}
 
 #define SOUND_EDITOR_C_PRECISION_CONTENTS(precision)																									\
 /* Takes a magnitude and a phase angle and returns the complex number with these polar coordinates.*/													\
@@ -51,6 +122,96 @@ precision##Complex FlipReal_##precision##Complex(precision##Complex x)
 	return -creal_##precision##Complex(x) + I * cimag_##precision##Complex(x);																			\
 }																																						\
 																																						\
+/* A pool job which fills the twiddle factors in the range [begin, end). Instead of paying a sincos per element, each anchor gets an exact sincos*/		\
+/* and everything until the next anchor comes from the angle-addition recurrence w(k+1) = w(k) * w(1), which is just a complex multiply.*/				\
+static void GenerateTwiddleRange_##precision##Complex(void* context, unsigned long long begin, unsigned long long end)									\
+{																																						\
+	Function_##precision##Complex twiddleFactors = *CAST(context, Function_##precision##Complex*);														\
+																																						\
+	/* The table has length/4 + 1 entries, so the length it serves can be recovered from it.*/															\
+	precision##Real lengthReal = (twiddleFactors.totalLen - 1) * 4;																						\
+	precision##Complex step = RootOfUnity_##precision##Complex(1, lengthReal);																			\
+	precision##Complex twiddle = RootOfUnity_##precision##Complex(begin, lengthReal);																	\
+																																						\
+	for (unsigned long long i = begin; i < end; i++)																									\
+	{																																					\
+		if (i != begin && i % TWIDDLE_ANCHOR_INTERVAL == 0)																								\
+		{																																				\
+			twiddle = RootOfUnity_##precision##Complex(i, lengthReal);																					\
+		}																																				\
+																																						\
+		get(twiddleFactors, i) = twiddle;																												\
+		twiddle *= step;																																\
+	}																																					\
+}																																						\
+																																						\
+/* Tries to fill the twiddle table from the cache file a past session with this length and precision may have left on disk.*/							\
+/* Returns zero iff it couldn't, in which case the table has to be generated from scratch.*/															\
+static char LoadTwiddleFactors_##precision##Complex(Function_##precision##Complex twiddleFactors)														\
+{																																						\
+	TCHAR path[MAX_PATH];																																\
+																																						\
+	if (!TwiddleCachePath(path, (twiddleFactors.totalLen - 1) * 4, sizeof(precision##Complex)))									\
+	{																																					\
+		return FALSE;																																	\
+	}																																					\
+																																						\
+	/* Denying writes so a concurrent instance can't overwrite the table halfway through our read.*/													\
+	FILE* file = _tfsopen(path, TEXT("rb"), _SH_DENYWR);																								\
+																																						\
+	if (file == NULL)																																	\
+	{																																					\
+		/* Most likely this length just hasn't been cached yet.*/																						\
+		return FALSE;																																	\
+	}																																					\
+																																						\
+	char success = TRUE;																																\
+																																						\
+	for (unsigned long long s = 0; success && s < twiddleFactors.segmentCount; s++)																		\
+	{																																					\
+		unsigned long long segmentLen = MinIndex(twiddleFactors.segmentLen, twiddleFactors.totalLen - (s * twiddleFactors.segmentLen));					\
+		success = fread(twiddleFactors.samples[s], sizeof(precision##Complex), segmentLen, file) == segmentLen;											\
+	}																																					\
+																																						\
+	fclose(file);																																		\
+	return success;																																		\
+}																																						\
+																																						\
+/* Leaves the twiddle table on disk for future sessions to load. Failing to write it only costs those sessions time, so errors just clean up and move on.*/\
+static void SaveTwiddleFactors_##precision##Complex(Function_##precision##Complex twiddleFactors)														\
+{																																						\
+	TCHAR path[MAX_PATH];																																\
+																																						\
+	if (!TwiddleCachePath(path, (twiddleFactors.totalLen - 1) * 4, sizeof(precision##Complex)))									\
+	{																																					\
+		return;																																			\
+	}																																					\
+																																						\
+	/* Exclusive access so two instances initializing the same length don't interleave their writes.*/													\
+	FILE* file = _tfsopen(path, TEXT("wb"), _SH_DENYRW);																								\
+																																						\
+	if (file == NULL)																																	\
+	{																																					\
+		return;																																			\
+	}																																					\
+																																						\
+	char success = TRUE;																																\
+																																						\
+	for (unsigned long long s = 0; success && s < twiddleFactors.segmentCount; s++)																		\
+	{																																					\
+		unsigned long long segmentLen = MinIndex(twiddleFactors.segmentLen, twiddleFactors.totalLen - (s * twiddleFactors.segmentLen));					\
+		success = fwrite(twiddleFactors.samples[s], sizeof(precision##Complex), segmentLen, file) == segmentLen;										\
+	}																																					\
+																																						\
+	fclose(file);																																		\
+																																						\
+	/* A half-written table would be rejected on load anyway, but it may as well not take up disk space.*/												\
+	if (!success)																																		\
+	{																																					\
+		_tremove(path);																																	\
+	}																																					\
+}																																						\
+																																						\
 SoundEditorCache* InitializeSoundEditor_##precision##Complex(Function_##precision##Complex* f)															\
 {																																						\
 	/* At first we have to allocate a bunch of stuff.*/																									\
@@ -83,47 +244,169 @@ SoundEditorCache* InitializeSoundEditor_##precision##Complex(Function_##precisio
 	/* Now that everything is allocated, we can proceed with occupying the cache with values.*/															\
 	cache->length = length;																																\
 	cache->logLength = CountTrailingZeroes(length);																										\
-	Function_##precision##Complex twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);										\
 																																						\
-	/* Converting to real because we'll be using it that way a lot.*/																					\
-	precision##Real lengthReal = length;																												\
+	/* The odd part of the length. NextMixedRadixLength only hands out lengths whose odd part is 1, 3 or 5, and the latter two take the mixed-radix engine.*/\
+	cache->oddFactor = length >> cache->logLength;																										\
+																																						\
+	/* Lengths that are a power of 4 get the radix-4 engine, which does the same job in half the passes with fewer multiplications.*/					\
+	cache->radix4 = cache->oddFactor == 1 && cache->logLength % 2 == 0;																					\
+																																						\
+	/* The reversal permutation only depends on the length, so we build its table once here and reuse it for every transform.*/							\
+	/* For mixed-radix lengths it covers the power-of-two digits of the shuffle.*/																		\
+	if ((cache->reversalTable = CreateReversalTable(cache->logLength, cache->radix4)) == NULL)															\
+	{																																					\
+		DeallocateFunctionInternals_##precision##Complex(cache->twiddleFactors);																		\
+		free(cache->twiddleFactors);																													\
+		free(cache);																																	\
+		return NULL;																																	\
+	}																																					\
+																																						\
+	/* The mixed-radix shuffle isn't its own inverse the way bit reversal is, so it follows cycles instead, with a visited bit per sample.*/			\
+	cache->visitedFlags = cache->oddFactor > 1 ? malloc(DivCeilInt(length, CHAR_BIT)) : NULL;															\
+																																						\
+	if (cache->oddFactor > 1 && cache->visitedFlags == NULL)																							\
+	{																																					\
+		free(cache->reversalTable);																														\
+		DeallocateFunctionInternals_##precision##Complex(cache->twiddleFactors);																		\
+		free(cache->twiddleFactors);																													\
+		free(cache);																																	\
+		return NULL;																																	\
+	}																																					\
+																																						\
+	/* Channels transform concurrently on save, and the shuffle's scratch bitmap is shared between them, so walks of it take this lock.*/				\
+	InitializeCriticalSection(&(cache->visitedLock));																									\
+																																						\
+	/* Huge power-of-two lengths also get a GPU plan when a usable device is around. NULL is the common case and just means the CPU engines do all the work.*/\
+	cache->gpu = CreateGpuFourierContext(length, f->funcType);																							\
 																																						\
-	get(twiddleFactors, 0) = 1.0;																														\
-	get(twiddleFactors, quarterLength) = -I;																											\
+	/* Spinning up a worker per logical processor. If this fails we just run everything serially, so no need to check for errors.*/						\
+	cache->threadPool = CreateThreadPool(0);																											\
+	Function_##precision##Complex twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);										\
 																																						\
-	for (unsigned long long i = 1; i < quarterLength; i++)																								\
+	/* Twiddle tables only depend on the length and precision, so odds are a past session already computed this very table and left it on disk.*/		\
+	if (!LoadTwiddleFactors_##precision##Complex(twiddleFactors))																						\
 	{																																					\
-		get(twiddleFactors, i) = RootOfUnity_##precision##Complex(i, lengthReal);																		\
+		get(twiddleFactors, 0) = 1.0;																													\
+		get(twiddleFactors, quarterLength) = -I;																										\
+		ParallelFor(cache->threadPool, GenerateTwiddleRange_##precision##Complex, cache->twiddleFactors, 1, quarterLength);								\
+																																						\
+		/* Leaving the table behind for the next session with this length.*/																			\
+		SaveTwiddleFactors_##precision##Complex(twiddleFactors);																						\
 	}																																					\
 																																						\
 	return cache;																																		\
 }																																						\
 																																						\
-void BitReverseArr_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)														\
+/* Applies the reversal permutation precomputed in the cache (bit reversal for the radix-2 engine, base-4 digit reversal for the radix-4 one)*/			\
+/* to the array. Works tile by tile: a tile's worth of samples is gathered into a buffer that fits in L1, reversed there, and written back*/			\
+/* out in contiguous rows, instead of bouncing single elements between distant cache lines on both ends like the naive swap loop does.*/				\
+static void ReverseArrBlocked_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)											\
 {																																						\
 	unsigned long long len = cache->length;																												\
-	unsigned int digits = cache->logLength;																												\
+	unsigned long long logLen = cache->logLength;																										\
+	unsigned long long* table = cache->reversalTable;																									\
 																																						\
-	for (unsigned long long i = 0; i < len; i++)																										\
+	/* Lengths too small to tile just walk the precomputed permutation directly.*/																		\
+	if (logLen < 2 * REVERSAL_BLOCK_DIGITS)																												\
 	{																																					\
-		unsigned long long reversed = BitReverse(digits, i);																							\
+		for (unsigned long long i = 0; i < len; i++)																									\
+		{																																				\
+			unsigned long long reversed = table[i];																										\
+																																						\
+			/* Avoiding reversing the same thing twice.*/																								\
+			if (reversed > i)																															\
+			{																																			\
+				precision##Complex temp = get(f, i);																									\
+				get(f, i) = get(f, reversed);																											\
+				get(f, reversed) = temp;																												\
+			}																																			\
+		}																																				\
+																																						\
+		return;																																			\
+	}																																					\
+																																						\
+	/* An index splits into (hi, mid, lo) with REVERSAL_BLOCK_DIGITS bits on each end. Reversal maps (hi, mid, lo) to*/									\
+	/* (reverse(lo), table[mid], reverse(hi)), so for a fixed mid the elements form a tile that lands in the tile of table[mid] whole,*/				\
+	/* with the roles of hi and lo swapped. The tiny tile-digit reversals are cheap enough to tabulate on the stack every call.*/						\
+	unsigned int midDigits = logLen - (2 * REVERSAL_BLOCK_DIGITS);																						\
+	unsigned long long midCount = 1ULL << midDigits;																									\
+	unsigned int blockReverse[REVERSAL_BLOCK_LEN];																										\
 																																						\
-		/* Avoiding reversing the same thing twice.*/																									\
-		if (reversed > i)																																\
+	for (unsigned int i = 0; i < REVERSAL_BLOCK_LEN; i++)																								\
+	{																																					\
+		blockReverse[i] = cache->radix4 ? DigitReverse4(REVERSAL_BLOCK_DIGITS / 2, i) : BitReverse(REVERSAL_BLOCK_DIGITS, i);							\
+	}																																					\
+																																						\
+	precision##Complex bufA[REVERSAL_BLOCK_LEN * REVERSAL_BLOCK_LEN], bufB[REVERSAL_BLOCK_LEN * REVERSAL_BLOCK_LEN];									\
+																																						\
+	for (unsigned long long mid = 0; mid < midCount; mid++)																								\
+	{																																					\
+		unsigned long long reversedMid = table[mid];																									\
+																																						\
+		/* Avoiding exchanging the same pair of tiles twice.*/																							\
+		if (reversedMid < mid)																															\
 		{																																				\
-			precision##Complex temp = get(f, i);																										\
-			get(f, i) = get(f, reversed);																												\
-			get(f, reversed) = temp;																													\
+			continue;																																	\
+		}																																				\
+																																						\
+		unsigned long long base = mid << REVERSAL_BLOCK_DIGITS;																							\
+		unsigned long long reversedBase = reversedMid << REVERSAL_BLOCK_DIGITS;																			\
+																																						\
+		/* Gathering the tile with the tile-level reversal already applied, reading row by contiguous row.*/											\
+		for (unsigned long long hi = 0; hi < REVERSAL_BLOCK_LEN; hi++)																					\
+		{																																				\
+			for (unsigned long long lo = 0; lo < REVERSAL_BLOCK_LEN; lo++)																				\
+			{																																			\
+				bufA[(blockReverse[lo] << REVERSAL_BLOCK_DIGITS) | blockReverse[hi]] = get(f, (hi << (logLen - REVERSAL_BLOCK_DIGITS)) | base | lo);	\
+			}																																			\
+		}																																				\
+																																						\
+		/* A tile on the permutation's diagonal maps onto itself, so the gathered buffer goes right back where it came from.*/							\
+		if (reversedMid == mid)																															\
+		{																																				\
+			for (unsigned long long hi = 0; hi < REVERSAL_BLOCK_LEN; hi++)																				\
+			{																																			\
+				for (unsigned long long lo = 0; lo < REVERSAL_BLOCK_LEN; lo++)																			\
+				{																																		\
+					get(f, (hi << (logLen - REVERSAL_BLOCK_DIGITS)) | base | lo) = bufA[(hi << REVERSAL_BLOCK_DIGITS) | lo];							\
+				}																																		\
+			}																																			\
+																																						\
+			continue;																																	\
+		}																																				\
+																																						\
+		for (unsigned long long hi = 0; hi < REVERSAL_BLOCK_LEN; hi++)																					\
+		{																																				\
+			for (unsigned long long lo = 0; lo < REVERSAL_BLOCK_LEN; lo++)																				\
+			{																																			\
+				bufB[(blockReverse[lo] << REVERSAL_BLOCK_DIGITS) | blockReverse[hi]] =																	\
+					get(f, (hi << (logLen - REVERSAL_BLOCK_DIGITS)) | reversedBase | lo);																\
+			}																																			\
+		}																																				\
+																																						\
+		/* Each buffer holds the other tile's new contents, written row by contiguous row.*/															\
+		for (unsigned long long hi = 0; hi < REVERSAL_BLOCK_LEN; hi++)																					\
+		{																																				\
+			for (unsigned long long lo = 0; lo < REVERSAL_BLOCK_LEN; lo++)																				\
+			{																																			\
+				get(f, (hi << (logLen - REVERSAL_BLOCK_DIGITS)) | reversedBase | lo) = bufA[(hi << REVERSAL_BLOCK_DIGITS) | lo];						\
+				get(f, (hi << (logLen - REVERSAL_BLOCK_DIGITS)) | base | lo) = bufB[(hi << REVERSAL_BLOCK_DIGITS) | lo];								\
+			}																																			\
 		}																																				\
 	}																																					\
 }																																						\
 																																						\
+void BitReverseArr_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)														\
+{																																						\
+	ReverseArrBlocked_##precision##Complex(f, cache);																									\
+}																																						\
+																																						\
 /* This is an auxiliary function of RealInterleavedFFT. It calculates the postprocessing step for it.*/													\
 /* 'sample' is the k'th sample in the function, 'oppositeSample' is the N-k'th sample 'root' is the k/N'th root of unity.*/								\
  __attribute__((always_inline)) inline																													\
 precision##Complex ForwardPostprocess_##precision##Complex(precision##Complex sample, precision##Complex oppositeSample, precision##Complex root)		\
 {																																						\
-	precision##Complex val = I * root;																													\
+	precision##Complex val = I * root;																																\
 	precision##Complex coeffA = CAST(1.0, precision##Complex) - val;																					\
 	precision##Complex coeffB = CAST(1.0, precision##Complex) + val;																					\
 	return CAST(0.5, precision##Complex) * ((sample * coeffA) + (conj_##precision##Complex(oppositeSample) * coeffB));									\
@@ -143,6 +426,49 @@ void ForwardPostprocessSymmetric_##precision##Complex(precision##Complex* sample
 	*oppositeSample = ForwardPostprocess_##precision##Complex(oppositeSampleVal, sampleVal, oppositeRoot); 												\
 }																																						\
 																																						\
+/* Walks the odd-index pre/postprocessing loop of the real interleaved FFT in segment-contiguous runs and hands them to the vectorized kernel.*/		\
+static void PostprocessOddRange_##precision##Complex(Function_##precision##Complex f, Function_##precision##Complex twiddleFactors,						\
+													 unsigned long long len, char inverse)																\
+{																																						\
+	unsigned long long halfLen = len / 2;																												\
+	unsigned long long quarterLen = len / 4;																											\
+	unsigned long long k = 1;																															\
+																																						\
+	while (k <= quarterLen)																																\
+	{																																					\
+		/* Taking the biggest run of iterations that doesn't make any of the five streams we touch cross a segment boundary.*/							\
+		unsigned long long count = ((quarterLen - k) / 2) + 1;																							\
+		count = MinIndex(count, StridedRunLength(k, 2, f.segmentLen));																					\
+		count = MinIndex(count, StridedRunLength(len - k, -2, f.segmentLen));																			\
+		count = MinIndex(count, StridedRunLength(halfLen - k, -2, f.segmentLen));																		\
+		count = MinIndex(count, StridedRunLength(halfLen + k, 2, f.segmentLen));																		\
+		count = MinIndex(count, StridedRunLength(k, 2, twiddleFactors.segmentLen));																		\
+																																						\
+		PostprocessOddIndices_##precision##Complex(&get(f, k), &get(f, len - k), &get(f, halfLen - k), &get(f, halfLen + k),							\
+												   &get(twiddleFactors, k), inverse, count);															\
+		k += 2 * count;																																	\
+	}																																					\
+}																																						\
+																																						\
+/* Same as the above, for the even-index loop.*/																										\
+static void PostprocessEvenRange_##precision##Complex(Function_##precision##Complex f, Function_##precision##Complex twiddleFactors,					\
+													  unsigned long long len, char inverse)															\
+{																																						\
+	unsigned long long halfLen = len / 2;																												\
+	unsigned long long k = 2;																															\
+																																						\
+	while (k < halfLen)																																	\
+	{																																					\
+		unsigned long long count = (halfLen - k) / 2;																									\
+		count = MinIndex(count, StridedRunLength(k, 2, f.segmentLen));																					\
+		count = MinIndex(count, StridedRunLength(len - k, -2, f.segmentLen));																			\
+		count = MinIndex(count, StridedRunLength(k / 2, 1, twiddleFactors.segmentLen));																	\
+																																						\
+		PostprocessEvenIndices_##precision##Complex(&get(f, k), &get(f, len - k), &get(twiddleFactors, k / 2), inverse, count);							\
+		k += 2 * count;																																	\
+	}																																					\
+}																																						\
+																																						\
 void RealInterleavedFFT_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)													\
 {																																						\
 	unsigned long long len = cache->length;																												\
@@ -163,26 +489,35 @@ void RealInterleavedFFT_##precision##Complex(Function_##precision##Complex f, So
 	/* We iterate over half the samples and postprocess 2 samples in each go because each k'th sample shares computations with the len-k'th one.*/		\
 	/* This computation uses RootOfUnity(k, 2*len) for each 1<=k<=2*len. But our cache only contains RootOfUnity(k, len) for each 1<=k<=len/2.*/		\
 	/* We do a bunch of stuff to overcome this that will be explained later. The first is that we split iteration for even and odd indices.*/			\
-	for (unsigned long long k = 1; k <= quarterLen; k += 2)																								\
+	/* When the CPU supports them, the vectorized kernels do the same split with the same math, several samples at a time.*/							\
+	if (simdKernelsUsable)																																\
 	{																																					\
-		precision##Complex root = get(twiddleFactors, k);																								\
+		PostprocessOddRange_##precision##Complex(f, twiddleFactors, len, FALSE);																		\
+		PostprocessEvenRange_##precision##Complex(f, twiddleFactors, len, FALSE);																		\
+	}																																					\
+	else																																				\
+	{																																					\
+		for (unsigned long long k = 1; k <= quarterLen; k += 2)																							\
+		{																																				\
+			precision##Complex root = get(twiddleFactors, k);																							\
 																																						\
-		/* Note that this loop only runs for odd 1<=k<=quarterLen values. We cover the indices k and halfLen-k in each iteration.*/						\
-		/* This first root is for the index k. RootOfUnity(k, 2*len)=sqrt(RootOfUnity(k, len)).*/														\
-		precision##Complex rootBeforeHalf = sqrt_##precision##Complex(root);																			\
+			/* Note that this loop only runs for odd 1<=k<=quarterLen values. We cover the indices k and halfLen-k in each iteration.*/					\
+			/* This first root is for the index k. RootOfUnity(k, 2*len)=sqrt(RootOfUnity(k, len)).*/													\
+			precision##Complex rootBeforeHalf = sqrt_##precision##Complex(root);																		\
 																																						\
-		/* This second root is for the index halfLen-k. RootOfUnity(halfLen-k, 2*len)=sqrt(FlipReal(RootOfUnity(k, len))).*/							\
-		precision##Complex rootAfterHalf = sqrt_##precision##Complex(FlipReal_##precision##Complex(root));												\
+			/* This second root is for the index halfLen-k. RootOfUnity(halfLen-k, 2*len)=sqrt(FlipReal(RootOfUnity(k, len))).*/						\
+			precision##Complex rootAfterHalf = sqrt_##precision##Complex(FlipReal_##precision##Complex(root));											\
 																																						\
-		ForwardPostprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), rootBeforeHalf);													\
-		ForwardPostprocessSymmetric_##precision##Complex(&get(f, halfLen - k), &get(f, halfLen + k), rootAfterHalf);									\
-	}																																					\
+			ForwardPostprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), rootBeforeHalf);												\
+			ForwardPostprocessSymmetric_##precision##Complex(&get(f, halfLen - k), &get(f, halfLen + k), rootAfterHalf);								\
+		}																																				\
 																																						\
-	for (unsigned long long k = 2; k < halfLen; k += 2)																									\
-	{																																					\
-		/* For even indices, RootOfUnity(k, 2*len)=RootOfUnity(k/2, len), which we have cached.*/														\
-		precision##Complex root	= get(twiddleFactors, k / 2);																							\
-		ForwardPostprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), root);															\
+		for (unsigned long long k = 2; k < halfLen; k += 2)																								\
+		{																																				\
+			/* For even indices, RootOfUnity(k, 2*len)=RootOfUnity(k/2, len), which we have cached.*/													\
+			precision##Complex root	= get(twiddleFactors, k / 2);																						\
+			ForwardPostprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), root);														\
+		}																																				\
 	}																																					\
 }																																						\
 																																						\
@@ -191,7 +526,7 @@ void RealInterleavedFFT_##precision##Complex(Function_##precision##Complex f, So
  __attribute__((always_inline)) inline																													\
 precision##Complex BackwardPreprocess_##precision##Complex(precision##Complex sample, precision##Complex oppositeSample, precision##Complex root)		\
 {																																						\
-	precision##Complex val = I * root;																													\
+	precision##Complex val = I * root;																																\
 	precision##Complex coeffA = conj_##precision##Complex(CAST(1.0, precision##Complex) - val);															\
 	precision##Complex coeffB = conj_##precision##Complex(CAST(1.0, precision##Complex) + val);															\
 	return CAST(0.5, precision##Complex) * ((sample * coeffA) + (conj_##precision##Complex(oppositeSample) * coeffB));									\
@@ -225,101 +560,710 @@ void InverseRealInterleavedFFT_##precision##Complex(Function_##precision##Comple
 	/* The math is from the same document as the one I used for the forward transform.*/																\
 	get(f, 0) = BackwardPreprocess_##precision##Complex(get(f, 0), get(f, 0), 1.0);  																	\
 																																						\
-	for (unsigned long long k = 1; k <= quarterLen; k += 2)																								\
+	/* The kernels reuse the forward postprocessing code for this, because preprocessing is just postprocessing with every root real-flipped.*/			\
+	if (simdKernelsUsable)																																\
+	{																																					\
+		PostprocessOddRange_##precision##Complex(f, twiddleFactors, len, TRUE);																			\
+		PostprocessEvenRange_##precision##Complex(f, twiddleFactors, len, TRUE);																		\
+	}																																					\
+	else																																				\
+	{																																					\
+		for (unsigned long long k = 1; k <= quarterLen; k += 2)																							\
+		{																																				\
+			precision##Complex root = get(twiddleFactors, k);																							\
+			precision##Complex rootBeforeHalf = sqrt_##precision##Complex(root);																		\
+			precision##Complex rootAfterHalf = sqrt_##precision##Complex(FlipReal_##precision##Complex(root));											\
+																																						\
+			BackwardPreprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), rootBeforeHalf);												\
+			BackwardPreprocessSymmetric_##precision##Complex(&get(f, halfLen - k), &get(f, halfLen + k), rootAfterHalf);								\
+		}																																				\
+																																						\
+		for (unsigned long long k = 2; k < halfLen; k += 2)																								\
+		{																																				\
+			precision##Complex root	= get(twiddleFactors, k / 2);																						\
+			BackwardPreprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), root);														\
+		}																																				\
+	}																																					\
+																																						\
+	/* Now applying inverse FFT. The result will be the original interleaved sequence of even and odd reals (with changes we've applied).*/				\
+	InverseFFT_##precision##Complex(f, cache);																											\
+}																																						\
+																																						\
+/* Everything one level of the FFT needs to know in order to compute its butterflies. Passed to the level jobs as their context.*/						\
+typedef struct																																			\
+{																																						\
+	Function_##precision##Complex f;																													\
+	Function_##precision##Complex twiddleFactors;																										\
+	unsigned long long len;																																\
+	unsigned long long halfLen;																															\
+	unsigned long long stride;																															\
+	unsigned long long halfStride;																														\
+	unsigned long long quarterStride;																													\
+	unsigned long long lenDivStride;																													\
+} FFTLevelContext_##precision##Complex;																													\
+																																						\
+/* Computes the twiddle factor RootOfUnity(k, stride) for the level described by the context.*/															\
+/* We want RootOfUnity(k, stride), for 0<=k<halfStride, but our cache is for RootOfUnity(k, len) for 0<=k<=len/4.*/										\
+/* First we use the equation RootOfUnity(k, stride) = RootOfUnity(k*lenDivStride, N) to cover the cases 0<=k<=quarterStride.*/							\
+/* If k > quarterStride, we use the fact that RootOfUnity(k, N) = FlipReal(RootOfUnity((N/2) - k, N)). Boom. Math.*/									\
+ __attribute__((always_inline)) inline																													\
+precision##Complex FFTLevelTwiddle_##precision##Complex(FFTLevelContext_##precision##Complex* level, unsigned long long k)								\
+{																																						\
+	return k <= level->quarterStride ?																													\
+		   get(level->twiddleFactors, (k * level->lenDivStride)) :																						\
+		   FlipReal_##precision##Complex(get(level->twiddleFactors, level->halfLen - (k * level->lenDivStride)));										\
+}																																						\
+																																						\
+/* Computes one butterfly. i is the base of the tree it belongs to, k is its index within the tree.*/													\
+ __attribute__((always_inline)) inline																													\
+void FFTButterfly_##precision##Complex(Function_##precision##Complex f, unsigned long long i, unsigned long long k,										\
+									   unsigned long long halfStride, precision##Complex factor)														\
+{																																						\
+	precision##Complex evenSum = get(f, i + k);																											\
+	precision##Complex oddSum = factor * get(f, i + k + halfStride);										 											\
+	get(f, i + k) = evenSum + oddSum;																													\
+	get(f, i + k + halfStride) = evenSum - oddSum;																										\
+}																																						\
+																																						\
+/* Computes the butterflies with indices [kBegin, kEnd) in the tree based at i through the vectorized kernel, in segment-contiguous runs.*/				\
+/* All the butterflies in the range must take their twiddle factors from the same branch of FFTLevelTwiddle - 'flip' says which one.*/					\
+static void ButterflyRange_##precision##Complex(FFTLevelContext_##precision##Complex* level, unsigned long long i, unsigned long long kBegin,			\
+												unsigned long long kEnd, char flip)																		\
+{																																						\
+	Function_##precision##Complex f = level->f;																											\
+	Function_##precision##Complex twiddleFactors = level->twiddleFactors;																				\
+	unsigned long long lenDivStride = level->lenDivStride;																								\
+																																						\
+	while (kBegin < kEnd)																																\
+	{																																					\
+		unsigned long long evenIndex = i + kBegin;																										\
+		unsigned long long oddIndex = evenIndex + level->halfStride;																					\
+		unsigned long long twiddleIndex = flip ? level->halfLen - (kBegin * lenDivStride) : kBegin * lenDivStride;										\
+		long long twiddleStep = flip ? -CAST(lenDivStride, long long) : CAST(lenDivStride, long long);													\
+																																						\
+		/* Taking the biggest run of butterflies that doesn't make any of the three streams we touch cross a segment boundary.*/						\
+		unsigned long long count = kEnd - kBegin;																										\
+		count = MinIndex(count, StridedRunLength(evenIndex, 1, f.segmentLen));																			\
+		count = MinIndex(count, StridedRunLength(oddIndex, 1, f.segmentLen));																			\
+		count = MinIndex(count, StridedRunLength(twiddleIndex, twiddleStep, twiddleFactors.segmentLen));												\
+																																						\
+		FFTButterflies_##precision##Complex(&get(f, evenIndex), &get(f, oddIndex), &get(twiddleFactors, twiddleIndex), twiddleStep, flip, count);		\
+		kBegin += count;																																\
+	}																																					\
+}																																						\
+																																						\
+/* A pool job which computes the butterflies of the trees [treeBegin, treeEnd) in one level. Used for the lower levels, where trees are plentiful.*/	\
+static void FFTLevelByTree_##precision##Complex(void* context, unsigned long long treeBegin, unsigned long long treeEnd)								\
+{																																						\
+	FFTLevelContext_##precision##Complex* level = context;																								\
+	Function_##precision##Complex f = level->f;																											\
+	unsigned long long halfStride = level->halfStride;																									\
+	unsigned long long quarterStride = level->quarterStride;																							\
+																																						\
+	for (unsigned long long tree = treeBegin; tree < treeEnd; tree++)																					\
+	{																																					\
+		/* i serves as a sort of "base" for the current tree. i + k is the k'th element in the (i / stride)'th tree of this level.*/					\
+		unsigned long long i = tree * level->stride;																									\
+																																						\
+		if (simdKernelsUsable)																															\
+		{																																				\
+			/* The k range is split where the twiddle factor lookup switches formulas, so each piece can go through a single kernel call.*/				\
+			ButterflyRange_##precision##Complex(level, i, 0, MinIndex(quarterStride + 1, halfStride), FALSE);											\
+			ButterflyRange_##precision##Complex(level, i, quarterStride + 1, halfStride, TRUE);															\
+		}																																				\
+		else																																			\
+		{																																				\
+			for (unsigned long long k = 0; k < halfStride; k++)																							\
+			{																																			\
+				FFTButterfly_##precision##Complex(f, i, k, halfStride, FFTLevelTwiddle_##precision##Complex(level, k));									\
+			}																																			\
+		}																																				\
+	}																																					\
+}																																						\
+																																						\
+/* A pool job which computes the butterflies with indices [kBegin, kEnd) across every tree in one level. Used for the upper levels, where trees*/		\
+/* are few but long. Iterating with k on the outside lets us compute each twiddle factor once for all the trees it applies to.*/						\
+static void FFTLevelByIndex_##precision##Complex(void* context, unsigned long long kBegin, unsigned long long kEnd)										\
+{																																						\
+	FFTLevelContext_##precision##Complex* level = context;																								\
+	Function_##precision##Complex f = level->f;																											\
+	unsigned long long len = level->len;																												\
+	unsigned long long stride = level->stride;																											\
+	unsigned long long halfStride = level->halfStride;																									\
+																																						\
+	if (simdKernelsUsable)																																\
+	{																																					\
+		/* The k range is split where the twiddle factor lookup switches formulas, so each piece can go through a single kernel call.*/					\
+		unsigned long long directEnd = MinIndex(kEnd, level->quarterStride + 1);																		\
+		unsigned long long flipBegin = kBegin > directEnd ? kBegin : directEnd;																			\
+																																						\
+		for (unsigned long long i = 0; i < len; i += stride)																							\
+		{																																				\
+			ButterflyRange_##precision##Complex(level, i, kBegin, directEnd, FALSE);																	\
+			ButterflyRange_##precision##Complex(level, i, flipBegin, kEnd, TRUE);																		\
+		}																																				\
+																																						\
+		return;																																			\
+	}																																					\
+																																						\
+	for (unsigned long long k = kBegin; k < kEnd; k++)																									\
+	{																																					\
+		precision##Complex factor = FFTLevelTwiddle_##precision##Complex(level, k);																		\
+																																						\
+		/* Each iteration of this loop moves to the next tree in the current level.*/																	\
+		for (unsigned long long i = 0; i < len; i += stride)																							\
+		{																																				\
+			FFTButterfly_##precision##Complex(f, i, k, halfStride, factor);																				\
+		}																																				\
+	}																																					\
+}																																						\
+																																						\
+/* Like BitReverseArr, but swaps each element with its base-4 digit reverse. Assumes the function length is a power of four.*/							\
+static void DigitReverseArr4_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)												\
+{																																						\
+	ReverseArrBlocked_##precision##Complex(f, cache);																									\
+}																																						\
+																																						\
+/* Looks up RootOfUnity(e, len) in the cache for any exponent 0 <= e < 3*len/4, which is the range the radix-4 butterflies need.*/						\
+/* The table only goes up to len/4, so the rest is covered by RootOfUnity((N/2) - e, N) = FlipReal(RootOfUnity(e, N)) for the second quarter*/			\
+/* of the circle, and RootOfUnity((N/2) + e, N) = -RootOfUnity(e, N) = conj(FlipReal(RootOfUnity(e, N))) for everything past the half.*/				\
+ __attribute__((always_inline)) inline																													\
+precision##Complex RootAtExponent_##precision##Complex(Function_##precision##Complex twiddleFactors, unsigned long long e,								\
+													   unsigned long long halfLen, unsigned long long quarterLen)										\
+{																																						\
+	if (e <= quarterLen)																																\
+	{																																					\
+		return get(twiddleFactors, e);																													\
+	}																																					\
+																																						\
+	if (e <= halfLen)																																	\
+	{																																					\
+		return FlipReal_##precision##Complex(get(twiddleFactors, halfLen - e));																			\
+	}																																					\
+																																						\
+	return conj_##precision##Complex(FlipReal_##precision##Complex(get(twiddleFactors, e - halfLen)));													\
+}																																						\
+																																						\
+/* Like RootAtExponent, but covers the whole circle, which the mixed-radix leaf pass and the sparse synthesis need. The last quarter is*/				\
+/* covered by RootOfUnity(N - e, N) = conj(RootOfUnity(e, N)).*/																						\
+ __attribute__((always_inline)) inline																													\
+precision##Complex RootAtAnyExponent_##precision##Complex(Function_##precision##Complex twiddleFactors, unsigned long long e,							\
+														  unsigned long long len, unsigned long long halfLen, unsigned long long quarterLen)			\
+{																																						\
+	if (e <= halfLen + quarterLen)																														\
+	{																																					\
+		return RootAtExponent_##precision##Complex(twiddleFactors, e, halfLen, quarterLen);																\
+	}																																					\
+																																						\
+	return conj_##precision##Complex(get(twiddleFactors, len - e));																						\
+}																																						\
+																																						\
+/* Computes one radix-4 butterfly. i is the base of the tree it belongs to, k is its index within the tree. Does the work of four radix-2*/				\
+/* butterflies across two levels with only three twiddle multiplications.*/																				\
+ __attribute__((always_inline)) inline																													\
+void FFTButterfly4_##precision##Complex(Function_##precision##Complex f, unsigned long long i, unsigned long long k,									\
+										unsigned long long quarterStride, precision##Complex w1, precision##Complex w2, precision##Complex w3)			\
+{																																						\
+	precision##Complex x0 = get(f, i + k);																												\
+	precision##Complex t1 = w1 * get(f, i + k + quarterStride);																							\
+	precision##Complex t2 = w2 * get(f, i + k + (2 * quarterStride));																					\
+	precision##Complex t3 = w3 * get(f, i + k + (3 * quarterStride));																					\
+																																						\
+	/* Two radix-2 combines of the half-sums, where the odd half of the second pair gets rotated by -i before combining.*/								\
+	precision##Complex u0 = x0 + t2;																													\
+	precision##Complex u1 = x0 - t2;																													\
+	precision##Complex u2 = t1 + t3;																													\
+	precision##Complex diff = t1 - t3;																													\
+	precision##Complex u3 = cimag_##precision##Complex(diff) - (I * creal_##precision##Complex(diff));													\
+																																						\
+	get(f, i + k) = u0 + u2;																															\
+	get(f, i + k + quarterStride) = u1 + u3;																											\
+	get(f, i + k + (2 * quarterStride)) = u0 - u2;																										\
+	get(f, i + k + (3 * quarterStride)) = u1 - u3;																										\
+}																																						\
+																																						\
+/* Computes the radix-4 butterflies with indices [kBegin, kEnd) in the tree based at i through the vectorized kernel, in runs that are*/				\
+/* segment-contiguous and that keep each of the three twiddle factor lookups on a single one of the formulas from RootAtExponent.*/						\
+static void ButterflyRange4_##precision##Complex(FFTLevelContext_##precision##Complex* level, unsigned long long i, unsigned long long kBegin,			\
+												 unsigned long long kEnd)																				\
+{																																						\
+	Function_##precision##Complex f = level->f;																											\
+	Function_##precision##Complex twiddleFactors = level->twiddleFactors;																				\
+	unsigned long long lenDivStride = level->lenDivStride;																								\
+	unsigned long long quarterStride = level->quarterStride;																							\
+	unsigned long long halfLen = level->halfLen;																										\
+	unsigned long long quarterLen = halfLen / 2;																										\
+																																						\
+	/* The first k (inclusive) from which each lookup is on its next formula. The first stream's exponents never leave the table.*/						\
+	unsigned long long flip2From = (quarterLen / (2 * lenDivStride)) + 1;																				\
+	unsigned long long flip3From = (quarterLen / (3 * lenDivStride)) + 1;																				\
+	unsigned long long conj3From = (halfLen / (3 * lenDivStride)) + 1;																					\
+																																						\
+	while (kBegin < kEnd)																																\
+	{																																					\
+		char flip2 = kBegin >= flip2From;																												\
+		char flip3 = kBegin >= flip3From;																												\
+		char conj3 = kBegin >= conj3From;																												\
+																																						\
+		/* Building the three twiddle streams according to which formula each one is on. Note that conj implies flip - the combination*/				\
+		/* negates both parts, because the kernel composes the two sign masks.*/																		\
+		TwiddleStream_##precision##Complex twiddles1, twiddles2, twiddles3;																				\
+		unsigned long long index1 = kBegin * lenDivStride;																								\
+		unsigned long long index2 = flip2 ? halfLen - (2 * kBegin * lenDivStride) : 2 * kBegin * lenDivStride;											\
+		unsigned long long index3 = conj3 ? (3 * kBegin * lenDivStride) - halfLen :																		\
+							(flip3 ? halfLen - (3 * kBegin * lenDivStride) : 3 * kBegin * lenDivStride);												\
+																																						\
+		twiddles1.stride = CAST(lenDivStride, long long);																								\
+		twiddles1.flipReal = FALSE;																														\
+		twiddles1.conjugate = FALSE;																													\
+																																						\
+		twiddles2.stride = flip2 ? -CAST(2 * lenDivStride, long long) : CAST(2 * lenDivStride, long long);												\
+		twiddles2.flipReal = flip2;																														\
+		twiddles2.conjugate = FALSE;																													\
+																																						\
+		twiddles3.stride = flip3 && !conj3 ? -CAST(3 * lenDivStride, long long) : CAST(3 * lenDivStride, long long);									\
+		twiddles3.flipReal = flip3;																														\
+		twiddles3.conjugate = conj3;																													\
+																																						\
+		/* Ending this run at the nearest formula switch still ahead of us.*/																			\
+		unsigned long long count = kEnd - kBegin;																										\
+		count = !flip2 ? MinIndex(count, flip2From - kBegin) : count;																					\
+		count = !flip3 ? MinIndex(count, flip3From - kBegin) : count;																					\
+		count = !conj3 ? MinIndex(count, conj3From - kBegin) : count;																					\
+																																						\
+		/* And clamping it so that none of the seven streams we touch crosses a segment boundary.*/														\
+		count = MinIndex(count, StridedRunLength(i + kBegin, 1, f.segmentLen));																			\
+		count = MinIndex(count, StridedRunLength(i + kBegin + quarterStride, 1, f.segmentLen));															\
+		count = MinIndex(count, StridedRunLength(i + kBegin + (2 * quarterStride), 1, f.segmentLen));													\
+		count = MinIndex(count, StridedRunLength(i + kBegin + (3 * quarterStride), 1, f.segmentLen));													\
+		count = MinIndex(count, StridedRunLength(index1, twiddles1.stride, twiddleFactors.segmentLen));													\
+		count = MinIndex(count, StridedRunLength(index2, twiddles2.stride, twiddleFactors.segmentLen));													\
+		count = MinIndex(count, StridedRunLength(index3, twiddles3.stride, twiddleFactors.segmentLen));													\
+																																						\
+		twiddles1.base = &get(twiddleFactors, index1);																									\
+		twiddles2.base = &get(twiddleFactors, index2);																									\
+		twiddles3.base = &get(twiddleFactors, index3);																									\
+																																						\
+		FFTButterflies4_##precision##Complex(&get(f, i + kBegin), &get(f, i + kBegin + quarterStride), &get(f, i + kBegin + (2 * quarterStride)),		\
+											 &get(f, i + kBegin + (3 * quarterStride)), twiddles1, twiddles2, twiddles3, count);						\
+		kBegin += count;																																\
+	}																																					\
+}																																						\
+																																						\
+/* A pool job like FFTLevelByTree, for the radix-4 engine.*/																							\
+static void FFTLevel4ByTree_##precision##Complex(void* context, unsigned long long treeBegin, unsigned long long treeEnd)								\
+{																																						\
+	FFTLevelContext_##precision##Complex* level = context;																								\
+	Function_##precision##Complex f = level->f;																											\
+	Function_##precision##Complex twiddleFactors = level->twiddleFactors;																				\
+	unsigned long long quarterStride = level->quarterStride;																							\
+	unsigned long long lenDivStride = level->lenDivStride;																								\
+	unsigned long long halfLen = level->halfLen;																										\
+	unsigned long long quarterLen = halfLen / 2;																										\
+																																						\
+	for (unsigned long long tree = treeBegin; tree < treeEnd; tree++)																					\
+	{																																					\
+		unsigned long long i = tree * level->stride;																									\
+																																						\
+		if (simdKernelsUsable)																															\
+		{																																				\
+			ButterflyRange4_##precision##Complex(level, i, 0, quarterStride);																			\
+		}																																				\
+		else																																			\
+		{																																				\
+			for (unsigned long long k = 0; k < quarterStride; k++)																						\
+			{																																			\
+				unsigned long long e = k * lenDivStride;																								\
+				precision##Complex w1 = RootAtExponent_##precision##Complex(twiddleFactors, e, halfLen, quarterLen);									\
+				precision##Complex w2 = RootAtExponent_##precision##Complex(twiddleFactors, 2 * e, halfLen, quarterLen);								\
+				precision##Complex w3 = RootAtExponent_##precision##Complex(twiddleFactors, 3 * e, halfLen, quarterLen);								\
+				FFTButterfly4_##precision##Complex(f, i, k, quarterStride, w1, w2, w3);																	\
+			}																																			\
+		}																																				\
+	}																																					\
+}																																						\
+																																						\
+/* A pool job like FFTLevelByIndex, for the radix-4 engine.*/																							\
+static void FFTLevel4ByIndex_##precision##Complex(void* context, unsigned long long kBegin, unsigned long long kEnd)									\
+{																																						\
+	FFTLevelContext_##precision##Complex* level = context;																								\
+	Function_##precision##Complex f = level->f;																											\
+	Function_##precision##Complex twiddleFactors = level->twiddleFactors;																				\
+	unsigned long long len = level->len;																												\
+	unsigned long long stride = level->stride;																											\
+	unsigned long long quarterStride = level->quarterStride;																							\
+	unsigned long long lenDivStride = level->lenDivStride;																								\
+	unsigned long long halfLen = level->halfLen;																										\
+	unsigned long long quarterLen = halfLen / 2;																										\
+																																						\
+	if (simdKernelsUsable)																																\
+	{																																					\
+		for (unsigned long long i = 0; i < len; i += stride)																							\
+		{																																				\
+			ButterflyRange4_##precision##Complex(level, i, kBegin, kEnd);																				\
+		}																																				\
+																																						\
+		return;																																			\
+	}																																					\
+																																						\
+	for (unsigned long long k = kBegin; k < kEnd; k++)																									\
+	{																																					\
+		unsigned long long e = k * lenDivStride;																										\
+		precision##Complex w1 = RootAtExponent_##precision##Complex(twiddleFactors, e, halfLen, quarterLen);											\
+		precision##Complex w2 = RootAtExponent_##precision##Complex(twiddleFactors, 2 * e, halfLen, quarterLen);										\
+		precision##Complex w3 = RootAtExponent_##precision##Complex(twiddleFactors, 3 * e, halfLen, quarterLen);										\
+																																						\
+		for (unsigned long long i = 0; i < len; i += stride)																							\
+		{																																				\
+			FFTButterfly4_##precision##Complex(f, i, k, quarterStride, w1, w2, w3);																		\
+		}																																				\
+	}																																					\
+}																																						\
+																																						\
+/* The radix-4 counterpart of FFT. Climbs the recursion tree two levels at a time, which cuts both the number of passes over the data and the*/			\
+/* number of twiddle multiplications. Only valid when the length is a power of four.*/																	\
+static void FFT4_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)															\
+{																																						\
+	/* Base-4 digit-reversing the array sorts it by the order of the leaves in the radix-4 recursion tree.*/											\
+	DigitReverseArr4_##precision##Complex(f, cache);																									\
+																																						\
+	unsigned long long len = cache->length;																												\
+	unsigned int logLen = cache->logLength;																												\
+																																						\
+	/* The same level context the radix-2 engine uses, with quarterStride now playing the role halfStride plays there.*/								\
+	FFTLevelContext_##precision##Complex level;																											\
+	level.f = f;																																		\
+	level.twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);																\
+	level.len = len;																																	\
+	level.halfLen = len / 2;																															\
+	level.stride = 4;																																	\
+	level.halfStride = 2;																																\
+	level.quarterStride = 1;																															\
+	level.lenDivStride = len / 4;																														\
+																																						\
+	/* Each iteration of this loop climbs two levels up the recursion tree.*/																			\
+	for (unsigned int j = 0; j < logLen; j += 2)																										\
+	{																																					\
+		/* Same partitioning choice as the radix-2 engine.*/																							\
+		if (level.lenDivStride >= level.quarterStride)																									\
+		{																																				\
+			ParallelFor(cache->threadPool, FFTLevel4ByTree_##precision##Complex, &level, 0, level.lenDivStride);										\
+		}																																				\
+		else																																			\
+		{																																				\
+			ParallelFor(cache->threadPool, FFTLevel4ByIndex_##precision##Complex, &level, 0, level.quarterStride);										\
+		}																																				\
+																																						\
+		/* In the next level, trees will be four times as big.*/																						\
+		level.stride *= 4;																																\
+		level.halfStride *= 4;																															\
+		level.quarterStride *= 4;																														\
+		level.lenDivStride /= 4;																														\
+	}																																					\
+}																																						\
+																																						\
+/* Sorts the array by the order of the leaves in the mixed-radix recursion tree, where splitting in two stops at subsequences of length oddFactor:*/	\
+/* sample 2^logLength * t + r belongs at position reverse(r) * oddFactor + t. Unlike bit reversal this shuffle isn't its own inverse, so instead*/		\
+/* of swapping pairs it follows the permutation's cycles, with a visited bit per sample. That walk is less cache-friendly than the tiled swap the*/		\
+/* power-of-two lengths get, but it's one pass against the memory and butterfly work the shorter length saves everywhere else.*/						\
+static void MixedReverseArr_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)												\
+{																																						\
+	unsigned long long len = cache->length;																												\
+	unsigned long long oddFactor = cache->oddFactor;																									\
+	unsigned int logLen = cache->logLength;																												\
+	unsigned long long subMask = (1ULL << logLen) - 1;																									\
+	unsigned long long* table = cache->reversalTable;																									\
+	unsigned char* visited = cache->visitedFlags;																										\
+																																						\
+	/* Nothing in the cache is mutated by a transform except this scratch, and concurrent channel transforms share it, so the walk holds its lock.*/	\
+	EnterCriticalSection(&(cache->visitedLock));																										\
+	memset(visited, 0, DivCeilInt(len, CHAR_BIT));																										\
+																																						\
+	/* For big lengths the precomputed table only covers the middle digits, and the tile digits on both ends get the same on-the-stack*/				\
+	/* treatment ReverseArrBlocked gives them.*/																										\
+	char tiled = logLen >= 2 * REVERSAL_BLOCK_DIGITS;																									\
+	unsigned long long midMask = tiled ? (1ULL << (logLen - (2 * REVERSAL_BLOCK_DIGITS))) - 1 : 0;														\
+	unsigned long long blockReverse[REVERSAL_BLOCK_LEN];																								\
+																																						\
+	for (unsigned int i = 0; i < REVERSAL_BLOCK_LEN; i++)																								\
+	{																																					\
+		blockReverse[i] = BitReverse(REVERSAL_BLOCK_DIGITS, i);																							\
+	}																																					\
+																																						\
+	for (unsigned long long n = 0; n < len; n++)																										\
+	{																																					\
+		if ((visited[n / CHAR_BIT] >> (n % CHAR_BIT)) & 1)																								\
+		{																																				\
+			continue;																																	\
+		}																																				\
+																																						\
+		/* Carrying the displaced sample around the cycle until it lands back at n.*/																	\
+		precision##Complex carry = get(f, n);																											\
+		unsigned long long cur = n;																														\
+																																						\
+		for (;;)																																		\
+		{																																				\
+			visited[cur / CHAR_BIT] |= 1 << (cur % CHAR_BIT);																							\
+																																						\
+			/* Splitting cur into its subsequence (the power-of-two digits) and its position within it, then reversing the subsequence digits.*/		\
+			unsigned long long r = cur & subMask;																										\
+			unsigned long long t = cur >> logLen;																										\
+			unsigned long long reversed = tiled ?																										\
+				(blockReverse[r & (REVERSAL_BLOCK_LEN - 1)] << (logLen - REVERSAL_BLOCK_DIGITS)) |														\
+				(table[(r >> REVERSAL_BLOCK_DIGITS) & midMask] << REVERSAL_BLOCK_DIGITS) |																\
+				blockReverse[r >> (logLen - REVERSAL_BLOCK_DIGITS)] : table[r];																			\
+			cur = (reversed * oddFactor) + t;																											\
+																																						\
+			if (cur == n)																																\
+			{																																			\
+				break;																																	\
+			}																																			\
+																																						\
+			precision##Complex displaced = get(f, cur);																									\
+			get(f, cur) = carry;																														\
+			carry = displaced;																															\
+		}																																				\
+																																						\
+		get(f, n) = carry;																																\
+	}																																					\
+																																						\
+	LeaveCriticalSection(&(cache->visitedLock));																										\
+}																																						\
+																																						\
+/* Everything the leaf jobs of the mixed-radix engine need to know. Passed to the jobs as their context.*/												\
+typedef struct																																			\
+{																																						\
+	Function_##precision##Complex f;																													\
+	Function_##precision##Complex twiddleFactors;																										\
+	unsigned long long len;																																\
+	unsigned long long oddFactor;																														\
+} OddLeafContext_##precision##Complex;																													\
+																																						\
+/* A pool job which computes the plain size-oddFactor DFTs of the leaves [begin, end). With the odd factor capped at MAX_ODD_FACTOR the direct*/		\
+/* O(m^2) sum beats being clever, and each leaf's samples sit contiguously thanks to the shuffle.*/														\
+static void OddLeafDFTRange_##precision##Complex(void* context, unsigned long long begin, unsigned long long end)										\
+{																																						\
+	OddLeafContext_##precision##Complex* ctx = context;																									\
+	Function_##precision##Complex f = ctx->f;																											\
+	unsigned long long m = ctx->oddFactor;																												\
+	unsigned long long len = ctx->len, halfLen = len / 2, quarterLen = len / 4;																			\
+																																						\
+	/* The m'th roots of unity, which the big table holds at every len/m'th exponent.*/																	\
+	precision##Complex roots[MAX_ODD_FACTOR];																											\
+																																						\
+	for (unsigned long long e = 0; e < m; e++)																											\
+	{																																					\
+		roots[e] = RootAtAnyExponent_##precision##Complex(ctx->twiddleFactors, e * (len / m), len, halfLen, quarterLen);								\
+	}																																					\
+																																						\
+	for (unsigned long long leaf = begin; leaf < end; leaf++)																							\
 	{																																					\
-		precision##Complex root = get(twiddleFactors, k);																								\
-		precision##Complex rootBeforeHalf = sqrt_##precision##Complex(root);																			\
-		precision##Complex rootAfterHalf = sqrt_##precision##Complex(FlipReal_##precision##Complex(root));												\
+		unsigned long long base = leaf * m;																												\
+		precision##Complex inputs[MAX_ODD_FACTOR];																										\
 																																						\
-		BackwardPreprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), rootBeforeHalf);													\
-		BackwardPreprocessSymmetric_##precision##Complex(&get(f, halfLen - k), &get(f, halfLen + k), rootAfterHalf);									\
+		for (unsigned long long t = 0; t < m; t++)																										\
+		{																																				\
+			inputs[t] = get(f, base + t);																												\
+		}																																				\
+																																						\
+		for (unsigned long long a = 0; a < m; a++)																										\
+		{																																				\
+			precision##Complex sum = inputs[0];																											\
+																																						\
+			for (unsigned long long t = 1; t < m; t++)																									\
+			{																																			\
+				sum += roots[(a * t) % m] * inputs[t];																									\
+			}																																			\
+																																						\
+			get(f, base + a) = sum;																														\
+		}																																				\
 	}																																					\
+}																																						\
+																																						\
+/* The mixed-radix counterpart of FFT, for lengths oddFactor * 2^logLength. After the shuffle the leaves get their plain DFTs, and from there*/			\
+/* the usual radix-2 levels take over with trees that are oddFactor times as big - the butterfly math never cared that the length was a power*/			\
+/* of two. The radix-4 engine doesn't apply here because its level pairing assumes the tree branches in fours the whole way down.*/						\
+static void FFTMixed_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)														\
+{																																						\
+	MixedReverseArr_##precision##Complex(f, cache);																										\
+																																						\
+	unsigned long long len = cache->length;																												\
+	unsigned long long oddFactor = cache->oddFactor;																									\
+	unsigned int logLen = cache->logLength;																												\
+																																						\
+	OddLeafContext_##precision##Complex leaves;																											\
+	leaves.f = f;																																		\
+	leaves.twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);																\
+	leaves.len = len;																																	\
+	leaves.oddFactor = oddFactor;																														\
+	ParallelFor(cache->threadPool, OddLeafDFTRange_##precision##Complex, &leaves, 0, len / oddFactor);													\
+																																						\
+	/* The same level climb as the radix-2 engine, starting from trees of one leaf pair.*/																\
+	FFTLevelContext_##precision##Complex level;																											\
+	level.f = f;																																		\
+	level.twiddleFactors = leaves.twiddleFactors;																										\
+	level.len = len;																																	\
+	level.halfLen = len / 2;																															\
+	level.stride = 2 * oddFactor;																														\
+	level.halfStride = oddFactor;																														\
+	level.quarterStride = oddFactor / 2;																												\
+	level.lenDivStride = len / (2 * oddFactor);																											\
+																																						\
+	for (unsigned int j = 0; j < logLen; j++)																											\
+	{																																					\
+		if (level.lenDivStride >= level.halfStride)																										\
+		{																																				\
+			ParallelFor(cache->threadPool, FFTLevelByTree_##precision##Complex, &level, 0, level.lenDivStride);											\
+		}																																				\
+		else																																			\
+		{																																				\
+			ParallelFor(cache->threadPool, FFTLevelByIndex_##precision##Complex, &level, 0, level.halfStride);											\
+		}																																				\
 																																						\
-	for (unsigned long long k = 2; k < halfLen; k += 2)																									\
-	{																																					\
-		precision##Complex root	= get(twiddleFactors, k / 2);																							\
-		BackwardPreprocessSymmetric_##precision##Complex(&get(f, k), &get(f, len - k), root);															\
+		level.stride *= 2;																																\
+		level.halfStride *= 2;																															\
+		level.quarterStride = level.halfStride / 2;																										\
+		level.lenDivStride /= 2;																														\
 	}																																					\
-																																						\
-	/* Now applying inverse FFT. The result will be the original interleaved sequence of even and odd reals (with changes we've applied).*/				\
-	InverseFFT_##precision##Complex(f, cache);																											\
 }																																						\
-																																						\
 /* Most of the comments in this function refer to a picture of the recursion tree the algorithm follows, which I saw here:*/							\
 /* https://www.geeksforgeeks.org/iterative-fast-fourier-transformation-polynomial-multiplication/*/														\
 /* The algorithm itself is a modified version of this: https://stackoverflow.com/a/37729648/12553917. */												\
 void FFT_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)																	\
 {																																						\
+	/* When a GPU plan exists it takes the whole transform. It can still fail mid-flight (lost device, transfer trouble), and then the CPU engines run as usual.*/\
+	if (cache->gpu != NULL && GpuFFT(cache->gpu, &f))																									\
+	{																																					\
+		return;																																			\
+	}																																					\
+																																						\
+	/* Lengths that are a power of 4 go through the radix-4 engine instead.*/																			\
+	if (cache->radix4)																																	\
+	{																																					\
+		FFT4_##precision##Complex(f, cache);																											\
+		return;																																			\
+	}																																					\
+																																						\
+	/* And lengths with an odd factor go through the mixed-radix engine.*/																				\
+	if (cache->oddFactor > 1)																															\
+	{																																					\
+		FFTMixed_##precision##Complex(f, cache);																										\
+		return;																																			\
+	}																																					\
+																																						\
 	/* Bit-reversing the array sorts it by the order of the leaves in the recursion tree.*/																\
 	BitReverseArr_##precision##Complex(f, cache);																										\
 																																						\
 	unsigned long long len = cache->length;																												\
 	unsigned long long halfLen = len / 2;																												\
 	unsigned int logLen = cache->logLength;																												\
-	Function_##precision##Complex twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);										\
 																																						\
+	/* The level context holds everything the jobs that run the butterflies need to know.*/																\
 	/* The stride is the length of each sub-tree in the current level.*/																				\
 	/* We start from 2 because the level with length-1 sub-trees is trivial and assumed to already be contained in the array.*/							\
-	unsigned long long stride = 2;																														\
-	unsigned long long halfStride = 1;																													\
-	unsigned long long quarterStride = 0;																												\
-	unsigned long long lenDivStride = halfLen;																											\
+	FFTLevelContext_##precision##Complex level;																											\
+	level.f = f;																																		\
+	level.twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);																\
+	level.len = len;																																	\
+	level.halfLen = halfLen;																															\
+	level.stride = 2;																																	\
+	level.halfStride = 1;																																\
+	level.quarterStride = 0;																															\
+	level.lenDivStride = halfLen;																														\
 																																						\
 	/* Each iteration of this loop climbs another level up the recursion tree.*/																		\
 	for (unsigned int j = 0; j < logLen; j++)																											\
 	{																																					\
-		/* Each iteration of this loop moves to the next element in the current tree.*/																	\
-		/* We only need to iterate over half the elements because in each iteration, we calculate two indices together.*/								\
-		for (unsigned long long k = 0; k < halfStride; k++)																								\
+		/* The butterflies within one level are all independent, so we let the pool loose on them.*/													\
+		/* We partition across whichever dimension is bigger: for the lower levels that's the trees, for the upper ones it's the indices within.*/		\
+		/* Note that there are len/stride trees in a level, which is the same as lenDivStride.*/														\
+		if (level.lenDivStride >= level.halfStride)																										\
 		{																																				\
-			/* Caching repeatedly-used calculations.*/																									\
-			unsigned long long kPlusHalfStride = k + halfStride; 																						\
-																																						\
-			/* We want to calculate RootOfUnity(k, stride), for 0<=k<halfStride, but our cache is for RootOfUnity(k, len) for 0<=k<=len/4.*/			\
-			/* First we use the equation RootOfUnity(k, stride) = RootOfUnity(k*lenDivStride, N) to cover the cases 0<=k<=quarterStride.*/				\
-			/* If k > quarterStride, we use the fact that RootOfUnity(k, N) = FlipReal(RootOfUnity((N/2) - k, N)). Boom. Math.*/						\
-			/* I could split the for loop into two to save on this branch here, but it doesn't really save anything,*/									\
-			/* we'd have to write the same code twice, and it might even hurt it because of instruction caching.*/										\
-			precision##Complex factor = k <= quarterStride ?																							\
-										get(twiddleFactors, (k * lenDivStride)) :																		\
-										FlipReal_##precision##Complex(get(twiddleFactors, halfLen - (k * lenDivStride)));								\
-																																						\
-			/* Each iteration of this loop moves to the next tree in the current level.*/																\
-			for (unsigned long long i = 0; i < len; i += stride)																						\
-			{																																			\
-				/* i serves as a sort of "base" for the current tree. i + k is the k'th element in the (i / stride)'th tree of this level.*/			\
-				precision##Complex evenSum = get(f, i + k);																								\
-				precision##Complex oddSum = factor * get(f, kPlusHalfStride + i);											 							\
-				get(f, i + k) = evenSum + oddSum;																										\
-				get(f, kPlusHalfStride + i) = evenSum - oddSum;																							\
-			}																																			\
+			ParallelFor(cache->threadPool, FFTLevelByTree_##precision##Complex, &level, 0, level.lenDivStride);											\
+		}																																				\
+		else																																			\
+		{																																				\
+			ParallelFor(cache->threadPool, FFTLevelByIndex_##precision##Complex, &level, 0, level.halfStride);											\
 		}																																				\
 																																						\
 		/* In the next level, trees will be twice as big.*/																								\
-		stride *= 2;																																	\
-		halfStride *= 2;																																\
-		quarterStride = halfStride / 2; /* Can't just multiply by 2 because this starts at 0.*/															\
-		lenDivStride /= 2;																																\
+		level.stride *= 2;																																\
+		level.halfStride *= 2;																															\
+		level.quarterStride = level.halfStride / 2; /* Can't just multiply by 2 because this starts at 0.*/												\
+		level.lenDivStride /= 2;																														\
 	}																																					\
 }																																						\
 																																						\
-void InverseFFT_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)															\
+/* A pool job which conjugates the samples in the range [begin, end). The first half of the conjugation trick the inverse FFT uses.*/					\
+static void ConjugateRange_##precision##Complex(void* context, unsigned long long begin, unsigned long long end)										\
 {																																						\
-	unsigned long long len = cache->length;																												\
+	Function_##precision##Complex f = *CAST(context, Function_##precision##Complex*);																	\
 																																						\
-	/* Conjugating every sample before applying forward FFT.*/																							\
-	for (unsigned long long i = 0; i < len; i++)																										\
+	for (unsigned long long i = begin; i < end; i++)																									\
 	{																																					\
 		get(f, i) = conj_##precision##Complex(get(f, i));																								\
 	}																																					\
+}																																						\
+																																						\
+/* A pool job which conjugates the samples in the range [begin, end) and divides them by the function length. The second half of the trick.*/			\
+static void ConjugateAndScaleRange_##precision##Complex(void* context, unsigned long long begin, unsigned long long end)								\
+{																																						\
+	Function_##precision##Complex f = *CAST(context, Function_##precision##Complex*);																	\
+	unsigned long long len = f.totalLen;																												\
+																																						\
+	for (unsigned long long i = begin; i < end; i++)																									\
+	{																																					\
+		get(f, i) = conj_##precision##Complex(get(f, i)) / len;																							\
+	}																																					\
+}																																						\
+																																						\
+void InverseFFT_##precision##Complex(Function_##precision##Complex f, SoundEditorCache* cache)															\
+{																																						\
+	unsigned long long len = cache->length;																												\
+																																						\
+	/* Conjugating every sample before applying forward FFT.*/																							\
+	ParallelFor(cache->threadPool, ConjugateRange_##precision##Complex, &f, 0, len);																	\
 																																						\
 	/* Applying forward fft.*/																															\
 	FFT_##precision##Complex(f, cache);																													\
 																																						\
 	/* Conjugating again and dividing by the num of samples.*/																							\
-	for (unsigned long long i = 0; i < len; i++)																										\
+	ParallelFor(cache->threadPool, ConjugateAndScaleRange_##precision##Complex, &f, 0, len);															\
+}																																						\
+																																						\
+/* Everything the sparse synthesis job needs to know about the band of bins it's adding into the waveform. Passed to the job as its context.*/			\
+typedef struct																																			\
+{																																						\
+	Function_##precision##Complex timeFunc;																/* The shadowed waveform being patched.*/		\
+	Function_##precision##Complex twiddleFactors;														/* The root of unity cache.*/					\
+	unsigned long long len;																				/* The complex interleaved length.*/			\
+	unsigned long long bandLength;																		/* How many bins actually changed.*/			\
+	unsigned long long* bins;																			/* The indices of the changed bins.*/			\
+	precision##Complex* coeffsA;																		/* Per-bin coefficient on the positive-frequency exponential.*/\
+	precision##Complex* coeffsB;																		/* Per-bin coefficient on the negative-frequency one.*/\
+} SparseSynthesisContext_##precision##Complex;																											\
+																																						\
+/* A pool job which adds each changed bin's inverse-transform contribution to the waveform samples in [begin, end).*/									\
+/* A bin's contribution to sample m is A*u + B*conj(u) where u = RootOfUnity(bin * m, len) conjugated, so it comes straight from the cache -*/			\
+/* bin * m mod len advances by just an addition and a conditional subtract per sample, and the roots stay table-exact throughout.*/						\
+static void SparseSynthesisJob_##precision##Complex(void* context, unsigned long long begin, unsigned long long end)									\
+{																																						\
+	SparseSynthesisContext_##precision##Complex* ctx = context;																							\
+	unsigned long long len = ctx->len, halfLen = len / 2, quarterLen = len / 4;																			\
+																																						\
+	for (unsigned long long b = 0; b < ctx->bandLength; b++)																							\
 	{																																					\
-		get(f, i) = conj_##precision##Complex(get(f, i)) / len;																							\
+		unsigned long long bin = ctx->bins[b];																											\
+		precision##Complex coeffA = ctx->coeffsA[b], coeffB = ctx->coeffsB[b];																			\
+		unsigned long long e = (bin * begin) % len;																										\
+																																						\
+		for (unsigned long long m = begin; m < end; m++)																								\
+		{																																				\
+			precision##Complex u = conj_##precision##Complex(RootAtAnyExponent_##precision##Complex(ctx->twiddleFactors, e, len, halfLen, quarterLen));	\
+			get(ctx->timeFunc, m) += (coeffA * u) + (coeffB * conj_##precision##Complex(u));															\
+			e += bin;																																	\
+			e = e >= len ? e - len : e;																													\
+		}																																				\
 	}																																					\
 }
 
@@ -328,6 +1272,9 @@ SOUND_EDITOR_C_PRECISION_CONTENTS(Float)
 
 SoundEditorCache* InitializeSoundEditor(Function* f)
 {
+	// Checking once which instruction sets the CPU supports, so the hot loops can dispatch straight to the vectorized kernels.
+	simdKernelsUsable = SimdKernelsSupported();
+
 	switch (GetType(f))
 	{
 		case FloatComplexType:
@@ -347,14 +1294,21 @@ void DeallocateSoundEditorCache(SoundEditorCache* cache)
 		return;
 	}
 		
-	// DeallocateFunctionInternals as well as free can handle NULL pointers no problem.
+	// DestroyThreadPool and DeallocateFunctionInternals as well as free can handle NULL pointers no problem.
+	DestroyThreadPool(cache->threadPool);
+	DeallocateGpuFourierContext(cache->gpu);
 	DeallocateFunctionInternals(cache->twiddleFactors);
 	free(cache->twiddleFactors);
+	free(cache->reversalTable);
+	free(cache->visitedFlags);
+	DeleteCriticalSection(&(cache->visitedLock));
 	free(cache);
 }
 
 void RealInterleavedFFT(Function* f, SoundEditorCache* cache)
 {
+	INSTRUMENT_BEGIN(TRANSFORM);
+
 	switch (GetType(f))
 	{
 		case FloatComplexType:
@@ -367,10 +1321,15 @@ void RealInterleavedFFT(Function* f, SoundEditorCache* cache)
 			fprintf(stderr, "Tried to FFT an invalid type.\n");
 			break;
 	}
+
+	INSTRUMENT_END(TRANSFORM);
+	INSTRUMENT_COUNT(TRANSFORM, NumOfSamples(f));
 }
 
 void InverseRealInterleavedFFT(Function* f, SoundEditorCache* cache)
 {
+	INSTRUMENT_BEGIN(TRANSFORM);
+
 	switch (GetType(f))
 	{
 		case FloatComplexType:
@@ -383,6 +1342,174 @@ void InverseRealInterleavedFFT(Function* f, SoundEditorCache* cache)
 			fprintf(stderr, "Tried to IFFT an invalid type.\n");
 			break;
 	}
+
+	INSTRUMENT_END(TRANSFORM);
+	INSTRUMENT_COUNT(TRANSFORM, NumOfSamples(f));
+}
+
+SpectralShadow* CreateSpectralShadow(Function* f)
+{
+	SpectralShadow* shadow = calloc(1, sizeof(SpectralShadow));
+
+	if (shadow == NULL)
+	{
+		return NULL;
+	}
+
+	shadow->func = CreatePartialClone(f, 0, NumOfSamples(f) - 1);
+
+	if (shadow->func == NULL)
+	{
+		free(shadow);
+		return NULL;
+	}
+
+	shadow->synced = TRUE;
+	return shadow;
+}
+
+void DeallocateSpectralShadow(SpectralShadow* shadow)
+{
+	if (shadow == NULL)
+	{
+		return;
+	}
+
+	DeallocateFunctionInternals(shadow->func);
+	free(shadow->func);
+
+	if (shadow->bandBackup != NULL)
+	{
+		DeallocateFunctionInternals(shadow->bandBackup);
+		free(shadow->bandBackup);
+	}
+
+	free(shadow);
+}
+
+void RefreshSpectralShadow(SpectralShadow* shadow, Function* channelData)
+{
+	CopySamples(shadow->func, channelData, 0, 0, NumOfSamples(channelData));
+	shadow->synced = TRUE;
+}
+
+void SwapSpectralShadow(SpectralShadow* shadow, Function** channelData)
+{
+	Function* temp = *channelData;
+	*channelData = shadow->func;
+	shadow->func = temp;
+}
+
+void BeginSpectralShadowBandEdit(SpectralShadow* shadow, Function* channelData, unsigned long long fromBin, unsigned long long toBin, SoundEditorCache* cache)
+{
+	// A stale shadow means we've already committed to a full transform on the next flip, so there's nothing to keep in sync.
+	if (shadow == NULL || !shadow->synced)
+	{
+		return;
+	}
+
+	// Synthesizing one bin into the waveform costs about as much as one butterfly level of the full inverse transform, so past logLength bins the full transform wins.
+	// Bands that reach bin 0 also take the full transform path, because that bin packs the 0Hz and Nyquist values together and doesn't behave like the others.
+	if (fromBin == 0 || toBin - fromBin + 1 > cache->logLength)
+	{
+		shadow->synced = FALSE;
+		return;
+	}
+
+	shadow->bandBackup = CreatePartialClone(channelData, fromBin, toBin);
+
+	// When there's no memory for the backup we just fall back to the full transform, same as above.
+	if (shadow->bandBackup == NULL)
+	{
+		shadow->synced = FALSE;
+		return;
+	}
+
+	shadow->bandStart = fromBin;
+}
+
+void EndSpectralShadowBandEdit(SpectralShadow* shadow, Function* channelData, SoundEditorCache* cache)
+{
+	#define END_SPECTRAL_SHADOW_BAND_EDIT_TYPED(precision)																											\
+	Function_##precision##Complex freq = *((Function_##precision##Complex*)channelData);																			\
+	Function_##precision##Complex backup = *((Function_##precision##Complex*)shadow->bandBackup);																	\
+	unsigned long long len = cache->length;																															\
+	unsigned long long halfLen = len / 2;																															\
+	precision##Real lengthReal = 2 * len;																															\
+																																									\
+	/* These are small, the band is capped at logLength bins.*/																										\
+	unsigned long long bins[bandLength];																															\
+	precision##Complex coeffsA[bandLength];																															\
+	precision##Complex coeffsB[bandLength];																															\
+																																									\
+	SparseSynthesisContext_##precision##Complex context;																											\
+	context.bandLength = 0;																																			\
+																																									\
+	/* Working out each changed bin's spectral delta and turning it into the two exponential coefficients of its time-domain contribution.*/						\
+	/* Editing the stored bin k moves the spectrum at both k and len - k (that's how the preprocessing of the inverse transform reads it),*/						\
+	/* so the contribution to waveform sample m is A * u + B * conj(u) with u = e^(2*pi*i*k*m/len), where A and B fall out of the*/									\
+	/* preprocessing coefficients. The special bin len / 2 passes through the preprocessing untouched, so its contribution is just d/len.*/							\
+	for (unsigned long long i = 0; i < bandLength; i++)																												\
+	{																																								\
+		unsigned long long bin = shadow->bandStart + i;																												\
+		precision##Complex delta = get(freq, bin) - get(backup, i);																									\
+																																									\
+		if (delta == 0)																																				\
+		{																																							\
+			continue;																																				\
+		}																																							\
+																																									\
+		if (bin == halfLen)																																			\
+		{																																							\
+			coeffsA[context.bandLength] = delta / len;																												\
+			coeffsB[context.bandLength] = 0;																														\
+		}																																							\
+		else																																						\
+		{																																							\
+			precision##Complex root = RootOfUnity_##precision##Complex(bin, lengthReal);																			\
+			precision##Complex oppositeRoot = FlipReal_##precision##Complex(root);																					\
+			coeffsA[context.bandLength] = CAST(0.5, precision##Complex) * delta *																					\
+				conj_##precision##Complex(CAST(1.0, precision##Complex) - (I * root)) / len;																		\
+			coeffsB[context.bandLength] = CAST(0.5, precision##Complex) * conj_##precision##Complex(delta) *														\
+				conj_##precision##Complex(CAST(1.0, precision##Complex) + (I * oppositeRoot)) / len;																\
+		}																																							\
+																																									\
+		bins[context.bandLength] = bin;																																\
+		context.bandLength++;																																		\
+	}																																								\
+																																									\
+	if (context.bandLength != 0)																																	\
+	{																																								\
+		context.timeFunc = *((Function_##precision##Complex*)shadow->func);																							\
+		context.twiddleFactors = *CAST(cache->twiddleFactors, Function_##precision##Complex*);																		\
+		context.len = len;																																			\
+		context.bins = bins;																																		\
+		context.coeffsA = coeffsA;																																	\
+		context.coeffsB = coeffsB;																																	\
+		ParallelFor(cache->threadPool, SparseSynthesisJob_##precision##Complex, &context, 0, len);																	\
+	}																																								\
+
+	// Nothing to do when no band edit was begun, which covers NULL and stale shadows too.
+	if (shadow == NULL || shadow->bandBackup == NULL)
+	{
+		return;
+	}
+
+	unsigned long long bandLength = NumOfSamples(shadow->bandBackup);
+
+	// Normally I would have this in a switch statement, but there's lots of variable declarations inside these macros that won't compile in a switch statement.
+	if (GetType(channelData) == FloatComplexType)
+	{
+		END_SPECTRAL_SHADOW_BAND_EDIT_TYPED(Float)
+	}
+	else
+	{
+		END_SPECTRAL_SHADOW_BAND_EDIT_TYPED(Double)
+	}
+
+	DeallocateFunctionInternals(shadow->bandBackup);
+	free(shadow->bandBackup);
+	shadow->bandBackup = NULL;
 }
 
 unsigned long long BitReverse(unsigned int digits, unsigned long long n)
@@ -399,26 +1526,278 @@ unsigned long long BitReverse(unsigned int digits, unsigned long long n)
 	return reversed;
 }
 
+unsigned long long DigitReverse4(unsigned int digits, unsigned long long n)
+{
+	unsigned long long reversed = 0;
+
+	for (int i = 0; i < digits; i++)
+	{
+		reversed <<= 2;
+		reversed |= (n & 3);
+		n >>= 2;
+	}
+
+	return reversed;
+}
+
+// Applying or recording an additive change works through chunks of at most this many samples, computed into small stack buffers,
+// so the vectorized kernels get contiguous runs to chew on without one giant allocation that could fail.
+#define ADDITIVE_CHUNK_LEN 256
+
+#define SOUND_EDITOR_C_ADDITIVE_HELPERS(precision)																													\
+/* The biggest run that starts at i and fits in one chunk without either of the two symmetric streams of an additive change crossing a segment boundary.*/			\
+ __attribute__((always_inline)) inline																																\
+static unsigned long long AdditiveRunLength_##precision##Complex(Function_##precision##Complex f, unsigned long long i, unsigned long long halfLength,				\
+																 unsigned long long startSample, unsigned long long endSample)										\
+{																																									\
+	unsigned long long count = MinIndex(halfLength - i, ADDITIVE_CHUNK_LEN);																						\
+	count = MinIndex(count, StridedRunLength(startSample + i, 1, f.segmentLen));																					\
+	return MinIndex(count, StridedRunLength(endSample - i, -1, f.segmentLen));																						\
+}																																									\
+																																									\
+/* Computes the Gaussian additions changeAmount * exp(-((2n/N - 1) / smoothing)^2) for the samples [i, i+count). Everything that needs these values*/				\
+/* has to take them from here, because the vectorized path isn't bit-identical to the scalar one, and mixing the two would make RecordClampedSamples*/				\
+/* and ApplyModificationInternal disagree about which samples clamp.*/																								\
+static void ComputeAdditions_##precision##Real(precision##Real* additions, unsigned long long i, unsigned long long count, precision##Real highestIndex,			\
+											   precision##Real smoothing, precision##Real changeAmount)																\
+{																																									\
+	if (simdKernelsUsable)																																			\
+	{																																								\
+		precision##Real step = CAST(2.0, precision##Real) / (highestIndex * smoothing);																				\
+		GaussianAdditions_##precision##Real(additions, (((2 * i) / highestIndex) - 1) / smoothing, step, changeAmount, count);										\
+	}																																								\
+	else																																							\
+	{																																								\
+		for (unsigned long long n = 0; n < count; n++)																												\
+		{																																							\
+			additions[n] = changeAmount * exp_##precision##Real(-Square##precision##Real((((2 * (i + n)) / highestIndex) - 1) / smoothing));						\
+		}																																							\
+	}																																								\
+}																																									\
+																																									\
+/* Same deal for magnitudes - the kernel's arithmetic and cabs can disagree in the last bit, so both passes of RecordClampedSamples use this.*/						\
+static void ComputeMagnitudes_##precision##Complex(precision##Real* magnitudes, Function_##precision##Complex f, unsigned long long index, long long stride,		\
+												   unsigned long long count)																						\
+{																																									\
+	if (simdKernelsUsable)																																			\
+	{																																								\
+		Magnitudes_##precision##Complex(magnitudes, &get(f, index), stride, count);																					\
+	}																																								\
+	else																																							\
+	{																																								\
+		for (unsigned long long n = 0; n < count; n++)																												\
+		{																																							\
+			magnitudes[n] = abs_##precision##Complex(get(f, index + (CAST(n, long long) * stride)));																\
+		}																																							\
+	}																																								\
+}
+
+SOUND_EDITOR_C_ADDITIVE_HELPERS(Float)
+SOUND_EDITOR_C_ADDITIVE_HELPERS(Double)
+
+// Finds the samples that applying the given additive modification would clamp to zero magnitude, and stores their indices and old values in it.
+// Those are the only samples an addition can't restore by subtracting itself back, because clamping throws their phase away.
+// Returns zero iff there was a memory allocation error.
+static char RecordClampedSamples(Function** channelsData, Modification* modification)
+{
+	#define RECORD_CLAMPED_SAMPLES_TYPED(precision)																													\
+	Function_##precision##Complex channelData = *(((Function_##precision##Complex**)channelsData)[modification->channel]);											\
+	Function_##precision##Complex* values;																															\
+	unsigned long long length = modification->length;																												\
+	unsigned long long startSample = modification->startSample;																										\
+	unsigned long long endSample = startSample + length - 1;																										\
+	unsigned long long halfLength = length / 2;																														\
+	precision##Real smoothing = modification->smoothing, changeAmount = modification->changeAmount;																	\
+	precision##Real highestIndex = length - 1;																														\
+	unsigned long long count = 0, n = 0;																															\
+																																									\
+	/* First pass just counts how many samples are about to get flattened, which is usually none, so usually we get to skip the allocations entirely.*/				\
+	/* The additions and magnitudes have to come out of the same helpers ApplyModificationInternal uses or we'd disagree with it about which samples clamp.*/		\
+	unsigned long long i = 0;																																		\
+																																									\
+	while (i < halfLength)																																			\
+	{																																								\
+		precision##Real additions[ADDITIVE_CHUNK_LEN], frontMagnitudes[ADDITIVE_CHUNK_LEN], backMagnitudes[ADDITIVE_CHUNK_LEN];										\
+		unsigned long long runLength = AdditiveRunLength_##precision##Complex(channelData, i, halfLength, startSample, endSample);									\
+		ComputeAdditions_##precision##Real(additions, i, runLength, highestIndex, smoothing, changeAmount);															\
+		ComputeMagnitudes_##precision##Complex(frontMagnitudes, channelData, startSample + i, 1, runLength);														\
+		ComputeMagnitudes_##precision##Complex(backMagnitudes, channelData, endSample - i, -1, runLength);															\
+																																									\
+		for (unsigned long long j = 0; j < runLength; j++)																											\
+		{																																							\
+			count += frontMagnitudes[j] + additions[j] <= 0 ? 1 : 0;																								\
+			count += backMagnitudes[j] + additions[j] <= 0 ? 1 : 0;																									\
+		}																																							\
+																																									\
+		i += runLength;																																				\
+	}																																								\
+																																									\
+	if (length % 2 == 1)																																			\
+	{																																								\
+		count += abs_##precision##Complex(get(channelData, startSample + halfLength)) + changeAmount <= 0 ? 1 : 0;													\
+	}																																								\
+																																									\
+	if (count == 0)																																					\
+	{																																								\
+		return TRUE;																																				\
+	}																																								\
+																																									\
+	/* Allocating room for the doomed samples' indices and old values.*/																							\
+	modification->clampedIndices = malloc(sizeof(unsigned long long) * count);																						\
+	values = malloc(sizeof(Function_##precision##Complex));																											\
+																																									\
+	if (modification->clampedIndices == NULL || values == NULL ||																									\
+		!AllocateFunctionInternals_##precision##Complex(values, count))																								\
+	{																																								\
+		free(modification->clampedIndices);																															\
+		free(values);																																				\
+		modification->clampedIndices = NULL;																														\
+		return FALSE;																																				\
+	}																																								\
+																																									\
+	modification->clampedCount = count;																																\
+	modification->clampedValues = (Function*)values;																												\
+																																									\
+	/* Second pass stores them, in the same visit order (and through the same chunks) as the first pass.*/															\
+	i = 0;																																							\
+																																									\
+	while (i < halfLength)																																			\
+	{																																								\
+		precision##Real additions[ADDITIVE_CHUNK_LEN], frontMagnitudes[ADDITIVE_CHUNK_LEN], backMagnitudes[ADDITIVE_CHUNK_LEN];										\
+		unsigned long long runLength = AdditiveRunLength_##precision##Complex(channelData, i, halfLength, startSample, endSample);									\
+		ComputeAdditions_##precision##Real(additions, i, runLength, highestIndex, smoothing, changeAmount);															\
+		ComputeMagnitudes_##precision##Complex(frontMagnitudes, channelData, startSample + i, 1, runLength);														\
+		ComputeMagnitudes_##precision##Complex(backMagnitudes, channelData, endSample - i, -1, runLength);															\
+																																									\
+		for (unsigned long long j = 0; j < runLength; j++)																											\
+		{																																							\
+			if (frontMagnitudes[j] + additions[j] <= 0)																												\
+			{																																						\
+				modification->clampedIndices[n] = i + j;																											\
+				get(*values, n) = get(channelData, startSample + i + j);																							\
+				n++;																																				\
+			}																																						\
+																																									\
+			if (backMagnitudes[j] + additions[j] <= 0)																												\
+			{																																						\
+				modification->clampedIndices[n] = length - 1 - (i + j);																								\
+				get(*values, n) = get(channelData, endSample - i - j);																								\
+				n++;																																				\
+			}																																						\
+		}																																							\
+																																									\
+		i += runLength;																																				\
+	}																																								\
+																																									\
+	if (length % 2 == 1 && abs_##precision##Complex(get(channelData, startSample + halfLength)) + changeAmount <= 0)												\
+	{																																								\
+		modification->clampedIndices[n] = halfLength;																												\
+		get(*values, n) = get(channelData, startSample + halfLength);																								\
+	}																																								\
+																																									\
+	return TRUE;
+
+	if (GetType(channelsData[modification->channel]) == FloatComplexType)
+	{
+		RECORD_CLAMPED_SAMPLES_TYPED(Float)
+	}
+	else
+	{
+		RECORD_CLAMPED_SAMPLES_TYPED(Double)
+	}
+}
+
+// Copies the old values that RecordClampedSamples stored back into their places in the channel data. Does nothing when no samples clamped.
+static void RestoreClampedSamples(Function** channelsData, Modification* modification)
+{
+	#define RESTORE_CLAMPED_SAMPLES_TYPED(precision)																												\
+	Function_##precision##Complex channelData = *(((Function_##precision##Complex**)channelsData)[modification->channel]);											\
+	Function_##precision##Complex* values = (Function_##precision##Complex*)modification->clampedValues;															\
+																																									\
+	for (unsigned long long n = 0; n < modification->clampedCount; n++)																								\
+	{																																								\
+		get(channelData, modification->startSample + modification->clampedIndices[n]) = get(*values, n);															\
+	}
+
+	if (modification->clampedCount == 0)
+	{
+		return;
+	}
+
+	if (GetType(channelsData[modification->channel]) == FloatComplexType)
+	{
+		RESTORE_CLAMPED_SAMPLES_TYPED(Float)
+	}
+	else
+	{
+		RESTORE_CLAMPED_SAMPLES_TYPED(Double)
+	}
+}
+
+// How many modification nodes fit in one slab of the pool below.
+#define MODIFICATION_SLAB_LEN 256
+
+// The pool every modification node comes from. Edits allocate these tiny nodes constantly, so carving them out of slabs keeps them
+// from peppering the heap. The pool lives for the whole process and just gets recycled between files.
+static SlabPool* modificationPool = NULL;
+
+// Grabs a zeroed node from the pool, creating the pool on first use. Returns NULL when there's no memory for it.
+static Modification* AllocateModification()
+{
+	if (modificationPool == NULL && (modificationPool = CreateSlabPool(sizeof(Modification), MODIFICATION_SLAB_LEN)) == NULL)
+	{
+		return NULL;
+	}
+
+	Modification* modification = SlabPoolAlloc(modificationPool);
+
+	if (modification != NULL)
+	{
+		memset(modification, 0, sizeof(Modification));
+	}
+
+	return modification;
+}
+
 char ApplyModification(unsigned long long fromSample, unsigned long long toSample, ChangeType changeType, double changeAmount, double smoothing, unsigned short channel, Function** channelsData, Modification** modificationStack)
 {
 	// Deallocating changes that were applied and then undone. A new modification means a new branching of the modifications tree, and we are only interested in the path of the tree we're currently on.
 	DeallocateModificationsNextwards((*modificationStack)->next);
 
 	// Creating a modification struct for this change.
-	Modification* modification = malloc(sizeof(Modification));
+	Modification* modification = AllocateModification();
 	modification->startSample = fromSample;
-	modification->oldFunc = CreatePartialClone(channelsData[channel], fromSample, toSample); // Recording the state of the samples that are about to be changed.
+	modification->length = toSample - fromSample + 1;
+	modification->oldFunc = NULL;
 	modification->changeType = changeType;
 	modification->changeAmount = changeAmount;
 	modification->smoothing = changeType == MULTIPLY ? smoothing : (1 - smoothing) * MAX_ADDITIVE_SMOOTHING + smoothing * MIN_ADDITIVE_SMOOTHING; // Additive smoothing is interpolated between the real allowed values.
 	modification->channel = channel;
+	modification->clampedCount = 0;
+	modification->clampedIndices = NULL;
+	modification->clampedValues = NULL;
 	modification->prev = *modificationStack;
 	modification->next = NULL;
 
-	// Exiting if malloc failed. Note that by doing this after deallocating next modifications, we lose them but if we switch the order, allocating memory may fail where it would otherwise succeed.
-	if (modification->oldFunc == NULL)
+	// Most changes don't need the old samples recorded, because applying the inverse calculation brings them back. Multiplications with a positive amount divide back,
+	// but zero or negative amounts can flatten samples irrecoverably so those still clone the whole range. Additions subtract back, except for samples that the clamp
+	// at zero magnitude flattened - those lose their phase, and RecordClampedSamples stores just them. Note that by allocating after deallocating next modifications,
+	// we lose them on failure, but if we switch the order, allocating memory may fail where it would otherwise succeed.
+	if (changeType == ADD)
 	{
-		return FALSE;
+		if (!RecordClampedSamples(channelsData, modification))
+		{
+			return FALSE;
+		}
+	}
+	else if (changeAmount <= 0.0)
+	{
+		modification->oldFunc = CreatePartialClone(channelsData[channel], fromSample, toSample); // Recording the state of the samples that are about to be changed.
+
+		if (modification->oldFunc == NULL)
+		{
+			return FALSE;
+		}
 	}
 
 	// Assigning this change to the new top of the stack.
@@ -426,15 +1805,15 @@ char ApplyModification(unsigned long long fromSample, unsigned long long toSampl
 	*modificationStack = modification;
 
 	// This actually makes the change in the channel data.
-	ApplyModificationInternal(channelsData, modification);
+	ApplyModificationInternal(channelsData, modification, FALSE);
 	return TRUE;
 }
 
-void ApplyModificationInternal(Function** channelsData, Modification* modification)
+void ApplyModificationInternal(Function** channelsData, Modification* modification, char invert)
 {
 	#define APPLY_MODIFICATION_INTERNAL_TYPED(precision)																											\
 	Function_##precision##Complex channelData = *(((Function_##precision##Complex**)channelsData)[modification->channel]);											\
-	unsigned long long length = NumOfSamples(modification->oldFunc);																								\
+	unsigned long long length = modification->length;																												\
 	unsigned long long startSample = modification->startSample;																										\
 	unsigned long long endSample = startSample + length - 1;																										\
 	precision##Real smoothing = modification->smoothing, changeAmount = modification->changeAmount;																	\
@@ -454,12 +1833,39 @@ void ApplyModificationInternal(Function** channelsData, Modification* modificati
 		/* The function we use is piecewise so we'll apply it in two parts.*/																						\
 		/* In the first part, 0 <= n < tukeyWidth, w[n] and w[length - 1 - n] are equal to 0.5 - 0.5 * cos(piDivWidth * n)).*/										\
 		/* We want the multiplication to apply the changeAmount at its peak and 1 at the edges. So the real multiplier is 1 + (changeAmount - 1) * w[n].*/			\
-		for (i = 0; i < plateauStart; i++)																															\
+		/* The kernel builds the window with a cosine recurrence instead of calling cos for every sample, and dividing instead of multiplying undoes it.*/			\
+		if (simdKernelsUsable)																																		\
+		{																																							\
+			i = 0;																																					\
+																																									\
+			while (i < plateauStart)																																\
+			{																																						\
+				unsigned long long runLength = MinIndex(plateauStart - i, StridedRunLength(startSample + i, 1, channelData.segmentLen));							\
+				runLength = MinIndex(runLength, StridedRunLength(endSample - i, -1, channelData.segmentLen));														\
+				TukeyRamp_##precision##Complex(&get(channelData, startSample + i), &get(channelData, endSample - i), piDivWidth * i, piDivWidth,					\
+											   changeAmountMinusOne, invert, runLength);																			\
+				i += runLength;																																		\
+			}																																						\
+		}																																							\
+		else																																						\
 		{																																							\
-			precision##Real multiplier = CAST(1.0, precision##Real) + (changeAmountMinusOne *																		\
-				(CAST(0.5, precision##Real) - (CAST(0.5, precision##Real) * cos_##precision##Real(piDivWidth * i))));												\
-			get(channelData, startSample + i) *= multiplier;																										\
-			get(channelData, endSample - i) *= multiplier; /* Applying the change symmetrically.*/																	\
+			for (i = 0; i < plateauStart; i++)																														\
+			{																																						\
+				precision##Real multiplier = CAST(1.0, precision##Real) + (changeAmountMinusOne *																	\
+					(CAST(0.5, precision##Real) - (CAST(0.5, precision##Real) * cos_##precision##Real(piDivWidth * i))));											\
+																																									\
+				/* Undoing a multiplication means dividing it back out.*/																							\
+				if (invert)																																			\
+				{																																					\
+					get(channelData, startSample + i) /= multiplier;																								\
+					get(channelData, endSample - i) /= multiplier; /* Applying the change symmetrically.*/															\
+				}																																					\
+				else																																				\
+				{																																					\
+					get(channelData, startSample + i) *= multiplier;																								\
+					get(channelData, endSample - i) *= multiplier;																									\
+				}																																					\
+			}																																						\
 		}																																							\
 																																									\
 		/* This is the highest sample index that wasn't covered by the previous loop. We want to apply the next part for all remaining samples up to this one.*/	\
@@ -469,39 +1875,63 @@ void ApplyModificationInternal(Function** channelsData, Modification* modificati
 		/* We don't really bother with the math for what indices to apply it to. We just apply it to all indices that weren't affected by the previous part.*/		\
 		for (; i <= plateauEnd; i++)																																\
 		{																																							\
-			get(channelData, startSample + i) *= changeAmount;																										\
+			if (invert)																																				\
+			{																																						\
+				get(channelData, startSample + i) /= changeAmount;																									\
+			}																																						\
+			else																																					\
+			{																																						\
+				get(channelData, startSample + i) *= changeAmount;																									\
+			}																																						\
 		}																																							\
 	}																																								\
 	else /* Additive change. This can be either add or subtract.*/																									\
 	{																																								\
-		/* Caching a few things first.*/																															\
+		/* Caching a few things first. Undoing an addition means subtracting it back, so inverting just flips the amount's sign.*/									\
 		unsigned long long halfLength = length / 2;																													\
 		precision##Real highestIndex = length - 1;																													\
+		changeAmount = invert ? -changeAmount : changeAmount;																										\
 																																									\
 		/* In this loop we apply the addition symmetrically for all samples except the middle one, if there's an odd number of samples.*/							\
-		for (unsigned long long i = 0; i < halfLength; i++)																											\
+		/* The additions come out of the shared chunk helpers so this clamps exactly the samples RecordClampedSamples says it will.*/								\
+		unsigned long long i = 0;																																	\
+																																									\
+		while (i < halfLength)																																		\
 		{																																							\
-			/* Calculating the magnitude we want to add.*/																											\
-			/* The function we follow is exp(-((2n/N - 1) / smoothing)^2)*/																							\
-			precision##Real addition = changeAmount * exp_##precision##Real(-Square##precision##Real((((2 * i) / highestIndex) - 1) / smoothing));					\
+			precision##Real additions[ADDITIVE_CHUNK_LEN];																											\
+			unsigned long long runLength = AdditiveRunLength_##precision##Complex(channelData, i, halfLength, startSample, endSample);								\
+			ComputeAdditions_##precision##Real(additions, i, runLength, highestIndex, smoothing, changeAmount);														\
 																																									\
-			/* Getting the samples we want to add to.*/																												\
-			precision##Real val1 = get(channelData, startSample + i);																								\
-			precision##Real val2 = get(channelData, endSample - i);																									\
+			/* The kernel scales each sample by the ratio of its new magnitude to its old one, which keeps the phase without ever computing it.*/					\
+			if (simdKernelsUsable)																																	\
+			{																																						\
+				MagnitudeAdd_##precision##Complex(&get(channelData, startSample + i), &get(channelData, endSample - i), additions, runLength);						\
+			}																																						\
+			else																																					\
+			{																																						\
+				for (unsigned long long n = 0; n < runLength; n++)																									\
+				{																																					\
+					/* Getting the samples we want to add to.*/																										\
+					precision##Complex val1 = get(channelData, startSample + i + n);																				\
+					precision##Complex val2 = get(channelData, endSample - i - n);																					\
 																																									\
-			/* Calculating the new magnitudes of the samples, which are the old ones + the addition clamped at 0.*/													\
-			precision##Real magnitude1 = Clamp##precision(abs_##precision##Complex(val1) + addition, 0.0, INFINITY);												\
-			precision##Real magnitude2 = Clamp##precision(abs_##precision##Complex(val2) + addition, 0.0, INFINITY);												\
+					/* Calculating the new magnitudes of the samples, which are the old ones + the addition clamped at 0.*/											\
+					precision##Real magnitude1 = Clamp##precision(abs_##precision##Complex(val1) + additions[n], 0.0, INFINITY);									\
+					precision##Real magnitude2 = Clamp##precision(abs_##precision##Complex(val2) + additions[n], 0.0, INFINITY);									\
 																																									\
-			/* Setting the samples to have the same phase as before but with the new magnitudes.*/																	\
-			get(channelData, startSample + i) = PolarToCartesian_##precision##Complex(magnitude1, carg_##precision##Complex(val1));									\
-			get(channelData, endSample - i) = PolarToCartesian_##precision##Complex(magnitude2, carg_##precision##Complex(val2));	 								\
+					/* Setting the samples to have the same phase as before but with the new magnitudes.*/															\
+					get(channelData, startSample + i + n) = PolarToCartesian_##precision##Complex(magnitude1, carg_##precision##Complex(val1));						\
+					get(channelData, endSample - i - n) = PolarToCartesian_##precision##Complex(magnitude2, carg_##precision##Complex(val2));						\
+				}																																					\
+			}																																						\
+																																									\
+			i += runLength;																																			\
 		}																																							\
 																																									\
 		/* If there's an odd number of samples, we have to apply the middle sample separately so we don't double-dip.*/												\
 		if (length % 2 == 1)																																		\
 		{																																							\
-			precision##Real val = get(channelData, startSample + halfLength);																						\
+			precision##Complex val = get(channelData, startSample + halfLength);																					\
 			precision##Real magnitude = Clamp##precision(abs_##precision##Complex(val) + changeAmount, 0.0, INFINITY);												\
 			get(channelData, startSample + halfLength) = PolarToCartesian_##precision##Complex(magnitude, carg_##precision##Complex(val));							\
 		}																																							\
@@ -527,7 +1957,7 @@ char RedoLastModification(Function** channelsData, Modification** modificationSt
 		Modification* next = current->next;
 
 		// Applying the modification again.
-		ApplyModificationInternal(channelsData, next);
+		ApplyModificationInternal(channelsData, next, FALSE);
 
 		// Assigning this modification as our current position on the stack.
 		*modificationStack = next;
@@ -545,8 +1975,17 @@ char UndoLastModification(Function** channelsData, Modification** modificationSt
 	{
 		Modification* prev = current->prev;
 
-		// Restoring the backed up values back into the channel data.
-		CopySamples(channelsData[current->channel], current->oldFunc, current->startSample, 0, NumOfSamples(current->oldFunc));
+		// Modifications that have the old samples backed up get them copied back in. The rest get undone by applying their inverse,
+		// plus restoring the few samples whose old values had to be stored because the clamp at zero magnitude flattened them.
+		if (current->oldFunc != NULL)
+		{
+			CopySamples(channelsData[current->channel], current->oldFunc, current->startSample, 0, current->length);
+		}
+		else
+		{
+			ApplyModificationInternal(channelsData, current, TRUE);
+			RestoreClampedSamples(channelsData, current);
+		}
 
 		// Assigning the last modification as our current position on the stack.
 		*modificationStack = prev;
@@ -613,7 +2052,7 @@ char IsRedoable(Modification* modificationStack, Modification* modification)
 void InitializeModificationStack(Modification** modificationStack)
 {
 	// The stack is initialized with an empty modification that represents the point before any changes were made.
-	*modificationStack = calloc(1, sizeof(Modification));
+	*modificationStack = AllocateModification();
 }
 
 void DeallocateModificationStack(Modification* modificationStack)
@@ -657,5 +2096,12 @@ void DeallocateModification(Modification* modification)
 		free(modification->oldFunc);
 	}
 
-	free(modification);
+	if (modification->clampedValues != NULL)
+	{
+		DeallocateFunctionInternals(modification->clampedValues);
+		free(modification->clampedValues);
+	}
+
+	free(modification->clampedIndices);
+	SlabPoolFree(modificationPool, modification);
 }
\ No newline at end of file
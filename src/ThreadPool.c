@@ -0,0 +1,253 @@
+// Fourier - a program for modifying the weights of different frequencies in a wave file.
+// Copyright (C) 2020 Aviv Edery.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ThreadPool.h"
+#include "MyUtils.h"
+#include <windows.h>	// For threads, critical sections, condition variables.
+#include <process.h>	// For _beginthreadex, which unlike CreateThread plays nice with the CRT.
+#include <stdlib.h>		// For malloc and such.
+#include <stdio.h>		// For logging errors.
+
+// Ranges shorter than this aren't worth waking the workers up for, we just run them on the calling thread.
+#define MIN_PARALLEL_RANGE 64
+
+// How many chunks we split a range into per participating thread. More than 1 so that threads which finish early can steal some slack from slower ones.
+#define CHUNKS_PER_THREAD 4
+
+struct ThreadPool
+{
+	HANDLE* threads;					// Handles to the worker threads so we can join them on shutdown.
+	unsigned int threadCount;			// How many worker threads there are. Parallelism is threadCount + 1 because the dispatching thread works too.
+	CRITICAL_SECTION lock;				// Guards every field below it.
+	CONDITION_VARIABLE workAvailable;	// Signaled when a new job is dispatched (and on shutdown).
+	CONDITION_VARIABLE workDone;		// Signaled when the last chunk of a job completes.
+	unsigned long generation;			// Incremented per dispatched job so workers can tell a new job apart from the one they just finished.
+	ThreadPoolJob job;					// The job currently being run, or NULL when idle.
+	void* context;						// The context to pass to the job.
+	unsigned long long rangeBegin;		// The start of the range the current job runs over.
+	unsigned long long rangeEnd;		// The end (exclusive) of the range the current job runs over.
+	unsigned long long chunkLen;		// The length of the chunks the current range is split into.
+	unsigned long long nextChunkBegin;	// The start of the next chunk that hasn't been claimed by any thread yet.
+	unsigned int chunksRemaining;		// How many claimed chunks haven't completed yet. The job is done when this is 0 and there's nothing left to claim.
+	char shuttingDown;					// Set when the pool is being destroyed, to make the workers exit.
+};
+
+// Nonzero on threads which are pool workers. Used to detect nested ParallelFor calls, which run serially instead of deadlocking on the pool.
+static __thread char isPoolWorker = FALSE;
+
+// Nonzero while a thread is in the middle of dispatching a job. Nested ParallelFor calls the dispatching thread makes while chipping in on its
+// own job have to run serially too, because the pool only runs one job at a time.
+static __thread char isDispatching = FALSE;
+
+// Claims and runs chunks of the current job until the whole range is covered. Must be called with the lock held, returns with it held.
+static void WorkOnCurrentJob(ThreadPool* pool)
+{
+	while (pool->nextChunkBegin < pool->rangeEnd)
+	{
+		// Claiming the next chunk while we hold the lock.
+		unsigned long long chunkBegin = pool->nextChunkBegin;
+		unsigned long long chunkEnd = min(chunkBegin + pool->chunkLen, pool->rangeEnd);
+		pool->nextChunkBegin = chunkEnd;
+		pool->chunksRemaining++;
+
+		// Running the chunk without the lock so other threads can claim chunks meanwhile.
+		LeaveCriticalSection(&(pool->lock));
+		pool->job(pool->context, chunkBegin, chunkEnd);
+		EnterCriticalSection(&(pool->lock));
+
+		pool->chunksRemaining--;
+	}
+
+	// Waking the dispatcher if we were the last to finish. It's possible that we finished a chunk while another thread still runs one, in which case that thread will do the waking.
+	if (pool->chunksRemaining == 0)
+	{
+		WakeAllConditionVariable(&(pool->workDone));
+	}
+}
+
+static unsigned int __stdcall ThreadPoolWorker(void* arg)
+{
+	ThreadPool* pool = arg;
+	unsigned long lastGeneration = 0;
+	isPoolWorker = TRUE;
+
+	EnterCriticalSection(&(pool->lock));
+
+	while (TRUE)
+	{
+		// Sleeping until there's a job we haven't worked on yet, or we're being shut down.
+		while (!pool->shuttingDown && pool->generation == lastGeneration)
+		{
+			SleepConditionVariableCS(&(pool->workAvailable), &(pool->lock), INFINITE);
+		}
+
+		if (pool->shuttingDown)
+		{
+			break;
+		}
+
+		lastGeneration = pool->generation;
+		WorkOnCurrentJob(pool);
+	}
+
+	LeaveCriticalSection(&(pool->lock));
+	return 0;
+}
+
+ThreadPool* CreateThreadPool(unsigned int threadCount)
+{
+	// 0 means the caller wants one worker per logical processor.
+	if (threadCount == 0)
+	{
+		SYSTEM_INFO sysInfo;
+		GetSystemInfo(&sysInfo);
+
+		// The calling thread participates in the work too, so we spawn one less worker than there are processors.
+		threadCount = sysInfo.dwNumberOfProcessors > 1 ? sysInfo.dwNumberOfProcessors - 1 : 0;
+	}
+
+	// A pool with no workers would make ParallelFor serial anyway, and NULL pools already mean exactly that.
+	if (threadCount == 0)
+	{
+		return NULL;
+	}
+
+	ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+
+	if ((pool->threads = calloc(threadCount, sizeof(HANDLE))) == NULL)
+	{
+		free(pool);
+		return NULL;
+	}
+
+	InitializeCriticalSection(&(pool->lock));
+	InitializeConditionVariable(&(pool->workAvailable));
+	InitializeConditionVariable(&(pool->workDone));
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		pool->threads[i] = (HANDLE)_beginthreadex(NULL, 0, ThreadPoolWorker, pool, 0, NULL);
+
+		// If we can't spawn all the threads we wanted, we make do with the ones we've got.
+		if (pool->threads[i] == NULL)
+		{
+			fprintf(stderr, "Only managed to spawn %u of %u pool workers.\n", i, threadCount);
+			break;
+		}
+
+		pool->threadCount++;
+	}
+
+	// If we couldn't spawn any workers at all, the pool is useless.
+	if (pool->threadCount == 0)
+	{
+		DestroyThreadPool(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void DestroyThreadPool(ThreadPool* pool)
+{
+	if (pool == NULL)
+	{
+		return;
+	}
+
+	// Telling the workers to exit, and waking them all up so they notice.
+	EnterCriticalSection(&(pool->lock));
+	pool->shuttingDown = TRUE;
+	WakeAllConditionVariable(&(pool->workAvailable));
+	LeaveCriticalSection(&(pool->lock));
+
+	for (unsigned int i = 0; i < pool->threadCount; i++)
+	{
+		WaitForSingleObject(pool->threads[i], INFINITE);
+		CloseHandle(pool->threads[i]);
+	}
+
+	DeleteCriticalSection(&(pool->lock));
+	free(pool->threads);
+	free(pool);
+}
+
+unsigned int GetThreadPoolParallelism(ThreadPool* pool)
+{
+	return pool == NULL ? 1 : pool->threadCount + 1;
+}
+
+static void ParallelForInternal(ThreadPool* pool, ThreadPoolJob job, void* context, unsigned long long begin, unsigned long long end,
+								unsigned long long minParallelRange)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	// Running serially when there's no pool to dispatch to, the range is too short to be worth the synchronization, or this is a nested call.
+	// The last case matters because a nested ParallelFor would otherwise try to dispatch a job while one is already running.
+	if (pool == NULL || isPoolWorker || isDispatching || end - begin < minParallelRange)
+	{
+		job(context, begin, end);
+		return;
+	}
+
+	unsigned int parallelism = pool->threadCount + 1;
+
+	isDispatching = TRUE;
+	EnterCriticalSection(&(pool->lock));
+
+	// Publishing the job for the workers. The chunk length is rounded up so chunk count doesn't exceed CHUNKS_PER_THREAD per thread.
+	pool->job = job;
+	pool->context = context;
+	pool->rangeBegin = begin;
+	pool->rangeEnd = end;
+	pool->chunkLen = DivCeilInt(end - begin, parallelism * CHUNKS_PER_THREAD);
+	pool->nextChunkBegin = begin;
+	pool->chunksRemaining = 0;
+	pool->generation++;
+	WakeAllConditionVariable(&(pool->workAvailable));
+
+	// The calling thread chips in instead of just sitting there waiting.
+	WorkOnCurrentJob(pool);
+
+	// Our part is done, but workers may still be chewing on chunks they claimed. Sleeping until the last one is done.
+	while (pool->chunksRemaining != 0)
+	{
+		SleepConditionVariableCS(&(pool->workDone), &(pool->lock), INFINITE);
+	}
+
+	pool->job = NULL;
+	LeaveCriticalSection(&(pool->lock));
+	isDispatching = FALSE;
+}
+
+void ParallelFor(ThreadPool* pool, ThreadPoolJob job, void* context, unsigned long long begin, unsigned long long end)
+{
+	ParallelForInternal(pool, job, context, begin, end, MIN_PARALLEL_RANGE);
+}
+
+void ParallelForHeavy(ThreadPool* pool, ThreadPoolJob job, void* context, unsigned long long begin, unsigned long long end)
+{
+	// A range of 1 still runs serially, there's nothing to split.
+	ParallelForInternal(pool, job, context, begin, end, 2);
+}
@@ -15,14 +15,21 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "WaveReadWriterInternal.h"
+#include "SimdKernels.h" // For the vectorized PCM converters.
+#include "Instrumentation.h" // For the self-timing macros, which are usually compiled out.
 #include <tchar.h>	 // For dealing with strings that may be unicode or ANSI.
 #include <ksmedia.h> // For the KSDATAFORMAT_SUBTYPE_PCM macro.
 #include <math.h>	 // For the min macro.
 #include <stdlib.h>	 // For malloc and such.
+#include <io.h>		 // For turning the FILE* into a handle we can map.
+#include <process.h> // For _beginthreadex, which unlike CreateThread plays nice with the CRT.
 #include <share.h>	 // For shflags to _tfsopen.
 #include <limits.h>	 // For integer max values.
 
 #define FOURCC_WAVE mmioFOURCC('W', 'A', 'V', 'E')
+#define FOURCC_RF64 mmioFOURCC('R', 'F', '6', '4')
+#define FOURCC_BW64 mmioFOURCC('B', 'W', '6', '4')
+#define FOURCC_DS64 mmioFOURCC('d', 's', '6', '4')
 #define FOURCC_FORMAT mmioFOURCC('f', 'm', 't', ' ')
 #define FOURCC_WAVL mmioFOURCC('w', 'a', 'v', 'l')
 #define FOURCC_DATA mmioFOURCC('d', 'a', 't', 'a')
@@ -41,12 +48,28 @@
 #define DEPTH_MAX(depth) ((int)(depth == 1 ? CHAR_MAX : depth == 2 ? SHRT_MAX : depth == 3 ? 0x007FFFFF : INT_MAX))
 #define DEPTH_MIN(depth) ((int)(depth == 1 ? CHAR_MIN : depth == 2 ? SHRT_MIN : depth == 3 ? 0xFF800000 : INT_MIN))
 
+// DEPTH_MAX as the given precision, for quantizing samples on the write path. Depth 4's top of range isn't representable as a float - it rounds
+// up to 2^31, which lround then overflows on - so the float version uses the biggest float below it, the same way the SIMD kernel does.
+#define DEPTH_MAX_Float(depth) (depth == 4 ? 2147483520.0f : CAST(DEPTH_MAX(depth), float))
+#define DEPTH_MAX_Double(depth) CAST(DEPTH_MAX(depth), double)
+
 // A mask where the only bit set is the most significant bit of an int with the given byte depth.
 #define DEPTH_HIGH_BIT(depth) (1 << ((depth * CHAR_BIT) - 1))
 
 // A mask where the only set bits are the ones that unavailable in an int with the given byte depth.
 #define SIGN_EXTEND_MASK(depth) (depth == 1 ? 0xFFFFFF00 : depth == 2 ? 0xFFFF0000 : depth == 3 ? 0xFF000000 : 0)
 
+// Whether the CPU we're running on supports the vectorized kernels in SimdKernels.c. Checked before every load and write, which is cheap enough.
+static char simdKernelsUsable = FALSE;
+
+// Whether files get loaded into the single precision pipeline even when their byte depth would normally pick double. See LoadPCMInterleaved.
+static char singlePrecisionProcessing = FALSE;
+
+void SetSinglePrecisionProcessing(char enabled)
+{
+	singlePrecisionProcessing = enabled;
+}
+
 void AllocateWaveFile(FileInfo** fileInfo, LPCTSTR path)
 {
 	*fileInfo = calloc(1, sizeof(FileInfo));
@@ -102,16 +125,27 @@ ReadWaveResult ReadWaveFile(FileInfo** fileInfo, LPCTSTR path)
 
 	// Reading the opening part of the file. This includes the RIFF character code, the file size, and the WAVE character code. After this there's all the subchunks.
 	// If we read it successfully we also verify that it has the right values in this header.
-	if (fread(&((*fileInfo)->header), sizeof(WaveHeader), 1, file) == 1 && (*fileInfo)->header.chunkHeader.id == FOURCC_RIFF && (*fileInfo)->header.id == FOURCC_WAVE)
+	if (fread(&((*fileInfo)->header), sizeof(WaveHeader), 1, file) == 1 && (*fileInfo)->header.id == FOURCC_WAVE &&
+		((*fileInfo)->header.chunkHeader.id == FOURCC_RIFF || (*fileInfo)->header.chunkHeader.id == FOURCC_RF64 || (*fileInfo)->header.chunkHeader.id == FOURCC_BW64))
 	{
-		// Verifying that the file size is as described. This has the (much desired) effect of also verifying that the file size doesn't exceed 4GB, which we'll rely on when we use functions like fseek from now on.
+		// RF64 (and its BW64 twin) is how WAVE files outgrow their 32-bit size fields: the header sizes get parked at 0xFFFFFFFF and the real 64-bit ones move to a ds64 chunk.
+		(*fileInfo)->isRF64 = (*fileInfo)->header.chunkHeader.id != FOURCC_RIFF;
+		(*fileInfo)->riffSize = (*fileInfo)->header.chunkHeader.size;
+
+		// Verifying that the file size is as described. For RIFF files this has the (much desired) effect of also verifying that the file size doesn't exceed 4GB.
+		// RF64 files can be as big as they want, since every bit of seek logic from here on is 64-bit.
 		_fseeki64(file, 0, SEEK_END);
+		__int64 fileSize = _ftelli64(file);
 
-		if (_ftelli64(file) - sizeof(ChunkHeader) == (*fileInfo)->header.chunkHeader.size)
+		if ((*fileInfo)->isRF64 && !ReadDS64Chunk(*fileInfo))
+		{
+			result = FILE_BAD_WAVE;
+		}
+		else if (fileSize - sizeof(ChunkHeader) == (*fileInfo)->riffSize)
 		{
 			// Now we're gonna search for the chunks listed below. The rest aren't relevant to us.
 			// The variables are initialized to 0 because it is a value they can't possibly get otherwise, and it'll help us determine which chunks were found later on.
-			DWORD formatChunk = 0, waveformChunk = 0;
+			unsigned long long formatChunk = 0, waveformChunk = 0;
 			result |= FindImportantChunks(*fileInfo, &formatChunk, &waveformChunk);
 
 			// Now we have the positions of all the relevant chunks and we know about which ones don't exist. Verifying some constraints about chunks that must exist, sometimes under certain conditions.
@@ -133,7 +167,7 @@ ReadWaveResult ReadWaveFile(FileInfo** fileInfo, LPCTSTR path)
 		}
 		else
 		{
-			fprintf(stderr, "File size is %lld while it says it should be %lu.\n", _ftelli64(file) - sizeof(ChunkHeader), (*fileInfo)->header.chunkHeader.size);
+			fprintf(stderr, "File size is %lld while it says it should be %llu.\n", fileSize - (__int64)sizeof(ChunkHeader), (*fileInfo)->riffSize);
 			result = FILE_BAD_SIZE;
 		}
 	}
@@ -152,7 +186,33 @@ ReadWaveResult ReadWaveFile(FileInfo** fileInfo, LPCTSTR path)
 	return result;
 }
 
-ReadWaveResult FindImportantChunks(FileInfo* fileInfo, DWORD* formatChunk, DWORD* waveDataChunk)
+char ReadDS64Chunk(FileInfo* fileInfo)
+{
+	FILE* file = fileInfo->file;
+	ChunkHeader header;
+	_fseeki64(file, sizeof(WaveHeader), SEEK_SET);
+
+	// The specification says the ds64 chunk comes first, right after the 'WAVE' FOURCC, so that's the only place we look.
+	if (fread(&header, sizeof(ChunkHeader), 1, file) != 1 || header.id != FOURCC_DS64 || header.size < (3 * sizeof(unsigned long long)) + sizeof(DWORD))
+	{
+		fprintf(stderr, "RF64 file doesn't lead with a valid ds64 chunk.\n");
+		return FALSE;
+	}
+
+	// The chunk opens with the 64-bit file, data and sample-count sizes, then a table that sizes other chunks we don't touch, so only the start gets read.
+	unsigned long long sizes[3];
+
+	if (fread(sizes, sizeof(sizes), 1, file) != 1)
+	{
+		return FALSE;
+	}
+
+	fileInfo->riffSize = sizes[0];
+	fileInfo->dataSize = sizes[1]; // sizes[2] is the sample count, which gets derived from the byte sizes instead, same as for RIFF files.
+	return TRUE;
+}
+
+ReadWaveResult FindImportantChunks(FileInfo* fileInfo, unsigned long long* formatChunk, unsigned long long* waveDataChunk)
 {
 	// Counters for how many of each chunk we have, because it's a problem if there's more than 1 of anything.
 	int formatChunks = 0, waveDataChunks = 0;
@@ -174,7 +234,7 @@ ReadWaveResult FindImportantChunks(FileInfo* fileInfo, DWORD* formatChunk, DWORD
 			return FILE_BAD_WAVE;
 		}
 
-		DWORD chunkPos = (DWORD)(_ftelli64(file) - sizeof(ChunkHeader));
+		unsigned long long chunkPos = (unsigned long long)(_ftelli64(file) - sizeof(ChunkHeader));
 
 		// Here we use the chunk ID to determine if it's a chunk we're interested in, and storing its position in the file if it is.
 		switch (chunk.id)
@@ -211,8 +271,10 @@ ReadWaveResult FindImportantChunks(FileInfo* fileInfo, DWORD* formatChunk, DWORD
 
 		// Now to set the file position such that it points to where the next chunk starts.
 		// To do this we have to consider that chunks with odd lengths have a padding byte at the end.
+		// An RF64 data chunk's own size field is stuck at 0xFFFFFFFF, so the real size from the ds64 chunk is what moves us past it.
 		// Note that size == 0 doesn't result in an infinite loop because in each iteration we at least move sizeof(ChunkHeader) when we call fread.
-		__int64 nextPosOffset = chunk.size + (chunk.size % 2);
+		unsigned long long chunkSize = fileInfo->isRF64 && chunk.id == FOURCC_DATA && chunk.size == 0xFFFFFFFF ? fileInfo->dataSize : chunk.size;
+		__int64 nextPosOffset = chunkSize + (chunkSize % 2);
 		_fseeki64(file, nextPosOffset, SEEK_CUR);
 	}
 
@@ -225,7 +287,7 @@ ReadWaveResult FindImportantChunks(FileInfo* fileInfo, DWORD* formatChunk, DWORD
 	return result;
 }
 
-char ReadFormatChunk(FileInfo* fileInfo, DWORD chunkOffset)
+char ReadFormatChunk(FileInfo* fileInfo, unsigned long long chunkOffset)
 {
 	FILE* file = fileInfo->file;
 	_fseeki64(file, chunkOffset, SEEK_SET);
@@ -233,7 +295,7 @@ char ReadFormatChunk(FileInfo* fileInfo, DWORD chunkOffset)
 	return fread(&(fileInfo->format.contents), min(sizeof(WAVEFORMATEXTENSIBLE), (size_t)fileInfo->format.header.size), 1, file) == 1;
 }
 
-char ReadWaveformChunk(FileInfo* fileInfo, DWORD chunkOffset)
+char ReadWaveformChunk(FileInfo* fileInfo, unsigned long long chunkOffset)
 {
 	FILE* file = fileInfo->file;
 	_fseeki64(file, chunkOffset, SEEK_SET);
@@ -260,7 +322,7 @@ char ReadWaveformChunk(FileInfo* fileInfo, DWORD chunkOffset)
 			}
 			else // Don't allow waveform segments that aren't recognized.
 			{
-				fprintf(stderr, "Unsupported data segment detected at offset: %lld.\n", chunkOffset + sizeof(ChunkHeader) + sizeof(FOURCC) + currentPos);
+				fprintf(stderr, "Unsupported data segment detected at offset: %llu.\n", chunkOffset + sizeof(ChunkHeader) + sizeof(FOURCC) + currentPos);
 				return FALSE;
 			}
 
@@ -297,6 +359,7 @@ char ReadWaveformChunk(FileInfo* fileInfo, DWORD chunkOffset)
 			}
 
 			segments[i].header = segmentHeader;
+			segments[i].size = segmentHeader.size; // Lists stay 32-bit. RF64 files always use a single data chunk, which is the only thing that can outgrow its size field.
 			segments[i].relativeOffset = currentPos;
 
 			// Moving to next.
@@ -320,6 +383,7 @@ char ReadWaveformChunk(FileInfo* fileInfo, DWORD chunkOffset)
 	{
 		WaveformSegment* segments = malloc(sizeof(WaveformSegment));
 		fread(&(segments->header), sizeof(ChunkHeader), 1, file);
+		segments->size = fileInfo->isRF64 && segments->header.size == 0xFFFFFFFF ? fileInfo->dataSize : segments->header.size;
 		segments->relativeOffset = 0;
 
 		fileInfo->waveform.offset = chunkOffset;
@@ -461,7 +525,7 @@ ReadWaveResult ValidateWaveform(FileInfo* fileInfo)
 	else
 	{
 		// Verifying is that the file doesn't end before the chunk does. For lists, we had to verify that while reading them.
-		if (fileInfo->waveform.offset + fileInfo->waveform.segments[0].header.size > fileInfo->header.chunkHeader.size)
+		if (fileInfo->waveform.offset + fileInfo->waveform.segments[0].size > fileInfo->riffSize)
 		{
 			fprintf(stderr, "File ends before the data chunk says it should.\n");
 			return FILE_BAD_WAVE;
@@ -486,13 +550,13 @@ unsigned long long CountSampleLength(FileInfo* fileInfo)
 			// Only counting data chunks, because silence chunks are ignored.
 			if (segments[i].header.id == FOURCC_DATA)
 			{
-				sum += segments[i].header.size;
+				sum += segments[i].size;
 			}
 		}
 	}
 	else
 	{
-		sum = fileInfo->waveform.segments[0].header.size;
+		sum = fileInfo->waveform.segments[0].size;
 	}
 
 	// The amount of samples per channel is the data byte size divided by the bytes per block.
@@ -516,6 +580,9 @@ void CreateNewFile(FileInfo** fileInfo, unsigned int length, unsigned int freque
 	(*fileInfo)->header.chunkHeader.id = FOURCC_RIFF;
 	(*fileInfo)->header.chunkHeader.size = sizeof(FOURCC) + sizeof(FormatChunk) + sizeof(ChunkHeader) + dataLength + (dataLength % 2);
 	(*fileInfo)->header.id = FOURCC_WAVE;
+	(*fileInfo)->isRF64 = FALSE;
+	(*fileInfo)->riffSize = (*fileInfo)->header.chunkHeader.size;
+	(*fileInfo)->dataSize = dataLength;
 
 	// Configuring format chunk to a WAVE_FORMAT_EXTENSIBLE chunk with subtype PCM, mono and with parameters as given.
 	(*fileInfo)->format.header.id = FOURCC_FORMAT;
@@ -540,6 +607,7 @@ void CreateNewFile(FileInfo** fileInfo, unsigned int length, unsigned int freque
 	(*fileInfo)->waveform.segments = malloc(sizeof(WaveformSegment));
 	(*fileInfo)->waveform.segments[0].header.id = FOURCC_DATA;
 	(*fileInfo)->waveform.segments[0].header.size = dataLength;
+	(*fileInfo)->waveform.segments[0].size = dataLength;
 	(*fileInfo)->waveform.segments[0].relativeOffset = 0;
 
 	// Setting the sample length for the file.
@@ -548,12 +616,182 @@ void CreateNewFile(FileInfo** fileInfo, unsigned int length, unsigned int freque
 
 #pragma endregion // Opening.
 
-char LoadPCMInterleaved(FileInfo* fileInfo, Function*** channelsData)
+// Maps the entire file into memory. RIFF files can't exceed 4GB (we verify that when reading them), and RF64 files that do still fit comfortably in a 64-bit address space.
+BYTE* MapWaveFile(FILE* file, HANDLE* mapping)
 {
-	// This macro is basically this entire function, except for all the different byte depths we can have.
-	#define LOAD_PCM_INTERLEAVED_TYPED(precision, depth)																																	\
-	/* This declaration needs to be made inside the macro, but the variable name has to be distinct per macro call to not piss off gcc so we append the depth.*/							\
-	Function_##precision##Real funcs[relevantChannels];																																	\
+	*mapping = NULL;
+
+	// Flushing first so the view and the CRT's buffers agree on the file's contents.
+	fflush(file);
+	HANDLE fileHandle = (HANDLE)_get_osfhandle(_fileno(file));
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+
+	if ((*mapping = CreateFileMapping(fileHandle, NULL, PAGE_READWRITE, 0, 0, NULL)) == NULL)
+	{
+		fprintf(stderr, "CreateFileMapping failed with error code: 0x%lX.\n", GetLastError());
+		return NULL;
+	}
+
+	BYTE* view = MapViewOfFile(*mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (view == NULL)
+	{
+		fprintf(stderr, "MapViewOfFile failed with error code: 0x%lX.\n", GetLastError());
+		CloseHandle(*mapping);
+		*mapping = NULL;
+	}
+
+	return view;
+}
+
+void UnmapWaveFile(BYTE* view, HANDLE mapping)
+{
+	if (view != NULL)
+	{
+		UnmapViewOfFile(view);
+	}
+
+	if (mapping != NULL)
+	{
+		CloseHandle(mapping);
+	}
+}
+
+// The handshake state between a load or save and the I/O thread it spins up, so the disk can chew on one run of blocks while another one converts.
+typedef struct
+{
+	HANDLE osFile;				// The Win32 handle under the FILE* the pipeline works on. Both threads use positioned I/O on it, so the shared file pointer never moves.
+	HANDLE thread;				// The I/O thread itself.
+	HANDLE workReady;			// Signaled when a run is staged and ready for the I/O thread.
+	HANDLE workDone;			// Signaled when the I/O thread has finished the staged run.
+	BYTE* blocks;				// The staged run of blocks to read or write.
+	DWORD bytes;				// How many bytes the staged run holds.
+	unsigned long long offset;	// Where in the file the staged run lives.
+	char reads;					// Whether the I/O thread reads runs from the file instead of writing them.
+	char transferPending;		// Whether a staged run hasn't been waited out yet.
+	char shutDown;				// Tells the I/O thread to exit instead of waiting for another run.
+	char succeeded;				// Whether every transfer so far went through fine.
+} BlockCourier;
+
+// Reads bytes from the file at the given offset without moving the shared file pointer, so it can't trip over a transfer that's in flight elsewhere in the file.
+static char ReadFileAt(HANDLE file, void* buffer, DWORD bytes, unsigned long long offset)
+{
+	OVERLAPPED position = {0};
+	position.Offset = (DWORD)offset;
+	position.OffsetHigh = (DWORD)(offset >> (sizeof(DWORD) * CHAR_BIT));
+
+	DWORD bytesRead = 0;
+	return ReadFile(file, buffer, bytes, &bytesRead, &position) && bytesRead == bytes;
+}
+
+// Same as ReadFileAt, but writing.
+static char WriteFileAt(HANDLE file, void* buffer, DWORD bytes, unsigned long long offset)
+{
+	OVERLAPPED position = {0};
+	position.Offset = (DWORD)offset;
+	position.OffsetHigh = (DWORD)(offset >> (sizeof(DWORD) * CHAR_BIT));
+
+	DWORD bytesWritten = 0;
+	return WriteFile(file, buffer, bytes, &bytesWritten, &position) && bytesWritten == bytes;
+}
+
+// The loop the I/O thread runs: wait for a staged run, move it between its buffer and where it belongs in the file, report back, repeat.
+static unsigned int __stdcall BlockCourierProcedure(void* context)
+{
+	BlockCourier* courier = (BlockCourier*)context;
+
+	for (;;)
+	{
+		WaitForSingleObject(courier->workReady, INFINITE);
+
+		if (courier->shutDown)
+		{
+			return 0;
+		}
+
+		INSTRUMENT_BEGIN(IO);
+
+		if (!(courier->reads ? ReadFileAt(courier->osFile, courier->blocks, courier->bytes, courier->offset)
+			: WriteFileAt(courier->osFile, courier->blocks, courier->bytes, courier->offset)))
+		{
+			courier->succeeded = FALSE;
+		}
+
+		INSTRUMENT_END(IO);
+		INSTRUMENT_COUNT(IO, courier->bytes);
+		SetEvent(courier->workDone);
+	}
+}
+
+// Spins up the I/O thread for the given file. Returns zero iff something couldn't be created - StopBlockCourier cleans up whatever part did get created.
+static char StartBlockCourier(BlockCourier* courier, FILE* file, char reads)
+{
+	// Flushing first so nothing the CRT buffered can land in the middle of our positioned I/O.
+	fflush(file);
+	courier->osFile = (HANDLE)_get_osfhandle(_fileno(file));
+	courier->reads = reads;
+	courier->succeeded = TRUE;
+
+	return courier->osFile != INVALID_HANDLE_VALUE &&
+		(courier->workReady = CreateEvent(NULL, FALSE, FALSE, NULL)) != NULL &&
+		(courier->workDone = CreateEvent(NULL, FALSE, FALSE, NULL)) != NULL &&
+		(courier->thread = (HANDLE)_beginthreadex(NULL, 0, BlockCourierProcedure, courier, 0, NULL)) != NULL;
+}
+
+// Waits out the run the I/O thread currently has, if any.
+static void WaitForBlockCourier(BlockCourier* courier)
+{
+	if (courier->transferPending)
+	{
+		WaitForSingleObject(courier->workDone, INFINITE);
+		courier->transferPending = FALSE;
+	}
+}
+
+// Hands a run of blocks off to the I/O thread, first waiting out the previous run. Failed transfers surface when the courier gets stopped.
+static void StageBlockTransfer(BlockCourier* courier, BYTE* blocks, DWORD bytes, unsigned long long offset)
+{
+	WaitForBlockCourier(courier);
+	courier->blocks = blocks;
+	courier->bytes = bytes;
+	courier->offset = offset;
+	courier->transferPending = TRUE;
+	SetEvent(courier->workReady);
+}
+
+// Waits out any in-flight transfer and takes the I/O thread and its events down. Returns zero iff any transfer failed along the way.
+static char StopBlockCourier(BlockCourier* courier)
+{
+	if (courier->thread != NULL)
+	{
+		WaitForBlockCourier(courier);
+		courier->shutDown = TRUE;
+		SetEvent(courier->workReady);
+		WaitForSingleObject(courier->thread, INFINITE);
+		CloseHandle(courier->thread);
+	}
+
+	if (courier->workReady != NULL)
+	{
+		CloseHandle(courier->workReady);
+	}
+
+	if (courier->workDone != NULL)
+	{
+		CloseHandle(courier->workDone);
+	}
+
+	return courier->succeeded;
+}
+
+char AllocateChannelsData(FileInfo* fileInfo, Function*** channelsData)
+{
+	// The typed part of the allocation. Structured like the other macros around here.
+	#define ALLOCATE_CHANNELS_DATA_TYPED(precision)																																			\
 	*channelsData = calloc(relevantChannels, sizeof(Function_##precision##Complex *));																										\
 																																															\
 	for (unsigned short i = 0; i < relevantChannels; i++)																																	\
@@ -562,12 +800,35 @@ char LoadPCMInterleaved(FileInfo* fileInfo, Function*** channelsData)
 																																															\
 		if (!AllocateFunctionInternals_##precision##Complex((*channelsData)[i], paddedLength / 2))																							\
 		{																																													\
-			free(buffer);																																									\
 			return FALSE;																																									\
 		}																																													\
+	}
+
+	WORD relevantChannels = GetRelevantChannelsCount(fileInfo); // The number of channels we want to load.
+	WORD containerSize = fileInfo->format.contents.Format.wBitsPerSample / 8; // The amount of bytes each sample effectively takes up.
+	WORD byteDepth = fileInfo->format.contents.Format.wFormatTag == WAVE_FORMAT_PCM ? containerSize : fileInfo->format.contents.Samples.wValidBitsPerSample / 8; // The amount of bytes each sample takes up that isn't padding.
+	unsigned long long paddedLength = max(MIN_FOURIER_LENGTH, NextMixedRadixLength(fileInfo->sampleLength)); // The same FFT-friendly length that LoadPCMInterleaved pads to.
+
+	// Picking the same precision that LoadPCMInterleaved's switch will pick for this byte depth.
+	if (byteDepth <= 2 || singlePrecisionProcessing)
+	{ ALLOCATE_CHANNELS_DATA_TYPED(Float) }
+	else
+	{ ALLOCATE_CHANNELS_DATA_TYPED(Double) }
+
+	return TRUE;
+}
+
+char LoadPCMInterleaved(FileInfo* fileInfo, Function** channelsData)
+{
+	// This macro is basically this entire function, except for all the different byte depths we can have.
+	#define LOAD_PCM_INTERLEAVED_TYPED(precision, depth)																																	\
+	/* This declaration needs to be made inside the macro, but the variable name has to be distinct per macro call to not piss off gcc so we append the depth.*/							\
+	Function_##precision##Real funcs[relevantChannels];																																		\
 																																															\
-		/* This will make the functions faster and more convenient to read and write to in interleaved form. Useful because we'll be doing that a lot.*/									\
-		funcs[i] = ReadComplexFunctionAsReal_##precision##Complex((*channelsData)[i]);																										\
+	/* This will make the functions faster and more convenient to read and write to in interleaved form. Useful because we'll be doing that a lot.*/										\
+	for (unsigned short i = 0; i < relevantChannels; i++)																																	\
+	{																																														\
+		funcs[i] = ReadComplexFunctionAsReal_##precision##Complex(channelsData[i]);																											\
 	}																																														\
 																																															\
 	/* Skipping the part where we read from the file if the file is newly created.*/																										\
@@ -579,56 +840,112 @@ char LoadPCMInterleaved(FileInfo* fileInfo, Function*** channelsData)
 			/* Silent chunks are ignored.*/																																					\
 			if (segments[i].header.id == FOURCC_DATA)																																		\
 			{																																												\
-				_fseeki64(file, ((__int64)fileInfo->waveform.offset) + segments[i].relativeOffset + sizeof(ChunkHeader), SEEK_SET);															\
-				size_t blocksInChunk = segments[i].header.size / blockAlign;																												\
+				size_t blocksInChunk = segments[i].size / blockAlign;																														\
+				unsigned long long chunkOffset = fileInfo->waveform.offset + segments[i].relativeOffset + sizeof(ChunkHeader);																\
+																																															\
+				/* With a mapped view the chunk is already sitting in memory. Otherwise the reader thread prefetches the runs into the staging buffers.*/									\
+				const BYTE* chunkBase = view != NULL ? view + chunkOffset : NULL;																											\
 																																															\
 				/* Reading PCM in chunks of buffer size and converting to complex interleaved samples until everything from this chunk has been read.*/										\
 				for (size_t blocksRead = 0; blocksRead < blocksInChunk; blocksRead += bufferBlockLen)																						\
 				{																																											\
 					size_t currentBlocks = min(bufferBlockLen, blocksInChunk - blocksRead);																									\
-					fread(buffer, blockAlign, currentBlocks, file);																															\
+					const BYTE* blocks;																																						\
+																																															\
+					/* Converting straight out of the mapped view means the data only gets touched once, on its way into the function segments.*/											\
+					if (chunkBase != NULL)																																					\
+					{																																										\
+						blocks = chunkBase + (blocksRead * blockAlign);																														\
+					}																																										\
+					else																																									\
+					{																																										\
+						/* The first run of a chunk stages its own read, since there was no previous run to have prefetched it.*/															\
+						if (blocksRead == 0)																																				\
+						{																																									\
+							StageBlockTransfer(&reader, stagingBuffers[backBuffer], currentBlocks * blockAlign, chunkOffset);																\
+						}																																									\
+																																															\
+						/* Staging the next run first waits out the read of this one, so after this the current buffer is free to convert from while the disk runs ahead of us.*/			\
+						if (blocksRead + currentBlocks < blocksInChunk)																														\
+						{																																									\
+							size_t nextBlocks = min(bufferBlockLen, blocksInChunk - (blocksRead + currentBlocks));																			\
+							StageBlockTransfer(&reader, stagingBuffers[!backBuffer], nextBlocks * blockAlign, chunkOffset + ((blocksRead + currentBlocks) * blockAlign));					\
+						}																																									\
+						else																																								\
+						{																																									\
+							WaitForBlockCourier(&reader);																																	\
+						}																																									\
+																																															\
+						blocks = stagingBuffers[backBuffer];																																\
+						backBuffer = !backBuffer;																																			\
+					}																																										\
 																																															\
 					/* Loading the data block by block.*/																																	\
-					for (size_t b = 0; b < currentBlocks; b++)																																\
+					INSTRUMENT_BEGIN(CONVERT);																																				\
+					if (simdKernelsUsable)																																					\
 					{																																										\
-						/* Loading each relevant sample in the block.*/																														\
+						/* The SIMD converters chew through the whole run of blocks one channel at a time, with the last few samples done scalar inside them.*/								\
 						for (WORD c = 0; c < relevantChannels; c++)																															\
 						{																																									\
-							/* First, we read the sample in its integer form. All byte depths get read into a 32-bit integer.*/																\
-							/* The upside of this is less repeat code and easier conversion of biased to two's complement for 8-bit PCM.*/													\
-							/* The downside is branching (which should be resolved at compile time) and we have to sign extend everything.*/												\
-							int sample = 0;																																					\
-							memcpy(&sample, buffer + (b * blockAlign) + (c * containerSize), depth);																						\
+							size_t converted = 0;																																			\
 																																															\
-							/* 8-bit files use biased representation instead of two's complement. Converting it.*/																			\
-							if (depth == 1)																																					\
+							/* A single call can't cross a boundary between two segments of the function, so long runs may take a few calls.*/												\
+							while (converted < currentBlocks)																																\
 							{																																								\
-								sample -= 128;																																				\
+								unsigned long long index = sampleIndex + converted;																											\
+								size_t runLen = min(currentBlocks - converted, funcs[c].segmentLen - (index % funcs[c].segmentLen));														\
+								ConvertPcmToReal_##precision##Real(&get(funcs[c], index), blocks + (converted * blockAlign) + (c * containerSize), runLen, depth, blockAlign);				\
+								converted += runLen;																																		\
 							}																																								\
-							/* In this part we sign-extend the other int types, except 32-bit because it doesn't need it.*/																	\
-							else if (depth != 4)																																			\
+						}																																									\
+																																															\
+						sampleIndex += currentBlocks;																																		\
+					}																																										\
+					else																																									\
+					{																																										\
+						for (size_t b = 0; b < currentBlocks; b++)																															\
+						{																																									\
+							/* Loading each relevant sample in the block.*/																													\
+							for (WORD c = 0; c < relevantChannels; c++)																														\
 							{																																								\
-								if ((DEPTH_HIGH_BIT(depth) & sample) != 0)																													\
+								/* First, we read the sample in its integer form. All byte depths get read into a 32-bit integer.*/															\
+								/* The upside of this is less repeat code and easier conversion of biased to two's complement for 8-bit PCM.*/												\
+								/* The downside is branching (which should be resolved at compile time) and we have to sign extend everything.*/											\
+								int sample = 0;																																				\
+								memcpy(&sample, blocks + (b * blockAlign) + (c * containerSize), depth);																					\
+																																															\
+								/* 8-bit files use biased representation instead of two's complement. Converting it.*/																		\
+								if (depth == 1)																																				\
 								{																																							\
-									sample |= SIGN_EXTEND_MASK(depth);																														\
+									sample -= 128;																																			\
+								}																																							\
+								/* In this part we sign-extend the other int types, except 32-bit because it doesn't need it.*/																\
+								else if (depth != 4)																																		\
+								{																																							\
+									if ((DEPTH_HIGH_BIT(depth) & sample) != 0)																												\
+									{																																						\
+										sample |= SIGN_EXTEND_MASK(depth);																													\
+									}																																						\
 								}																																							\
-							}																																								\
 																																															\
-							/* Now we convert it to a float in the range of -1 to 1.*/																										\
-							/* The conversion also balances out the fact that there's more negative than positive numbers in two's complement.*/											\
-							precision##Real realSample = ((sample + CAST(0.5, precision##Real)) / (DEPTH_MAX(depth) + CAST(0.5, precision##Real)));											\
+								/* Now we convert it to a float in the range of -1 to 1.*/																									\
+								/* The conversion also balances out the fact that there's more negative than positive numbers in two's complement.*/										\
+								precision##Real realSample = ((sample + CAST(0.5, precision##Real)) / (DEPTH_MAX(depth) + CAST(0.5, precision##Real)));										\
 																																															\
-							get(funcs[c], sampleIndex) = realSample;																														\
-						}																																									\
+								get(funcs[c], sampleIndex) = realSample;																													\
+							}																																								\
 																																															\
-						sampleIndex++;																																						\
+							sampleIndex++;																																					\
+						}																																									\
 					}																																										\
+					INSTRUMENT_END(CONVERT);																																				\
+					INSTRUMENT_COUNT(CONVERT, currentBlocks * relevantChannels);																											\
 				}																																											\
 			}																																												\
 		}																																													\
 	}																																														\
 																																															\
-	/* Padding until we reach that power of two length. This also has the job of occupying all the data for new files. We pad what 0 would get converted to, as opposed to 0 itself.*/		\
+	/* Padding until we reach that FFT-friendly length. This also has the job of occupying all the data for new files. We pad what 0 would get converted to, as opposed to 0 itself.*/		\
 	/* It's better for caching if we do the channels in the outer loop and indices in the inner loop.*/																						\
 	for (unsigned short c = 0; c < relevantChannels; c++)																																	\
 	{																																														\
@@ -639,25 +956,46 @@ char LoadPCMInterleaved(FileInfo* fileInfo, Function*** channelsData)
 	}
 
 	// This is where the function actually starts executing from. The macro needs to be above it.
+	simdKernelsUsable = SimdKernelsSupported(); // Cheap enough to just check every time.
 	FILE* file = fileInfo->file;
 	WORD relevantChannels = GetRelevantChannelsCount(fileInfo); // The number of channels we want to load.
 	WORD containerSize = fileInfo->format.contents.Format.wBitsPerSample / 8; // The amount of bytes each sample effectively takes up.
 	WORD byteDepth = fileInfo->format.contents.Format.wFormatTag == WAVE_FORMAT_PCM ? containerSize : fileInfo->format.contents.Samples.wValidBitsPerSample / 8; // The amount of bytes each sample takes up that isn't padding.
 	WORD blockAlign = fileInfo->format.contents.Format.nBlockAlign; // The amount of bytes each block of one sample per channel takes up.
-	unsigned long long paddedLength = max(MIN_FOURIER_LENGTH, NextPowerOfTwo(fileInfo->sampleLength)); // The sample length of a channel of data, rounded up to the next power of two that is greater/equal to some constant.
+	unsigned long long paddedLength = max(MIN_FOURIER_LENGTH, NextMixedRadixLength(fileInfo->sampleLength)); // The sample length of a channel of data, rounded up to the next FFT-friendly length (m * 2^k, m in {1, 3, 5}) that is greater/equal to some constant.
 
 	DWORD segmentsLength = fileInfo->waveform.segmentsLength;
 	WaveformSegment* segments = fileInfo->waveform.segments;
 	size_t bufferBlockLen = FILE_READING_BUFFER_LEN / blockAlign; // The buffer length is such that this will never be 0.
-	void* buffer = malloc(bufferBlockLen * blockAlign); // Buffer size is the largest number less/equal to FILE_READING_BUFFER_LEN that divides by blockAlign.
 	unsigned long long sampleIndex = 0;	 // This is actually sort of double the index. It'll be more clear in the comments inside the macro it's used in.
 
-	if (buffer == NULL)
+	// Mapping the file lets us convert the PCM straight out of the page cache instead of copying it into a buffer first.
+	// The memory manager reads ahead of the pages we touch, so disk and conversion time already overlap on this path.
+	HANDLE mapping = NULL;
+	BYTE* view = IsFileNew(fileInfo) ? NULL : MapWaveFile(file, &mapping);
+
+	// New files have nothing to read. When mapping fails we fall back to a double-buffered pipeline: a reader thread prefetches the next
+	// run of blocks into one staging buffer with positioned reads while the current run converts out of the other, so the load is bounded
+	// by the slower of the disk and the conversion instead of their sum.
+	BYTE* stagingBuffers[2] = { NULL, NULL }; // Buffer sizes are the largest number less/equal to FILE_READING_BUFFER_LEN that divides by blockAlign.
+	char backBuffer = 0;
+	BlockCourier reader = {0};
+
+	if (view == NULL && !IsFileNew(fileInfo))
 	{
-		return FALSE;
+		if ((stagingBuffers[0] = malloc(bufferBlockLen * blockAlign)) == NULL ||
+			(stagingBuffers[1] = malloc(bufferBlockLen * blockAlign)) == NULL ||
+			!StartBlockCourier(&reader, file, TRUE))
+		{
+			StopBlockCourier(&reader);
+			free(stagingBuffers[0]);
+			free(stagingBuffers[1]);
+			return FALSE;
+		}
 	}
 
-	// To be efficient with memory while not sacrificing precision, byte depths of 1,2 get converted to single precision floats, and 3,4 get converted to double precision.
+	// To be efficient with memory while not sacrificing precision, byte depths of 1,2 get converted to single precision floats, and 3,4 get converted to double precision -
+	// unless single precision processing is on, which loads the deep files into floats too and halves the memory and bandwidth of everything downstream.
 	// Each case is put in a scope to fix issues with having variable-length arrays inside a switch label.
 	switch (byteDepth)
 	{
@@ -668,9 +1006,15 @@ char LoadPCMInterleaved(FileInfo* fileInfo, Function*** channelsData)
 			{ LOAD_PCM_INTERLEAVED_TYPED(Float, 2) }
 			break;
 		case 3:
+			if (singlePrecisionProcessing)
+			{ LOAD_PCM_INTERLEAVED_TYPED(Float, 3) }
+			else
 			{ LOAD_PCM_INTERLEAVED_TYPED(Double, 3) }
 			break;
 		case 4:
+			if (singlePrecisionProcessing)
+			{ LOAD_PCM_INTERLEAVED_TYPED(Float, 4) }
+			else
 			{ LOAD_PCM_INTERLEAVED_TYPED(Double, 4) }
 			break;
 		default: // This case should never happen.
@@ -678,7 +1022,11 @@ char LoadPCMInterleaved(FileInfo* fileInfo, Function*** channelsData)
 			break;
 	}
 
-	free(buffer);
+	// The courier's verdict gets ignored - a short read just leaves samples at the padding value, which is also how the fread path used to behave.
+	StopBlockCourier(&reader);
+	UnmapWaveFile(view, mapping);
+	free(stagingBuffers[0]);
+	free(stagingBuffers[1]);
 	return TRUE;
 }
 
@@ -701,56 +1049,105 @@ char WriteWaveFile(FILE* file, FileInfo* fileInfo, Function** channelsData)
 		/* Silent chunks are kept as is.*/																																		\
 		if (segments[i].header.id == FOURCC_DATA)																																\
 		{																																										\
-			_fseeki64(file, fileInfo->waveform.offset + segments[i].relativeOffset + sizeof(ChunkHeader), SEEK_SET);															\
-			size_t blocksInChunk = segments[i].header.size / blockAlign;																										\
+			size_t blocksInChunk = segments[i].size / blockAlign;																												\
+			unsigned long long chunkOffset = fileInfo->waveform.offset + segments[i].relativeOffset + sizeof(ChunkHeader);														\
+																																												\
+			/* With a mapped view we convert straight into the destination. Otherwise the runs bounce through the staging buffers and positioned I/O.*/							\
+			BYTE* chunkBase = view != NULL ? view + chunkOffset : NULL;																											\
 																																												\
 			/* Writing to the segment in chunks of bufferBlockLen.*/																											\
 			for (size_t blocksWritten = 0; blocksWritten < blocksInChunk; blocksWritten += bufferBlockLen)																		\
 			{																																									\
 				size_t currentBlocks = min(bufferBlockLen, blocksInChunk - blocksWritten);																						\
 																																												\
-				/* In order to preserve the content in channels we do not modify, I have to read what's currently in there first.*/												\
-				fread(buffer, blockAlign, currentBlocks, file);																													\
-				_fseeki64(file, -blockAlign *currentBlocks, SEEK_CUR); /* Stepping back that read we just did, for writing later.*/												\
+				BYTE* blocks;																																					\
 																																												\
-				/* First we have to occupy the buffer with the samples from all the channels in the WAVE formatting.*/															\
-				for (size_t b = 0; b < currentBlocks; b++)																														\
+				if (chunkBase != NULL)																																			\
+				{																																								\
+					/* The blocks of channels we don't modify are already sitting in the view, so there's nothing to read first.*/												\
+					blocks = chunkBase + (blocksWritten * blockAlign);																											\
+				}																																								\
+				else																																							\
 				{																																								\
+					/* The staging buffers take turns. Handing a run off waits out the write before last, so by the time a buffer comes back around it's free again.*/			\
+					blocks = stagingBuffers[backBuffer];																														\
+					backBuffer = !backBuffer;																																	\
+																																												\
+					/* In order to preserve the content in channels we do not modify, I have to read what's currently in there first.*/											\
+					/* The positioned read doesn't move the file pointer, so it can't trip over the write that's still in flight behind us.*/									\
+					INSTRUMENT_BEGIN(IO);																																		\
+					ReadFileAt(writer.osFile, blocks, currentBlocks * blockAlign, chunkOffset + (blocksWritten * blockAlign));													\
+					INSTRUMENT_END(IO);																																			\
+					INSTRUMENT_COUNT(IO, currentBlocks * blockAlign);																											\
+				}																																								\
+																																												\
+				/* First we have to occupy the blocks with the samples from all the channels in the WAVE formatting.*/															\
+				INSTRUMENT_BEGIN(CONVERT);																																		\
+				if (simdKernelsUsable)																																			\
+				{																																								\
+					/* The SIMD converters chew through the whole run of blocks one channel at a time, with the last few samples done scalar inside them.*/						\
 					for (WORD c = 0; c < relevantChannels; c++)																													\
 					{																																							\
-						/* Taking the float value of the sample which should be roughly in the range [-1, 1].*/																	\
-						precision##Real sample = get(funcs[c], sampleIndex);																									\
+						size_t converted = 0;																																	\
 																																												\
-						/* Scaling it up so it matches the range of numbers of the given depth.*/																				\
-						sample = (DEPTH_MAX(depth) * sample) - CAST(0.5, precision##Real);																						\
+						/* A single call can't cross a boundary between two segments of the function, so long runs may take a few calls.*/										\
+						while (converted < currentBlocks)																														\
+						{																																						\
+							unsigned long long index = sampleIndex + converted;																									\
+							size_t runLen = min(currentBlocks - converted, funcs[c].segmentLen - (index % funcs[c].segmentLen));												\
+							ConvertRealToPcm_##precision##Real(blocks + (converted * blockAlign) + (c * containerSize), &get(funcs[c], index), runLen, depth, blockAlign);		\
+							converted += runLen;																																\
+						}																																						\
+					}																																							\
 																																												\
-						/* Applying triangular dither. The sum of a number between [-1, 0] and a number between [0, 1] has a triangular distribution and is between [-1, 1].*/	\
-						sample += RandRange##precision(-1.0, 0.0) + RandRange##precision(0.0, 1.0);																				\
+					sampleIndex += currentBlocks;																																\
+				}																																								\
+				else																																							\
+				{																																								\
+					for (size_t b = 0; b < currentBlocks; b++)																													\
+					{																																							\
+						for (WORD c = 0; c < relevantChannels; c++)																												\
+						{																																						\
+							/* Taking the float value of the sample which should be roughly in the range [-1, 1].*/																\
+							precision##Real sample = get(funcs[c], sampleIndex);																								\
 																																												\
-						/* Clamping the sample to the range of possible integer values.*/																						\
-						sample = Clamp##precision(sample, DEPTH_MIN(depth), DEPTH_MAX(depth));																					\
+							/* Scaling it up so it matches the range of numbers of the given depth.*/																			\
+							sample = (DEPTH_MAX_##precision(depth) * sample) - CAST(0.5, precision##Real);																		\
 																																												\
-						/* Rounding the sample to the nearest integer value.*/																									\
-						int quantized = lround_##precision##Real(sample);																										\
+							/* Applying triangular dither. The sum of a number between [-1, 0] and a number between [0, 1] has a triangular distribution and is between [-1, 1].*/\
+							sample += RandRange##precision(-1.0, 0.0) + RandRange##precision(0.0, 1.0);																			\
 																																												\
-						/* Converting 8-bit files to unsigned.*/																												\
-						if (depth == 1)																																			\
-						{																																						\
-							quantized += 128;																																	\
+							/* Clamping the sample to the range of possible integer values.*/																					\
+							sample = Clamp##precision(sample, DEPTH_MIN(depth), DEPTH_MAX_##precision(depth));																	\
+																																												\
+							/* Rounding the sample to the nearest integer value.*/																								\
+							int quantized = lround_##precision##Real(sample);																									\
+																																												\
+							/* Converting 8-bit files to unsigned.*/																											\
+							if (depth == 1)																																		\
+							{																																					\
+								quantized += 128;																																\
+							}																																					\
+																																												\
+							memcpy(blocks + (b * blockAlign) + (c * containerSize), &quantized, depth);																			\
 						}																																						\
 																																												\
-						memcpy(buffer + (b * blockAlign) + (c * containerSize), &quantized, depth);																				\
+						sampleIndex++;																																			\
 					}																																							\
-																																												\
-					sampleIndex++;																																				\
 				}																																								\
+				INSTRUMENT_END(CONVERT);																																		\
+				INSTRUMENT_COUNT(CONVERT, currentBlocks * relevantChannels);																									\
 																																												\
-				/* Writing the data to file.*/																																	\
-				fwrite(buffer, blockAlign, currentBlocks, file);																												\
+				/* Handing the converted run to the writer thread, which writes it out while we convert the next one. Stores into the view skip this because the page cache gets them directly.*/\
+				if (chunkBase == NULL)																																			\
+				{																																								\
+					StageBlockTransfer(&writer, blocks, currentBlocks * blockAlign, chunkOffset + (blocksWritten * blockAlign));												\
+				}																																								\
 			}																																									\
 		}																																										\
 	}
 
+	simdKernelsUsable = SimdKernelsSupported(); // Cheap enough to just check every time.
 	WORD relevantChannels = GetRelevantChannelsCount(fileInfo);	// The number of channels we're editing.
 	WORD containerSize = fileInfo->format.contents.Format.wBitsPerSample / 8; // The amount of bytes each sample effectively takes up.
 	WORD byteDepth = fileInfo->format.contents.Format.wFormatTag == WAVE_FORMAT_PCM ? containerSize : fileInfo->format.contents.Samples.wValidBitsPerSample / 8; // The amount of bytes each sample takes up that isn't padding.
@@ -759,16 +1156,37 @@ char WriteWaveFile(FILE* file, FileInfo* fileInfo, Function** channelsData)
 	DWORD segmentsLength = fileInfo->waveform.segmentsLength;
 	WaveformSegment* segments = fileInfo->waveform.segments;
 	size_t bufferBlockLen = FILE_READING_BUFFER_LEN / blockAlign; // The buffer length is such that this will never be 0.
-	void* buffer = malloc(bufferBlockLen * blockAlign); // Buffer size is the largest number less/equal to FILE_READING_BUFFER_LEN that divides by blockAlign.
 	unsigned long long sampleIndex = 0;	// This is actually sort of double the index. It'll be more clear in the comments inside the macro it's used in.
 
-	if (buffer == NULL)
+	// Mapping the file lets us convert the samples straight into the page cache instead of bouncing every block through a buffer.
+	// The memory manager writes the dirty pages back in the background, so conversion and disk time already overlap on this path.
+	HANDLE mapping = NULL;
+	BYTE* view = MapWaveFile(file, &mapping);
+
+	// When mapping fails we fall back to a double-buffered pipeline: a writer thread flushes one staging buffer with positioned writes while the next
+	// run of blocks converts into the other, so the save is bounded by the slower of the disk and the conversion instead of their sum.
+	BYTE* stagingBuffers[2] = { NULL, NULL }; // Buffer sizes are the largest number less/equal to FILE_READING_BUFFER_LEN that divides by blockAlign.
+	char backBuffer = 0;
+	BlockCourier writer = {0};
+
+	if (view == NULL)
 	{
-		return FALSE;
+		if ((stagingBuffers[0] = malloc(bufferBlockLen * blockAlign)) == NULL ||
+			(stagingBuffers[1] = malloc(bufferBlockLen * blockAlign)) == NULL ||
+			!StartBlockCourier(&writer, file, FALSE))
+		{
+			StopBlockCourier(&writer);
+			free(stagingBuffers[0]);
+			free(stagingBuffers[1]);
+			return FALSE;
+		}
 	}
 
 	// To be efficient with memory while not sacrificing precision, byte depths of 1,2 get converted to single precision floats, and 3,4 get converted to double precision.
 	// Each case is put in a scope to avoid issues with variable-length arrays inside a switch label.
+	// The precision has to follow the functions' actual type, which tracks the processing precision the file was opened with, not just the byte depth.
+	char isFloat = GetType(channelsData[0]) == FloatComplexType;
+
 	switch (byteDepth)
 	{
 		case 1:
@@ -778,9 +1196,15 @@ char WriteWaveFile(FILE* file, FileInfo* fileInfo, Function** channelsData)
 			{ WRITE_WAVE_FILE_TYPED(Float, 2) }
 			break;
 		case 3:
+			if (isFloat)
+			{ WRITE_WAVE_FILE_TYPED(Float, 3) }
+			else
 			{ WRITE_WAVE_FILE_TYPED(Double, 3) }
 			break;
 		case 4:
+			if (isFloat)
+			{ WRITE_WAVE_FILE_TYPED(Float, 4) }
+			else
 			{ WRITE_WAVE_FILE_TYPED(Double, 4) }
 			break;
 		default: // This case should never happen.
@@ -788,9 +1212,14 @@ char WriteWaveFile(FILE* file, FileInfo* fileInfo, Function** channelsData)
 			break;
 	}
 
-	free(buffer);
+	// Whatever run is still in flight has to land before we report the save done.
+	char success = view != NULL ? TRUE : StopBlockCourier(&writer);
+
+	UnmapWaveFile(view, mapping);
+	free(stagingBuffers[0]);
+	free(stagingBuffers[1]);
 	fflush(file);
-	return TRUE;
+	return success;
 }
 
 char WriteWaveFileAs(FileInfo* fileInfo, LPCTSTR path, Function** channelsData)
@@ -17,6 +17,8 @@
 #include "WindowsMain.h"
 #include "MyUtils.h"
 #include "Resource.h"
+#include "Instrumentation.h"
+#include "AudioPlayback.h"
 #include <windowsx.h>	// For GET_X_LPARAM.
 #include <stdio.h>		// For printing errors and such.
 #include <commctrl.h>	// For some trackbar-related things.
@@ -24,6 +26,7 @@
 #include <shlwapi.h> 	// For PathStipPath.
 #include <gdiplus.h>	// For drawing graphs.
 #include <time.h>		// To seed rand.
+#include <process.h>	// For _beginthreadex, which unlike CreateThread plays nice with the CRT.
 
 #pragma region Macros
 
@@ -36,10 +39,16 @@
 // This needs to be above 0x8000 and different than the values in Resources.h.
 #define PROGRAM_EXIT 0x8008
 
+// Same deal, the menu option for toggling single precision processing.
+#define FILE_ACTION_FLOAT32 0x8009
+
 // This message tells the main window to pop the select file option dialog or open the file in the command line when the program starts.
 // Despite WM_USER being intended as the point from which users can safely define their own messages, that is apparently not true (see WM_GETDEFID and WM_SETDEFIF) so we start from +2.
 #define WM_STARTFILE (WM_USER + 2)
 
+// This message tells the main window that the background save thread is done writing the file.
+#define WM_SAVEDONE (WM_USER + 3)
+
 // These don't need to be above 0x8000.
 #define NEW_FILE_OPTIONS_OK 1
 #define NEW_FILE_OPTIONS_CANCEL 2
@@ -121,6 +130,10 @@
 // Decibel is a unit which requires a reference point to measure against. This is that for the logarithm scale of fourier graphs.
 #define FOURIER_DECIBEL_REFERENCE 1.0
 
+// Constants related to zooming into the fourier graph with the mouse wheel.
+#define FOURIER_ZOOM_PER_CLICK 0.8 // Every wheel click inwards keeps this fraction of the visible spectrum in view.
+#define FOURIER_PAN_PER_CLICK 0.125 // Every shift+wheel click slides the view by this fraction of what's visible.
+
 // Colors used for graphs.
 #define WAVEFORM_BACKGROUND_COLOR RGB(245, 250, 248)
 #define WAVEFORM_FOREGROUND_COLOR RGB(217, 87, 0)
@@ -139,6 +152,9 @@
 #define FILE_FILTER TEXT("Wave files (*.wav;*.wave)\0*.wav;*.wave\0")
 #define TITLE_POSTFIX TEXT(" - Fourier")
 
+// Appended to the window title while a background save is running, as a poor man's progress indicator.
+#define SAVING_POSTFIX TEXT(" (saving)")
+
 #pragma endregion // Macros.
 
 static HWND mainWindowHandle = NULL;
@@ -146,6 +162,7 @@ static HICON programIcon = NULL;
 static NewFileOptionsWindow* newFileOptionsHandles = NULL;
 static NewFileOptionsSelections newFileOptionsSelections = {.length = NEW_FILE_DEFAULT_LENGTH, .frequency = NEW_FILE_DEFAULT_FREQUENCY, .byteDepth = NEW_FILE_DEFAULT_BYTE_DEPTH };
 static FileEditor fileEditor = {0};
+static unsigned short playbackChannel = 0; // Which channel the audition engine is playing, when it's playing. See TogglePlayback.
 
 #pragma region Initialization
 
@@ -296,6 +313,8 @@ LRESULT CALLBACK MainWindowProcedure(HWND windowHandle, UINT msg, WPARAM wparam,
 			return 0;
 		case WM_STARTFILE:
 			return ProcessStartFile();
+		case WM_SAVEDONE:
+			return ProcessSaveDone(windowHandle);
 		case WM_COMMAND:
 			return ProcessMainWindowCommand(windowHandle, wparam, lparam);
 		case WM_HSCROLL:
@@ -310,6 +329,8 @@ LRESULT CALLBACK MainWindowProcedure(HWND windowHandle, UINT msg, WPARAM wparam,
 			return ProcessRMBUp(lparam);
 		case WM_MOUSEMOVE:
 			return ProcessMouseMove(lparam);
+		case WM_MOUSEWHEEL:
+			return ProcessMouseWheel(wparam, lparam);
 		case WM_NOTIFY:
 			return ProcessNotification(wparam, (LPNMHDR)lparam);
 		case WM_CTLCOLORSTATIC:
@@ -347,6 +368,8 @@ void AddMainWindowMenus(HWND windowHandle)
 	AppendMenu(fileMenuHandler, MF_STRING, NOTIF_CODIFY(FILE_ACTION_OPEN), TEXT("Open\tCtrl+O"));
 	AppendMenu(fileMenuHandler, MF_STRING | MF_GRAYED, NOTIF_CODIFY(FILE_ACTION_SAVE), TEXT("Save\tCtrl+S"));
 	AppendMenu(fileMenuHandler, MF_STRING | MF_GRAYED, NOTIF_CODIFY(FILE_ACTION_SAVEAS), TEXT("Save as\tCtrl+Shift+S"));
+	AppendMenu(fileMenuHandler, MF_SEPARATOR, 0, NULL); // Separator between the precision toggle and the file operations.
+	AppendMenu(fileMenuHandler, MF_STRING, NOTIF_CODIFY(FILE_ACTION_FLOAT32), TEXT("Single precision processing"));
 	AppendMenu(fileMenuHandler, MF_SEPARATOR, 0, NULL); // Separator between exit and all the other options.
 	AppendMenu(fileMenuHandler, MF_STRING, NOTIF_CODIFY(PROGRAM_EXIT), TEXT("Exit"));
 
@@ -354,6 +377,7 @@ void AddMainWindowMenus(HWND windowHandle)
 	AppendMenu(editMenuHandler, MF_STRING | MF_GRAYED, NOTIF_CODIFY(EDIT_ACTION_UNDO), TEXT("Undo\tCtrl+Z"));
 	AppendMenu(editMenuHandler, MF_STRING | MF_GRAYED, NOTIF_CODIFY(EDIT_ACTION_REDO), TEXT("Redo\tCtrl+Y"));
 	AppendMenu(editMenuHandler, MF_STRING | MF_GRAYED, NOTIF_CODIFY(EDIT_ACTION_APPLY), TEXT("Apply\tCtrl+E"));
+	AppendMenu(editMenuHandler, MF_STRING | MF_GRAYED, NOTIF_CODIFY(EDIT_ACTION_PLAY), TEXT("Play channel\tCtrl+P"));
 
 	// Adding both menus.
 	AppendMenu(menuHandler, MF_POPUP, (UINT_PTR)fileMenuHandler, TEXT("File"));
@@ -444,8 +468,7 @@ LRESULT ProcessLMBDown(LPARAM lparam)
 				SetCapture(mainWindowHandle);
 
 				// Storing the clicked point as the pivot point for this selection, and setting the selection to be from this pivot point to itself.
-				double nyquist = GetNyquistDouble(fileEditor.fileInfo);
-				fileEditor.selectionPivot = ClampDouble((point.x * nyquist) / (GRAPH_WIDTH - 1.0), 0.0, nyquist);
+				fileEditor.selectionPivot = FourierPixelToFrequency(point.x);
 				SetTextboxDouble(fileEditor.fromFreqTextbox, fileEditor.selectionPivot, FALSE);
 				SetTextboxDouble(fileEditor.toFreqTextbox, fileEditor.selectionPivot, FALSE);
 				UpdateSelection();
@@ -501,8 +524,7 @@ LRESULT ProcessMouseMove(LPARAM lparam)
 	// MapWindowPoints returns 0 on failure. It can also sometimes return 0 on success, but not in our case so we don't check for it.
 	if (mapping != 0 && (fileEditor.isSelecting || isHovering))
 	{
-		double nyquist = GetNyquistDouble(fileEditor.fileInfo);
-		double pointFreq = ClampDouble((point.x * nyquist) / (GRAPH_WIDTH - 1.0), 0.0, nyquist);
+		double pointFreq = FourierPixelToFrequency(point.x);
 		
 		// Setting the selection to go from the pivot to the current pressed point.
 		if (fileEditor.isSelecting)
@@ -535,6 +557,37 @@ LRESULT ProcessMouseMove(LPARAM lparam)
 	return 0;
 }
 
+LRESULT ProcessMouseWheel(WPARAM wparam, LPARAM lparam)
+{
+	if (fileEditor.fileInfo != NULL)
+	{
+		// Unlike the other mouse messages, wheel coordinates arrive in screen space.
+		POINT point = { .x = GET_X_LPARAM(lparam), .y = GET_Y_LPARAM(lparam) };
+		ScreenToClient(mainWindowHandle, &point);
+
+		if (IsInWindow(point, fileEditor.fourierGraphStatic))
+		{
+			int clicks = GET_WHEEL_DELTA_WPARAM(wparam) / WHEEL_DELTA;
+			int mapping = MapWindowPoints(mainWindowHandle, fileEditor.fourierGraphStatic, &point, 1);
+
+			// MapWindowPoints returns 0 on failure. It can also sometimes return 0 on success, but not in our case so we don't check for it.
+			if (mapping != 0 && clicks != 0)
+			{
+				if (GET_KEYSTATE_WPARAM(wparam) & MK_SHIFT)
+				{
+					PanFourierGraph(clicks);
+				}
+				else
+				{
+					ZoomFourierGraph(clicks, point.x);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
 LRESULT ProcessNotification(WPARAM wparam, LPNMHDR nmhdr)
 {
 	if (nmhdr->code == TCN_SELCHANGE)
@@ -662,6 +715,12 @@ LRESULT ProcessMainWindowCommand(HWND windowHandle, WPARAM wparam, LPARAM lparam
 		case EDIT_ACTION_APPLY:
 			ApplyModificationFromInput(windowHandle);
 			break;
+		case EDIT_ACTION_PLAY:
+			TogglePlayback(windowHandle);
+			break;
+		case FILE_ACTION_FLOAT32:
+			ToggleSinglePrecision(windowHandle);
+			break;
 		case PROGRAM_EXIT:
 			DestroyWindow(windowHandle);
 			break;
@@ -685,6 +744,15 @@ void UpdateEditorToCurrentChannel()
 	DisplayChannelGraphs(currentChannel);
 }
 
+void ToggleSinglePrecision(HWND windowHandle)
+{
+	// This only matters the next time a file gets opened. Reloading the current file under the new precision would throw away its undo history, so we don't.
+	static char singlePrecisionOn = FALSE;
+	singlePrecisionOn = !singlePrecisionOn;
+	SetSinglePrecisionProcessing(singlePrecisionOn);
+	CheckMenuItem(GetMenu(windowHandle), NOTIF_CODIFY(FILE_ACTION_FLOAT32), MF_BYCOMMAND | (singlePrecisionOn ? MF_CHECKED : MF_UNCHECKED));
+}
+
 void FileNew(HWND windowHandle)
 {
 	if (newFileOptionsHandles != NULL)
@@ -830,15 +898,41 @@ void FileSave(HWND windowHandle)
 	{
 		FileSaveAs(windowHandle);
 	}
-	else if (HasUnsavedChanges())
+	else if (HasUnsavedChanges() && fileEditor.saveThread == NULL) // Only one save at a time. The title bar already says one is going.
 	{
 		SetAllChannelsDomain(TIME_DOMAIN);
 
+		// Snapshotting the channels so the save can run in the background while edits keep applying to the live copy.
+		unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+		char snapshotted = (fileEditor.saveSnapshot = calloc(relevantChannels, sizeof(Function*))) != NULL;
+
+		for (unsigned short i = 0; snapshotted && i < relevantChannels; i++)
+		{
+			snapshotted = (fileEditor.saveSnapshot[i] = CreatePartialClone(fileEditor.channelsData[i], 0, NumOfSamples(fileEditor.channelsData[i]) - 1)) != NULL;
+		}
+
+		if (snapshotted)
+		{
+			fileEditor.saveThreadState = fileEditor.modificationStack;
+			fileEditor.saveThread = (HANDLE)_beginthreadex(NULL, 0, BackgroundSaveProcedure, NULL, 0, NULL);
+		}
+
+		if (fileEditor.saveThread != NULL)
+		{
+			UpdateWindowTitle(); // This shows the saving indicator now that the save is going.
+			return;
+		}
+
+		// There wasn't enough memory for the snapshot (or the thread), so the save runs right here like it used to.
+		DeallocateSaveSnapshot();
+
 		while (TRUE)
 		{
 			if (WriteWaveFile(fileEditor.fileInfo->file, fileEditor.fileInfo, fileEditor.channelsData))
 			{
 				fileEditor.currentSaveState = fileEditor.modificationStack;
+				ResetSessionJournal(fileEditor.sessionJournal); // Everything the journal guarded is in the file now.
+				INSTRUMENT_REPORT("Save");
 				UpdateWindowTitle();
 				break;
 			}
@@ -855,6 +949,79 @@ void FileSave(HWND windowHandle)
 	}
 }
 
+unsigned int __stdcall BackgroundSaveProcedure(void* arg)
+{
+	fileEditor.saveResult = WriteWaveFile(fileEditor.fileInfo->file, fileEditor.fileInfo, fileEditor.saveSnapshot);
+	PostMessage(mainWindowHandle, WM_SAVEDONE, 0, 0);
+	return 0;
+}
+
+char WaitForBackgroundSave()
+{
+	if (fileEditor.saveThread == NULL)
+	{
+		return TRUE;
+	}
+
+	WaitForSingleObject(fileEditor.saveThread, INFINITE);
+	CloseHandle(fileEditor.saveThread);
+	fileEditor.saveThread = NULL;
+	DeallocateSaveSnapshot();
+
+	if (fileEditor.saveResult)
+	{
+		fileEditor.currentSaveState = fileEditor.saveThreadState;
+
+		// The saved file holds the snapshot's state, so the journal starts over from there. Edits that applied while the save ran stay journaled.
+		RewriteSessionJournal(fileEditor.sessionJournal, fileEditor.saveThreadState, fileEditor.modificationStack);
+	}
+
+	INSTRUMENT_REPORT("Save");
+	UpdateWindowTitle();
+	return fileEditor.saveResult;
+}
+
+void DeallocateSaveSnapshot()
+{
+	if (fileEditor.saveSnapshot != NULL)
+	{
+		unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+
+		for (unsigned short i = 0; i < relevantChannels; i++)
+		{
+			if (fileEditor.saveSnapshot[i] != NULL)
+			{
+				DeallocateFunctionInternals(fileEditor.saveSnapshot[i]);
+				free(fileEditor.saveSnapshot[i]);
+			}
+		}
+
+		free(fileEditor.saveSnapshot);
+		fileEditor.saveSnapshot = NULL;
+	}
+}
+
+LRESULT ProcessSaveDone(HWND windowHandle)
+{
+	// The thread may have already been reaped by someone who couldn't afford to wait for this message, in which case there's nothing to do.
+	if (fileEditor.saveThread == NULL)
+	{
+		return 0;
+	}
+
+	if (!WaitForBackgroundSave()) // Returns right away since the thread posted this message on its way out.
+	{
+		int choice = MessageBox(windowHandle, TEXT("There is insufficient memory for saving this file."), NULL, MB_RETRYCANCEL | MB_ICONERROR);
+
+		if (choice == IDRETRY)
+		{
+			FileSave(windowHandle);
+		}
+	}
+
+	return 0;
+}
+
 void FileSaveAs(HWND windowHandle)
 {
 	// If the file editor isn't open yet, no file has been opened for saving.
@@ -863,6 +1030,9 @@ void FileSaveAs(HWND windowHandle)
 		return;
 	}
 
+	// Save-as reads from the same file that a background save writes to, so one has to finish before the other starts.
+	WaitForBackgroundSave();
+
 	OPENFILENAME ofn = {0};
 	TCHAR filename[MAX_PATH];
 
@@ -909,6 +1079,12 @@ void FileSaveAs(HWND windowHandle)
 			if (WriteWaveFileAs(fileEditor.fileInfo, filename, fileEditor.channelsData))
 			{
 				fileEditor.currentSaveState = fileEditor.modificationStack;
+
+				// The file lives at a new path now, so the journal moves with it. The old sidecar empties and deletes itself on close.
+				ResetSessionJournal(fileEditor.sessionJournal);
+				CloseSessionJournal(fileEditor.sessionJournal);
+				fileEditor.sessionJournal = OpenSessionJournal(fileEditor.fileInfo->path, NumOfSamples(fileEditor.channelsData[0]), GetRelevantChannelsCount(fileEditor.fileInfo));
+				INSTRUMENT_REPORT("Save as");
 				UpdateWindowTitle();
 				break;
 			}
@@ -950,10 +1126,29 @@ void Undo(HWND windowHandle)
 		unsigned short channel = GetUndoChannel(fileEditor.modificationStack);
 		SetChannelDomain(channel, FREQUENCY_DOMAIN);
 
-		if (UndoLastModification(fileEditor.channelsData, &(fileEditor.modificationStack)))
+		// Backing up the band we're about to revert, so the shadowed waveform can be patched instead of fully recomputed.
+		Modification* modification = fileEditor.modificationStack;
+		BeginSpectralShadowBandEdit(fileEditor.channelsShadow[channel], fileEditor.channelsData[channel],
+			modification->startSample, modification->startSample + modification->length - 1, fileEditor.soundEditorCache);
+		char undone = UndoLastModification(fileEditor.channelsData, &(fileEditor.modificationStack));
+		EndSpectralShadowBandEdit(fileEditor.channelsShadow[channel], fileEditor.channelsData[channel], fileEditor.soundEditorCache);
+
+		if (undone)
 		{
+			// The waveform just changed so the old peaks are no good anymore. PlotChannelWaveform builds a fresh pyramid when it sees NULL here.
+			// The spectrum that produced it changed too, so the fourier plotter's magnitude pyramid goes the same way.
+			DeallocatePeakPyramid(fileEditor.channelsPeaks[channel]);
+			fileEditor.channelsPeaks[channel] = NULL;
+			DeallocateMagnitudePyramid(fileEditor.channelsMagnitudes[channel]);
+			fileEditor.channelsMagnitudes[channel] = NULL;
+
 			PlotChannelFourier(channel);
 			PlotChannelWaveform(channel);
+
+			// Undos get journaled too. The journal is a replay script, not just a list of changes.
+			JournalEntry entry = { JOURNAL_UNDO };
+			AppendSessionJournalEntry(fileEditor.sessionJournal, &entry);
+			INSTRUMENT_REPORT("Undo");
 			UpdateWindowTitle();
 			UpdateUndoRedoState();
 
@@ -969,13 +1164,32 @@ void Redo(HWND windowHandle)
 {
 	if (CanRedo(fileEditor.modificationStack))
 	{
-		unsigned short channel = GetUndoChannel(fileEditor.modificationStack);
+		// This used to fetch the undo channel, which is a different channel entirely when the last undone change and the one before it don't share one.
+		unsigned short channel = GetRedoChannel(fileEditor.modificationStack);
 		SetChannelDomain(channel, FREQUENCY_DOMAIN);
 
-		if (RedoLastModification(fileEditor.channelsData, &(fileEditor.modificationStack)))
+		// Backing up the band we're about to reapply, so the shadowed waveform can be patched instead of fully recomputed.
+		Modification* modification = fileEditor.modificationStack->next;
+		BeginSpectralShadowBandEdit(fileEditor.channelsShadow[channel], fileEditor.channelsData[channel],
+			modification->startSample, modification->startSample + modification->length - 1, fileEditor.soundEditorCache);
+		char redone = RedoLastModification(fileEditor.channelsData, &(fileEditor.modificationStack));
+		EndSpectralShadowBandEdit(fileEditor.channelsShadow[channel], fileEditor.channelsData[channel], fileEditor.soundEditorCache);
+
+		if (redone)
 		{
+			// Same as with undoing, the pyramids have to go because the waveform and the spectrum both changed.
+			DeallocatePeakPyramid(fileEditor.channelsPeaks[channel]);
+			fileEditor.channelsPeaks[channel] = NULL;
+			DeallocateMagnitudePyramid(fileEditor.channelsMagnitudes[channel]);
+			fileEditor.channelsMagnitudes[channel] = NULL;
+
 			PlotChannelFourier(channel);
 			PlotChannelWaveform(channel);
+
+			// Same as with undoing, the redo goes in the journal so a replay retraces the user's steps.
+			JournalEntry entry = { JOURNAL_REDO };
+			AppendSessionJournalEntry(fileEditor.sessionJournal, &entry);
+			INSTRUMENT_REPORT("Redo");
 			UpdateWindowTitle();
 			UpdateUndoRedoState();
 
@@ -1073,15 +1287,31 @@ void ApplyModificationFromInput(HWND windowHandle)
 	// If it gets allocated where fileEditor.currentSaveState points to, we'll have no way to know that the current save state is lost. So we have to check this before applying the modification.
 	char losingSaveState = IsRedoable(fileEditor.modificationStack, fileEditor.currentSaveState);
 
-	if (ApplyModification(fromFreqInt, toFreqInt, changeType, changeAmount, smoothing, currentChannel, fileEditor.channelsData, &(fileEditor.modificationStack)))
+	// Backing up the band before it changes, so the shadowed waveform can be patched with just the changed bins afterwards.
+	BeginSpectralShadowBandEdit(fileEditor.channelsShadow[currentChannel], fileEditor.channelsData[currentChannel], fromFreqInt, toFreqInt, fileEditor.soundEditorCache);
+	char applied = ApplyModification(fromFreqInt, toFreqInt, changeType, changeAmount, smoothing, currentChannel, fileEditor.channelsData, &(fileEditor.modificationStack));
+	EndSpectralShadowBandEdit(fileEditor.channelsShadow[currentChannel], fileEditor.channelsData[currentChannel], fileEditor.soundEditorCache);
+
+	if (applied)
 	{
+		// Every bin affects every sample, so any change means the channel's peak pyramid is stale. The changed bins stale the magnitude pyramid directly.
+		DeallocatePeakPyramid(fileEditor.channelsPeaks[currentChannel]);
+		fileEditor.channelsPeaks[currentChannel] = NULL;
+		DeallocateMagnitudePyramid(fileEditor.channelsMagnitudes[currentChannel]);
+		fileEditor.channelsMagnitudes[currentChannel] = NULL;
+
 		PlotAndDisplayChannelGraphs(currentChannel);
-		
+
 		if (losingSaveState)
 		{
 			fileEditor.currentSaveState = NULL;
 		}
 
+		// The new change goes straight into the journal sidecar, where it survives a crash until the next full save.
+		JournalEntry entry = { JOURNAL_APPLY, changeType, currentChannel, fromFreqInt, toFreqInt, changeAmount, smoothing };
+		AppendSessionJournalEntry(fileEditor.sessionJournal, &entry);
+
+		INSTRUMENT_REPORT("Apply");
 		UpdateWindowTitle();
 		UpdateUndoRedoState();
 	}
@@ -1091,6 +1321,35 @@ void ApplyModificationFromInput(HWND windowHandle)
 	}
 }
 
+void TogglePlayback(HWND windowHandle)
+{
+	// No editor means no channels to play yet.
+	if (!IsEditorOpen())
+	{
+		return;
+	}
+
+	if (IsAudioPlaying())
+	{
+		StopAudioPlayback();
+		return;
+	}
+
+	unsigned short currentChannel = TabCtrl_GetCurSel(fileEditor.channelTabs);
+
+	// The engine streams the channel's buffer as a waveform, so it has to actually hold one when playback starts.
+	// From here on, SetChannelDomain keeps the audition honest by muting it whenever this channel flips to the frequency domain.
+	SetChannelDomain(currentChannel, TIME_DOMAIN);
+	playbackChannel = currentChannel;
+
+	// Handing over the slot in the channels array rather than its contents, because domain flips trade the buffer out from under us.
+	if (!StartAudioPlayback(&(fileEditor.channelsData[currentChannel]), 0, fileEditor.fileInfo->sampleLength,
+							fileEditor.fileInfo->format.contents.Format.nSamplesPerSec))
+	{
+		MessageBox(windowHandle, TEXT("Couldn't start audio playback."), NULL, MB_OK | MB_ICONERROR);
+	}
+}
+
 char PromptSaveProgress(HWND windowHandle)
 {
 	if (HasUnsavedChanges())
@@ -1107,6 +1366,20 @@ char PromptSaveProgress(HWND windowHandle)
 				break; // Proceeding without saving in case of no.
 			case IDYES:
 				FileSave(windowHandle); // Saving first in case of yes.
+
+				// If the save went to the background, it has to be seen through before the progress can be discarded.
+				while (!WaitForBackgroundSave())
+				{
+					int retry = MessageBox(windowHandle, TEXT("There is insufficient memory for saving this file."), NULL, MB_RETRYCANCEL | MB_ICONERROR);
+
+					if (retry == IDCANCEL)
+					{
+						return FALSE;
+					}
+
+					FileSave(windowHandle);
+				}
+
 				break;
 			default:
 				break;
@@ -1117,24 +1390,126 @@ char PromptSaveProgress(HWND windowHandle)
 	return TRUE;
 }
 
+unsigned int __stdcall InitializeSoundEditorProcedure(void* arg)
+{
+	fileEditor.soundEditorCache = InitializeSoundEditor(fileEditor.channelsData[0]);
+	return 0;
+}
+
+void ReplayJournalEntries()
+{
+	unsigned long long entries = SessionJournalEntries(fileEditor.sessionJournal);
+
+	// The core apply/undo/redo functions get called directly instead of going through the UI wrappers, so the replay doesn't journal itself.
+	// The shadows and pyramids are all still NULL at this point and the plots haven't happened yet, so none of that upkeep is needed either.
+	for (unsigned long long n = 0; n < entries; n++)
+	{
+		JournalEntry entry;
+
+		if (!ReadSessionJournalEntry(fileEditor.sessionJournal, n, &entry))
+		{
+			fprintf(stderr, "Reading entry %llu of the session journal failed. The entries after it are dropped.\n", n);
+			return;
+		}
+
+		switch (entry.action)
+		{
+			case JOURNAL_APPLY:
+				// A journal that got corrupted could say anything, so the bounds the input path enforces get checked again before trusting an entry.
+				if (entry.channel >= GetRelevantChannelsCount(fileEditor.fileInfo) || entry.fromSample < 1 || entry.fromSample > entry.toSample ||
+					entry.toSample >= NumOfSamples(fileEditor.channelsData[0]) || (entry.changeType != MULTIPLY && entry.changeType != ADD))
+				{
+					fprintf(stderr, "Entry %llu of the session journal is out of bounds. The entries after it are dropped.\n", n);
+					return;
+				}
+
+				// Edits act on the frequency domain, same as when the user first made them.
+				SetChannelDomain(entry.channel, FREQUENCY_DOMAIN);
+
+				if (!ApplyModification(entry.fromSample, entry.toSample, entry.changeType, entry.changeAmount, entry.smoothing,
+									   entry.channel, fileEditor.channelsData, &(fileEditor.modificationStack)))
+				{
+					fprintf(stderr, "Ran out of memory replaying the session journal. The entries after %llu are dropped.\n", n);
+					return;
+				}
+
+				break;
+			case JOURNAL_UNDO:
+				if (CanUndo(fileEditor.modificationStack))
+				{
+					SetChannelDomain(GetUndoChannel(fileEditor.modificationStack), FREQUENCY_DOMAIN);
+					UndoLastModification(fileEditor.channelsData, &(fileEditor.modificationStack));
+				}
+
+				break;
+			case JOURNAL_REDO:
+				if (CanRedo(fileEditor.modificationStack))
+				{
+					SetChannelDomain(GetRedoChannel(fileEditor.modificationStack), FREQUENCY_DOMAIN);
+					RedoLastModification(fileEditor.channelsData, &(fileEditor.modificationStack));
+				}
+
+				break;
+		}
+	}
+}
+
 void InitializeFileEditor(HWND windowHandle, FileInfo* fileInfo)
 {
 	// Closing the file that was open until now.
 	CloseFileEditor();
 	fileEditor.fileInfo = fileInfo;
 
-	if (LoadPCMInterleaved(fileInfo, &(fileEditor.channelsData)) &&
-		(fileEditor.soundEditorCache = InitializeSoundEditor(fileEditor.channelsData[0])) != NULL)
+	// All the segment storage for this session comes from one arena. If creating it failed then functions fall back to the plain heap, so no need to check.
+	fileEditor.segmentArena = CreateMemoryArena();
+	SetFunctionArena(fileEditor.segmentArena);
+
+	// The editor cache only depends on the channel functions' type and length, so once they're allocated it can get built on a thread while the PCM loads.
+	// That hides the twiddle table generation behind the disk and conversion time, which are the other long parts of opening a big file.
+	char allocated = AllocateChannelsData(fileInfo, &(fileEditor.channelsData));
+	HANDLE cacheThread = allocated ? (HANDLE)_beginthreadex(NULL, 0, InitializeSoundEditorProcedure, NULL, 0, NULL) : NULL;
+	char loaded = allocated && LoadPCMInterleaved(fileInfo, fileEditor.channelsData);
+
+	if (cacheThread != NULL)
+	{
+		WaitForSingleObject(cacheThread, INFINITE);
+		CloseHandle(cacheThread);
+	}
+	else if (allocated)
+	{
+		// There wasn't enough memory for the thread, so the cache gets built right here like it used to.
+		fileEditor.soundEditorCache = InitializeSoundEditor(fileEditor.channelsData[0]);
+	}
+
+	if (loaded && fileEditor.soundEditorCache != NULL)
 	{
 		InitializeModificationStack(&(fileEditor.modificationStack));
 
 		unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
 		fileEditor.channelsDomain = calloc(relevantChannels, sizeof(FunctionDomain));
+		fileEditor.channelsShadow = calloc(relevantChannels, sizeof(SpectralShadow*));
+		fileEditor.channelsPeaks = calloc(relevantChannels, sizeof(PeakPyramid*));
+		fileEditor.channelsMagnitudes = calloc(relevantChannels, sizeof(MagnitudePyramid*));
 		fileEditor.waveformGraphs = calloc(relevantChannels, sizeof(HBITMAP));
 		fileEditor.fourierGraphs = calloc(relevantChannels, sizeof(HBITMAP));
 		fileEditor.fourierGraphsPeaks = malloc(relevantChannels * sizeof(unsigned short));
 		fileEditor.currentSaveState = fileEditor.modificationStack;
 
+		// The journal sidecar is where edits go to survive a crash. Finding entries in it means a past session ended without getting to save them,
+		// so they get replayed now instead of being lost. A clean close always leaves the journal empty. New files have no path to journal next to yet.
+		fileEditor.sessionJournal = IsFileNew(fileInfo) ? NULL : OpenSessionJournal(fileInfo->path, NumOfSamples(fileEditor.channelsData[0]), relevantChannels);
+
+		if (SessionJournalEntries(fileEditor.sessionJournal) != 0)
+		{
+			ReplayJournalEntries();
+			MessageBox(windowHandle, TEXT("Edits from a session that ended unexpectedly were recovered and reapplied. Save the file to keep them."),
+					   TEXT("Recovered edits"), MB_OK | MB_ICONINFORMATION);
+		}
+
+		// A fresh file starts with the whole spectrum in view.
+		fileEditor.fourierZoomFrom = 0.0;
+		fileEditor.fourierZoomTo = 1.0;
+
 		// In here are things that are allocated once and kept until the program ends instead of being specific to each file.
 		// The fact that we only allocate these once means we have to be careful to deallocate it exactly once, meaning not in CloseFileEditor.
 		if (fileEditor.graphingDC == NULL)
@@ -1151,6 +1526,7 @@ void InitializeFileEditor(HWND windowHandle, FileInfo* fileInfo)
 			PlotChannelGraphs(i);
 		}
 
+		INSTRUMENT_REPORT("Open");
 		PaintFileEditor();
 	}
 	else // Deallocating functions if it failed.
@@ -1300,6 +1676,7 @@ void PaintFileEditorPermanents()
 	EnableMenuItem(mainMenu, NOTIF_CODIFY(FILE_ACTION_SAVE), MF_BYCOMMAND | MF_ENABLED);
 	EnableMenuItem(mainMenu, NOTIF_CODIFY(FILE_ACTION_SAVEAS), MF_BYCOMMAND | MF_ENABLED);
 	EnableMenuItem(mainMenu, NOTIF_CODIFY(EDIT_ACTION_APPLY), MF_BYCOMMAND | MF_ENABLED);
+	EnableMenuItem(mainMenu, NOTIF_CODIFY(EDIT_ACTION_PLAY), MF_BYCOMMAND | MF_ENABLED);
 }
 
 void PaintFileEditorTemporaries()
@@ -1332,55 +1709,84 @@ void PaintFileEditorTemporaries()
 	UpdateWindowTitle();
 	DisplayChannelGraphs(0);
 
-	unsigned int nyquist = GetNyquistInt(fileEditor.fileInfo);
-
-	// If the nyquist frequency is below 1000, the x axis is in hertz.
-	if (1000 >= nyquist)
-	{
-		TCHAR buffer[NUMBER_BUFFER_LEN];
-		_ultot_s(nyquist, buffer, NUMBER_BUFFER_LEN, 10);
-		_tcscat_s(buffer, NUMBER_BUFFER_LEN, TEXT("Hz"));
-
-		SendMessage(fileEditor.minFreqStatic, WM_SETTEXT, 0, (LPARAM)TEXT("0Hz"));
-		SendMessage(fileEditor.maxFreqStatic, WM_SETTEXT, 0, (LPARAM)buffer);
-	}
-	else // Nyquist frequency is above/equal 1000, using KHz.
-	{
-		TCHAR buffer[NUMBER_BUFFER_LEN];
-		_stprintf_s(buffer, NUMBER_BUFFER_LEN, TEXT("%gKHz"), nyquist / 1000.0);
-		
-		SendMessage(fileEditor.minFreqStatic, WM_SETTEXT, 0, (LPARAM)TEXT("0KHz"));
-		SendMessage(fileEditor.maxFreqStatic, WM_SETTEXT, 0, (LPARAM)buffer);
-	}
+	// The axis labels depend on the zoom, which was just reset for the new file.
+	UpdateFrequencyAxisLabels();
 }
 
 void SetChannelDomain(unsigned short channel, FunctionDomain domain)
 {
 	if (fileEditor.channelsDomain[channel] != domain)
 	{
-		if (domain == FREQUENCY_DOMAIN)
+		SpectralShadow* shadow = fileEditor.channelsShadow[channel];
+		char auditioningThisChannel = IsAudioPlaying() && channel == playbackChannel;
+
+		// The audition engine streams this channel's buffer, which is about to hold spectrum bins instead of a waveform. Muting it until the waveform is back.
+		if (auditioningThisChannel && domain != TIME_DOMAIN)
 		{
-			RealInterleavedFFT(fileEditor.channelsData[channel], fileEditor.soundEditorCache);
+			MuteAudioPlayback(TRUE);
+		}
+
+		// When the shadow holds an up-to-date copy of the other domain, flipping is just trading buffers with it. That's the common case -
+		// narrow-band edits keep the shadow in sync through BeginSpectralShadowBandEdit/EndSpectralShadowBandEdit, so the repeated
+		// waveform-fourier-waveform trips that editing cause don't pay for a single transform.
+		if (shadow != NULL && shadow->synced)
+		{
+			SwapSpectralShadow(shadow, &(fileEditor.channelsData[channel]));
 		}
 		else
 		{
-			InverseRealInterleavedFFT(fileEditor.channelsData[channel], fileEditor.soundEditorCache);
+			// Snapshotting the representation we're leaving into the shadow before transforming, so the flip back is free.
+			// Channels without shadows get one here, which means the very first flip is where the allocation cost is paid.
+			if (shadow == NULL)
+			{
+				fileEditor.channelsShadow[channel] = CreateSpectralShadow(fileEditor.channelsData[channel]);
+			}
+			else
+			{
+				RefreshSpectralShadow(shadow, fileEditor.channelsData[channel]);
+			}
+
+			if (domain == FREQUENCY_DOMAIN)
+			{
+				RealInterleavedFFT(fileEditor.channelsData[channel], fileEditor.soundEditorCache);
+			}
+			else
+			{
+				InverseRealInterleavedFFT(fileEditor.channelsData[channel], fileEditor.soundEditorCache);
+			}
 		}
 
 		fileEditor.channelsDomain[channel] = domain;
+
+		if (auditioningThisChannel && domain == TIME_DOMAIN)
+		{
+			MuteAudioPlayback(FALSE);
+		}
 	}
 }
 
-void SetAllChannelsDomain(FunctionDomain domain)
+// A pool job which brings the channels [begin, end) into the domain pointed to by the context. See SetAllChannelsDomain.
+static void SetChannelsDomainJob(void* context, unsigned long long begin, unsigned long long end)
 {
-	unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+	FunctionDomain domain = *CAST(context, FunctionDomain*);
 
-	for (unsigned short i = 0; i < relevantChannels; i++)
+	for (unsigned long long i = begin; i < end; i++)
 	{
 		SetChannelDomain(i, domain);
 	}
 }
 
+void SetAllChannelsDomain(FunctionDomain domain)
+{
+	unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+
+	// Every channel's conversion works on its own samples, so the pool converts them all concurrently. What the conversions do share is either
+	// read-only (the twiddle factor cache) or serializes behind its own lock: the mixed-radix shuffle scratch, the GPU plan, and the arena
+	// a flip allocates its spectral shadow from. The inner ParallelFor calls each conversion makes run serially when made from inside a pool
+	// worker, so the pool doesn't get oversubscribed. When there's one channel, its conversion still gets to use the pool for its own loops.
+	ParallelForHeavy(fileEditor.soundEditorCache->threadPool, SetChannelsDomainJob, &domain, 0, relevantChannels);
+}
+
 void PlotChannelWaveform(unsigned short channel)
 {	
 	// This macro contains the contents of this function that depend on the float precision. It needs to be declared at the start before it is used.
@@ -1438,6 +1844,13 @@ void PlotChannelWaveform(unsigned short channel)
 	}																																								\
 	else																																							\
 	{																																								\
+		/* The pyramid gets built on the channel's first plot and again whenever an edit resets it. If building it failed, we fall back to scanning with a step size.*/\
+		if (fileEditor.channelsPeaks[channel] == NULL)																												\
+		{																																							\
+			fileEditor.channelsPeaks[channel] = CreatePeakPyramid(fileEditor.channelsData[channel], length);														\
+		}																																							\
+																																									\
+		PeakPyramid_##precision##Real* peaks = (PeakPyramid_##precision##Real*)fileEditor.channelsPeaks[channel];													\
 		unsigned long long stepSize = GetPlottingStepSize();																										\
 																																									\
 		/* In this mode, for every x pixel, we find the min and max values from the set of samples that map to this pixel, and draw a line between them.*/			\
@@ -1447,9 +1860,11 @@ void PlotChannelWaveform(unsigned short channel)
 			unsigned long long startSample = llceil_DoubleReal(binSize * xCoord);																					\
 			unsigned long long endSample = ClampInt(llceil_DoubleReal(binSize * (xCoord + 1)), 0, length);															\
 																																									\
-			/* Finding the min and max values of all samples in the range [startSample, endSample).*/																\
-			precision##Real min = GetMin_##precision##Real(func, startSample, endSample, stepSize);																	\
-			precision##Real max = GetMax_##precision##Real(func, startSample, endSample, stepSize);																	\
+			/* Finding the min and max values of all samples in the range [startSample, endSample). The pyramid answers that exactly without rescanning the samples.*/\
+			precision##Real min = peaks != NULL ? GetPeakPyramidMin_##precision##Real(peaks, func, startSample, endSample)											\
+				: GetMin_##precision##Real(func, startSample, endSample, stepSize);																					\
+			precision##Real max = peaks != NULL ? GetPeakPyramidMax_##precision##Real(peaks, func, startSample, endSample)											\
+				: GetMax_##precision##Real(func, startSample, endSample, stepSize);																					\
 																																									\
 			/* Calculating the y pixel that the min and max samples map to, and drawing a line between them.*/														\
 			unsigned int minYCoord = ClampInt(halfHeight - (halfHeight * min), 0, GRAPH_HEIGHT - 1);																\
@@ -1460,6 +1875,7 @@ void PlotChannelWaveform(unsigned short channel)
 	}
 
 	SetChannelDomain(channel, TIME_DOMAIN);
+	INSTRUMENT_BEGIN(PAINT);
 
 	if (fileEditor.waveformGraphs[channel] == NULL)
 	{
@@ -1492,6 +1908,7 @@ void PlotChannelWaveform(unsigned short channel)
 	}
 
 	SelectObject(fileEditor.graphingDC, oldSelectedObj);
+	INSTRUMENT_END(PAINT);
 }
 
 void PlotChannelFourier(unsigned short channel)
@@ -1500,10 +1917,17 @@ void PlotChannelFourier(unsigned short channel)
 	#define PLOT_CHANNEL_FOURIER_TYPED(precision)																													\
 	Function_##precision##Complex func = *((Function_##precision##Complex*)fileEditor.channelsData[channel]);														\
 																																									\
+	/* The pyramid gets built on the channel's first plot and again whenever an edit resets it. If building it failed, we fall back to scanning with a step size.*/	\
+	if (fileEditor.channelsMagnitudes[channel] == NULL)																												\
+	{																																								\
+		fileEditor.channelsMagnitudes[channel] = CreateMagnitudePyramid(fileEditor.channelsData[channel], length);													\
+	}																																								\
+																																									\
+	MagnitudePyramid_##precision##Complex* magnitudes = (MagnitudePyramid_##precision##Complex*)fileEditor.channelsMagnitudes[channel];								\
 	unsigned long long stepSize = GetPlottingStepSize();																											\
 																																									\
-	/* We'll be plotting the graph such that the highest pixel represents the global maximum point.*/																\
-	precision##Real globalMax = abs_##precision##Complex(GetMax_##precision##Complex(func, 0, length, stepSize)); 													\
+	/* We'll be plotting the graph such that the highest pixel represents the global maximum point - global over the whole spectrum, so zooming doesn't rescale it.*/\
+	precision##Real globalMax = magnitudes != NULL ? magnitudes->globalMax : abs_##precision##Complex(GetMax_##precision##Complex(func, 0, length, stepSize));		\
 																																									\
 	/* Clamping the value so it isn't smaller than the decibel reference, which is the smallest number that we plot while globalMax is the highest.*/				\
 	globalMax = Clamp(globalMax, FOURIER_DECIBEL_REFERENCE, MAX_##precision##Real);																					\
@@ -1522,13 +1946,14 @@ void PlotChannelFourier(unsigned short channel)
 	/* Unlike waveforms, we don't need other plotting modes for low samples here because we zero-pad the DFT so it always has enough samples.*/						\
 	for (unsigned int i = 0; i < GRAPH_WIDTH; i++)																													\
 	{																																								\
-		/* Calculating the indices of the first (inclusive) and last (exclusive) samples which map to this x pixel.*/												\
+		/* Calculating the indices of the first (inclusive) and last (exclusive) bins which map to this x pixel, counted from where the zoom starts.*/				\
 		/* The sample at index 0 is special, it makes no sense to edit since it stands fo 0Hz (what the hell is 0Hz?) so we don't plot it.*/						\
-		unsigned long long startSample = llceil_DoubleReal(binSize * i) + (i == 0 ? 1 : 0);																			\
-		unsigned long long endSample = ClampInt(llceil_DoubleReal(binSize * (i + 1)), 0, length);																	\
+		unsigned long long startSample = visibleFrom + llceil_DoubleReal(binSize * i) + (visibleFrom == 0 && i == 0 ? 1 : 0);										\
+		unsigned long long endSample = ClampInt(visibleFrom + llceil_DoubleReal(binSize * (i + 1)), 0, visibleTo);													\
 																																									\
-		/* Finding the min and max values of all samples in the range [startSample, endSample).*/																	\
-		precision##Real max = abs_##precision##Complex(GetMax_##precision##Complex(func, startSample, endSample, stepSize));										\
+		/* Finding the biggest magnitude of all bins in the range [startSample, endSample). The pyramid answers that exactly without rescanning them.*/				\
+		precision##Real max = magnitudes != NULL ? GetMagnitudePyramidMax_##precision##Complex(magnitudes, func, startSample, endSample)							\
+			: abs_##precision##Complex(GetMax_##precision##Complex(func, startSample, endSample, stepSize));														\
 																																									\
 		/* Converting to logarithmic scale. Had a bug with the integer conversion when this returns -INF, so I only proceed if max is above the reference.*/		\
 		max = max < FOURIER_DECIBEL_REFERENCE ? 0.0 : LinearToDecibel##precision##Real(max, FOURIER_DECIBEL_REFERENCE); 											\
@@ -1540,6 +1965,7 @@ void PlotChannelFourier(unsigned short channel)
 	}																																								\
 
 	SetChannelDomain(channel, FREQUENCY_DOMAIN);
+	INSTRUMENT_BEGIN(PAINT);
 
 	if (fileEditor.fourierGraphs[channel] == NULL)
 	{
@@ -1557,9 +1983,12 @@ void PlotChannelFourier(unsigned short channel)
 	bitmapDimensions.bottom = GRAPH_HEIGHT;
 	FillRect(fileEditor.graphingDC, &bitmapDimensions, GetStockObject(WHITE_BRUSH));
 
-	// For every sample in the function that isn't zero-padding, setting the pixel it corresponds to. Length is doubled because we'll be reading a complex sequence as if it's a real sequence of twice the length.
+	// The graph only spans the slice of the bins that the zoom has in view, which is all of them when it's fully zoomed out.
+	// The zoom never goes past a bin per pixel, so every pixel always has at least one bin to show.
 	unsigned long long length = NumOfSamples(fileEditor.channelsData[channel]);
-	DoubleReal binSize = length / ((DoubleReal)GRAPH_WIDTH); // Always double precision because it's used for sample indices, not sample values.
+	unsigned long long visibleFrom = CAST(fileEditor.fourierZoomFrom * length, unsigned long long);
+	unsigned long long visibleTo = ClampInt(llceil_DoubleReal(fileEditor.fourierZoomTo * length), visibleFrom + 1, length);
+	DoubleReal binSize = (visibleTo - visibleFrom) / ((DoubleReal)GRAPH_WIDTH); // Always double precision because it's used for sample indices, not sample values.
 
 	// From this point on we need to know if the function uses single or double precision. Either way it's gonna be in complex interleaved form, more on that in the documentation of RealInterleavedFFT.
 	if (GetType(fileEditor.channelsData[channel]) == FloatComplexType)
@@ -1572,6 +2001,7 @@ void PlotChannelFourier(unsigned short channel)
 	}
 
 	SelectObject(fileEditor.graphingDC, oldSelectedObj);
+	INSTRUMENT_END(PAINT);
 }
 
 void PlotChannelGraphs(unsigned short channel)
@@ -1642,6 +2072,99 @@ unsigned long long GetPlottingStepSize()
 	return ClampInt(fileEditor.fileInfo->sampleLength / START_INCREASING_STEP_SIZE_THRESHOLD, 1, topClamp);
 }
 
+double FourierPixelToFrequency(int xPixel)
+{
+	// The graph's pixels only span the visible part of the spectrum, which is all of it when the zoom is fully out.
+	double nyquist = GetNyquistDouble(fileEditor.fileInfo);
+	double span = fileEditor.fourierZoomTo - fileEditor.fourierZoomFrom;
+	double freq = (fileEditor.fourierZoomFrom + ((span * xPixel) / (GRAPH_WIDTH - 1.0))) * nyquist;
+	return ClampDouble(freq, 0.0, nyquist);
+}
+
+void ZoomFourierGraph(int clicks, int xPixel)
+{
+	double span = fileEditor.fourierZoomTo - fileEditor.fourierZoomFrom;
+	double newSpan = span;
+
+	// The wheel reports whole clicks, so a couple of little loops beat pulling in pow for this.
+	for (int i = 0; i < clicks; i++)
+	{
+		newSpan *= FOURIER_ZOOM_PER_CLICK;
+	}
+
+	for (int i = 0; i > clicks; i--)
+	{
+		newSpan /= FOURIER_ZOOM_PER_CLICK;
+	}
+
+	// The view never gets narrower than a bin per pixel, because past that there's nothing more to resolve.
+	double minSpan = ClampDouble(CAST(GRAPH_WIDTH, double) / NumOfSamples(fileEditor.channelsData[0]), 0.0, 1.0);
+	newSpan = ClampDouble(newSpan, minSpan, 1.0);
+
+	// Anchoring the zoom so the frequency under the cursor stays under it, give or take the clamping at the spectrum's edges.
+	double anchor = fileEditor.fourierZoomFrom + ((span * xPixel) / (GRAPH_WIDTH - 1.0));
+	double newFrom = ClampDouble(anchor - (((anchor - fileEditor.fourierZoomFrom) * newSpan) / span), 0.0, 1.0 - newSpan);
+
+	if (newFrom != fileEditor.fourierZoomFrom || newSpan != span)
+	{
+		fileEditor.fourierZoomFrom = newFrom;
+		fileEditor.fourierZoomTo = newFrom + newSpan;
+		ReplotFourierGraphs();
+	}
+}
+
+void PanFourierGraph(int clicks)
+{
+	double span = fileEditor.fourierZoomTo - fileEditor.fourierZoomFrom;
+	double newFrom = ClampDouble(fileEditor.fourierZoomFrom + (clicks * FOURIER_PAN_PER_CLICK * span), 0.0, 1.0 - span);
+
+	if (newFrom != fileEditor.fourierZoomFrom)
+	{
+		fileEditor.fourierZoomFrom = newFrom;
+		fileEditor.fourierZoomTo = newFrom + span;
+		ReplotFourierGraphs();
+	}
+}
+
+void ReplotFourierGraphs()
+{
+	// Every channel's graph shares the zoom, and switching tabs displays whatever was plotted last, so they all get replotted here.
+	// The magnitude pyramids make each replot O(graph width) lookups, which is what makes wheeling around feel instant.
+	unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+
+	for (unsigned short i = 0; i < relevantChannels; i++)
+	{
+		PlotChannelFourier(i);
+	}
+
+	UpdateFrequencyAxisLabels();
+	DisplayChannelFourier(TabCtrl_GetCurSel(fileEditor.channelTabs));
+}
+
+void UpdateFrequencyAxisLabels()
+{
+	double nyquist = GetNyquistDouble(fileEditor.fileInfo);
+	double minFreq = fileEditor.fourierZoomFrom * nyquist;
+	double maxFreq = fileEditor.fourierZoomTo * nyquist;
+	TCHAR buffer[NUMBER_BUFFER_LEN];
+
+	// If the nyquist frequency is below 1000, the x axis is in hertz.
+	if (1000.0 >= nyquist)
+	{
+		_stprintf_s(buffer, NUMBER_BUFFER_LEN, TEXT("%.4gHz"), minFreq);
+		SendMessage(fileEditor.minFreqStatic, WM_SETTEXT, 0, (LPARAM)buffer);
+		_stprintf_s(buffer, NUMBER_BUFFER_LEN, TEXT("%.4gHz"), maxFreq);
+		SendMessage(fileEditor.maxFreqStatic, WM_SETTEXT, 0, (LPARAM)buffer);
+	}
+	else // Nyquist frequency is above/equal 1000, using KHz.
+	{
+		_stprintf_s(buffer, NUMBER_BUFFER_LEN, TEXT("%.4gKHz"), minFreq / 1000.0);
+		SendMessage(fileEditor.minFreqStatic, WM_SETTEXT, 0, (LPARAM)buffer);
+		_stprintf_s(buffer, NUMBER_BUFFER_LEN, TEXT("%.4gKHz"), maxFreq / 1000.0);
+		SendMessage(fileEditor.maxFreqStatic, WM_SETTEXT, 0, (LPARAM)buffer);
+	}
+}
+
 void UpdateSelection()
 {
 	InvalidateRect(fileEditor.fourierGraphStatic, NULL, FALSE);
@@ -1650,23 +2173,45 @@ void UpdateSelection()
 
 void CloseFileEditor()
 {
+	// The audition engine reads straight out of the channels, which are about to be deallocated.
+	StopAudioPlayback();
+
+	// The save thread reads the file and the snapshot, both of which are about to be torn down.
+	WaitForBackgroundSave();
+
 	DeallocateChannelsData();
+	DeallocateChannelsShadows();
+	DeallocateChannelsPeaks();
+	DeallocateChannelsMagnitudes();
 	DeallocateChannelsGraphs();
 	DeallocateSoundEditorCache(fileEditor.soundEditorCache);
 	DeallocateModificationStack(fileEditor.modificationStack);
+
+	// The close prompt already decided the fate of any unsaved changes, so the journal empties - nothing should come back to life next session.
+	ResetSessionJournal(fileEditor.sessionJournal);
+	CloseSessionJournal(fileEditor.sessionJournal);
 	CloseWaveFile(fileEditor.fileInfo);
 	free(fileEditor.channelsDomain);
 	free(fileEditor.fourierGraphsPeaks);
 
+	// Everything that borrowed from the session's arena has been deallocated by now, so its blocks can all go back at once.
+	SetFunctionArena(NULL);
+	DestroyMemoryArena(fileEditor.segmentArena);
+
 	fileEditor.fileInfo = NULL;
 	fileEditor.channelsData = NULL;
 	fileEditor.soundEditorCache = NULL;
 	fileEditor.channelsDomain = NULL;
+	fileEditor.channelsShadow = NULL;
+	fileEditor.channelsPeaks = NULL;
+	fileEditor.channelsMagnitudes = NULL;
+	fileEditor.segmentArena = NULL;
 	fileEditor.fourierGraphsPeaks = NULL;
 	fileEditor.waveformGraphs = NULL;
 	fileEditor.fourierGraphs = NULL;
 	fileEditor.modificationStack = NULL;
 	fileEditor.currentSaveState = NULL;
+	fileEditor.sessionJournal = NULL;
 
 	if (fileEditor.isSelecting)
 	{
@@ -1693,6 +2238,51 @@ void DeallocateChannelsData()
 	}
 }
 
+void DeallocateChannelsShadows()
+{
+	if (fileEditor.channelsShadow != NULL)
+	{
+		unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+
+		for (unsigned short i = 0; i < relevantChannels; i++)
+		{
+			DeallocateSpectralShadow(fileEditor.channelsShadow[i]);
+		}
+
+		free(fileEditor.channelsShadow);
+	}
+}
+
+void DeallocateChannelsPeaks()
+{
+	if (fileEditor.channelsPeaks != NULL)
+	{
+		unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+
+		for (unsigned short i = 0; i < relevantChannels; i++)
+		{
+			DeallocatePeakPyramid(fileEditor.channelsPeaks[i]);
+		}
+
+		free(fileEditor.channelsPeaks);
+	}
+}
+
+void DeallocateChannelsMagnitudes()
+{
+	if (fileEditor.channelsMagnitudes != NULL)
+	{
+		unsigned short relevantChannels = GetRelevantChannelsCount(fileEditor.fileInfo);
+
+		for (unsigned short i = 0; i < relevantChannels; i++)
+		{
+			DeallocateMagnitudePyramid(fileEditor.channelsMagnitudes[i]);
+		}
+
+		free(fileEditor.channelsMagnitudes);
+	}
+}
+
 void DeallocateChannelsGraphs()
 {
 	// Dodging a segfault with GetRelevantChannelsCount.
@@ -1742,7 +2332,7 @@ void UpdateWindowTitle()
 		// Extracting the file name from the full path, and appending " - Fourier".
 		// I decided not to impose a length limit because I fear cutting a unicode string in the middle might ruin it. Worst comes to worst, users get a long ass string at the top of the screen.
 		unsigned int pathLen = _tcslen(fileEditor.fileInfo->path);
-		unsigned int bufLen = pathLen + _tcslen(TITLE_POSTFIX) + 2; // Buffer must be large enough to hold the path name, an optional asterisk, the postfix, and the null terminator.
+		unsigned int bufLen = pathLen + _tcslen(SAVING_POSTFIX) + _tcslen(TITLE_POSTFIX) + 2; // Buffer must be large enough to hold the path name, an optional asterisk, the postfixes, and the null terminator.
 		TCHAR pathCopy[bufLen];
 		_tcscpy_s(pathCopy, pathLen + 1, fileEditor.fileInfo->path);
 		PathStripPath(pathCopy);
@@ -1753,7 +2343,25 @@ void UpdateWindowTitle()
 			_tcscat_s(pathCopy, pathLen + 2, TEXT("*"));
 		}
 
+		// Letting the user know their file is still being written in the background.
+		if (fileEditor.saveThread != NULL)
+		{
+			_tcscat_s(pathCopy, bufLen, SAVING_POSTFIX);
+		}
+
 		_tcscat_s(pathCopy, bufLen, TITLE_POSTFIX);
+
+#ifdef INSTRUMENT
+		// The last breakdown rides on the title bar, since the editor has no status bar to put it in.
+		if (InstrumentLastReport()[0] != '\0')
+		{
+			TCHAR statsTitle[bufLen + 256];
+			_stprintf_s(statsTitle, bufLen + 256, TEXT("%s  [%hs]"), pathCopy, InstrumentLastReport());
+			SetWindowText(mainWindowHandle, statsTitle);
+			return;
+		}
+#endif
+
 		SetWindowText(mainWindowHandle, pathCopy);
 	}
 }
@@ -2245,10 +2853,16 @@ LRESULT CALLBACK FourierGraphWindowProc(HWND windowHandle, UINT msg, WPARAM wpar
 
 				if (!isnan(from) && !isnan(to) && from <= to)
 				{
+					// The selection is stored in frequencies but painted in pixels, and the zoom decides the mapping between them. Selections that poke out of view clamp to the edges.
 					double nyquist = GetNyquistDouble(fileEditor.fileInfo);
-					int fromPixel = ClampInt((from / nyquist) * (GRAPH_WIDTH - 1),  0, GRAPH_WIDTH - 1);
-					int toPixel = ClampInt((to / nyquist) * GRAPH_WIDTH, 0, GRAPH_WIDTH);
-					BitBlt(fileEditor.currentFourierDC, fromPixel, 0, toPixel - fromPixel, GRAPH_HEIGHT, NULL, 0, 0, PATINVERT);
+					double span = fileEditor.fourierZoomTo - fileEditor.fourierZoomFrom;
+					int fromPixel = ClampInt((((from / nyquist) - fileEditor.fourierZoomFrom) / span) * (GRAPH_WIDTH - 1), 0, GRAPH_WIDTH - 1);
+					int toPixel = ClampInt((((to / nyquist) - fileEditor.fourierZoomFrom) / span) * GRAPH_WIDTH, 0, GRAPH_WIDTH);
+
+					if (fromPixel < toPixel)
+					{
+						BitBlt(fileEditor.currentFourierDC, fromPixel, 0, toPixel - fromPixel, GRAPH_HEIGHT, NULL, 0, 0, PATINVERT);
+					}
 				}
 
 				// Now we blit the fully painted thing onto the static control.